@@ -0,0 +1,89 @@
+﻿#pragma once
+
+//
+// 複数のGameを同時に実行
+// ステージ設定と乱数の種の組み合わせごとに1つのGameを作り、
+// スレッドに分担させて最速で進める
+//
+
+#include <algorithm>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "cinder/Json.h"
+#include "cinder/Timer.h"
+#include "ThreadPool.hpp"
+#include "HeadlessRunner.hpp"
+
+
+namespace ngs {
+
+class BatchRunner {
+public:
+  struct Job {
+    // TIPS:Gameごとに複製してから使う
+    const ci::JsonTree* params;
+    u_int seed;
+  };
+
+  // 実行結果の集計
+  struct Report {
+    size_t games;
+    size_t threads;
+
+    u_int  ticks;
+    double sim_time;
+    double wall_time;
+  };
+
+
+  // 全てのJobを指定したtick数だけ進める
+  // script:全てのGameに与える入力
+  static Report run(ThreadPool& thread_pool, const std::vector<Job>& jobs,
+                    const u_int ticks, const std::string& script = std::string()) {
+    std::vector<double> sim_times(jobs.size());
+
+    ci::Timer timer(true);
+    thread_pool.parallelFor(jobs.size(),
+                            [&jobs, &sim_times, ticks, &script](size_t index, size_t thread) {
+                              // TIPS:設定を共有しない
+                              ci::JsonTree params(*jobs[index].params);
+                              HeadlessRunner runner(params, jobs[index].seed);
+                              if (!script.empty()) {
+                                std::istringstream input(script);
+                                runner.script(input);
+                              }
+
+                              sim_times[index] = runner.run(ticks).sim_time;
+                            });
+
+    Report report = {
+      jobs.size(),
+      thread_pool.threadNum(),
+      ticks,
+      0.0,
+      timer.getSeconds()
+    };
+    for (auto time : sim_times) {
+      report.sim_time += time;
+    }
+
+    return report;
+  }
+
+
+  static void print(std::ostream& output, const Report& report) {
+    double wall_time = std::max(report.wall_time, 1e-9);
+
+    output << "threads:" << report.threads
+           << " games:" << report.games
+           << " wall:" << report.wall_time << "s"
+           << " games/min:" << report.games / wall_time * 60.0
+           << " speed:" << report.sim_time / wall_time << "x"
+           << std::endl;
+  }
+
+};
+
+}
@@ -0,0 +1,167 @@
+﻿#pragma once
+
+//
+// バイナリの読み書き
+// 値はメモリ上の表現をそのまま並べる(同じ環境で読み書きする前提)
+// TIPS:memcpyでコピーできる型だけ扱う
+//
+// operator&で保存と読み込みを同じ記述にできる
+//   template <typename Self, typename Stream>
+//   static void transfer(Self& self, Stream& stream) { stream & self.a & self.b; }
+//
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+
+namespace ngs {
+
+class BinaryWriter {
+  std::vector<u_char> data_;
+
+
+public:
+  BinaryWriter() = default;
+
+
+  template <typename T>
+  void put(const T& value) {
+    const auto* p = reinterpret_cast<const u_char*>(&value);
+    data_.insert(std::end(data_), p, p + sizeof(T));
+  }
+
+  void put(const std::string& text) {
+    put(u_int(text.size()));
+    data_.insert(std::end(data_), std::begin(text), std::end(text));
+  }
+
+  template <typename T>
+  void put(const std::vector<T>& values) {
+    put(u_int(values.size()));
+    for (const auto& value : values) {
+      put(value);
+    }
+  }
+
+  template <typename T>
+  BinaryWriter& operator&(const T& value) {
+    put(value);
+    return *this;
+  }
+
+
+  void clear() { data_.clear(); }
+
+  const std::vector<u_char>& data() const { return data_; }
+  size_t size() const { return data_.size(); }
+
+  // 内容のハッシュ値(FNV-1a)
+  // 同じ内容を書き込んだかどうかの比較に使う
+  u_int hash() const {
+    u_int value = 2166136261u;
+    for (auto byte : data_) {
+      value = (value ^ byte) * 16777619u;
+    }
+    return value;
+  }
+
+  bool write(const std::string& path) const {
+    std::ofstream file(path, std::ios::binary);
+    if (!file) return false;
+
+    file.write(reinterpret_cast<const char*>(data_.data()), data_.size());
+    return bool(file);
+  }
+
+};
+
+
+class BinaryReader {
+  std::vector<u_char> data_;
+  size_t pos_;
+  // 範囲外を読もうとしたらfalse
+  bool good_;
+
+
+public:
+  BinaryReader() :
+    pos_(0),
+    good_(true)
+  { }
+
+  explicit BinaryReader(std::vector<u_char> data) :
+    data_(std::move(data)),
+    pos_(0),
+    good_(true)
+  { }
+
+
+  bool read(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+
+    data_.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    pos_  = 0;
+    good_ = true;
+    return true;
+  }
+
+
+  template <typename T>
+  bool get(T& value) {
+    if (!good_ || ((pos_ + sizeof(T)) > data_.size())) {
+      good_ = false;
+      return false;
+    }
+
+    std::memcpy(&value, &data_[pos_], sizeof(T));
+    pos_ += sizeof(T);
+    return true;
+  }
+
+  bool get(std::string& text) {
+    u_int size;
+    if (!get(size)) return false;
+    if ((pos_ + size) > data_.size()) {
+      good_ = false;
+      return false;
+    }
+
+    text.assign(reinterpret_cast<const char*>(&data_[pos_]), size);
+    pos_ += size;
+    return true;
+  }
+
+  template <typename T>
+  bool get(std::vector<T>& values) {
+    u_int size;
+    if (!get(size)) return false;
+    // TIPS:壊れたデータで巨大な確保をしない
+    if (size > (data_.size() - pos_)) {
+      good_ = false;
+      return false;
+    }
+
+    values.resize(size);
+    for (auto& value : values) {
+      if (!get(value)) return false;
+    }
+    return true;
+  }
+
+  template <typename T>
+  BinaryReader& operator&(T& value) {
+    get(value);
+    return *this;
+  }
+
+
+  bool good() const { return good_; }
+  bool eof() const { return pos_ >= data_.size(); }
+
+};
+
+}
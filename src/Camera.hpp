@@ -5,6 +5,8 @@
 //
 
 #include "cinder/params/Params.h"
+#include "BinaryStream.hpp"
+#include "WorldState.hpp"
 
 
 namespace ngs {
@@ -13,8 +15,17 @@ class Camera {
   Message& message_;
   Message::ConnectionHolder connection_holder_;
   const ci::JsonTree& params_;
+  const WorldState& world_;
+
+  // WorldStateを読んだ時の版(変わっていなければ目標位置を求め直さない)
+  u_int world_version_;
+  bool  world_read_;
+  // 追いかけているCubeが回転移動中
+  bool  follow_rotation_;
 
   ci::CameraPersp camera_;
+  // 表示領域の大きさ
+  ci::Vec2i size_;
   
   ci::Vec3f eye_pos_;
   ci::Vec3f interest_pos_;
@@ -22,6 +33,15 @@ class Camera {
   ci::Vec3f target_eye_pos_;
   ci::Vec3f target_interest_pos_;
 
+  // 現在の状態
+  // TIPS:camera_から読み戻すと誤差が出るので、こちらを正として毎回camera_へ設定する
+  ci::Vec3f current_eye_pos_;
+  ci::Vec3f current_interest_pos_;
+
+  // 直前のtickの状態(描画補間用)
+  ci::Vec3f prev_eye_pos_;
+  ci::Vec3f prev_interest_pos_;
+
   float fov_;
   float near_;
 
@@ -33,17 +53,26 @@ class Camera {
   
   
 public:
-  Camera(Message& message, const ci::JsonTree& params) :
+  Camera(Message& message, const ci::JsonTree& params, const WorldState& world) :
     message_(message),
     params_(params),
-    camera_(ci::app::getWindowWidth(), ci::app::getWindowHeight(), 
+    world_(world),
+    world_version_(0),
+    world_read_(false),
+    follow_rotation_(false),
+    camera_(params.getValueForKey<int>("app.width"), params.getValueForKey<int>("app.height"),
             params.getValueForKey<float>("camera.fov"),
             params.getValueForKey<float>("camera.nearZ"),
             params.getValueForKey<float>("camera.farZ")),
+    size_(params.getValueForKey<int>("app.width"), params.getValueForKey<int>("app.height")),
     eye_pos_(Json::getVec3<float>(params["camera.eyePos"])),
     interest_pos_(Json::getVec3<float>(params["camera.interestPos"])),
     target_eye_pos_(eye_pos_),
     target_interest_pos_(interest_pos_),
+    current_eye_pos_(eye_pos_),
+    current_interest_pos_(interest_pos_),
+    prev_eye_pos_(eye_pos_),
+    prev_interest_pos_(interest_pos_),
     fov_(params.getValueForKey<float>("camera.fov")),
     near_(params.getValueForKey<float>("camera.nearZ")),
     center_rate_(params.getValueForKey<float>("camera.centerRate")),
@@ -56,13 +85,16 @@ public:
     
     connection_holder_ += message.connect(Msg::POST_UPDATE, this, &Camera::update);
     connection_holder_ += message.connect(Msg::RESET_STAGE, this, &Camera::reset);
+    connection_holder_ += message.connect(Msg::PARAMS_CHANGED, this, &Camera::paramsChanged);
   }
 
 
-  void resize() {
+  // TIPS:Windowが無くても動作するよう、大きさは呼び出し側が指定する
+  void resize(const ci::Vec2i& size) {
     DOUT << "resize()" << std::endl;
-    
-    float aspect = ci::app::getWindowAspectRatio();
+
+    size_ = size;
+    float aspect = size_.x / float(size_.y);
     camera_.setAspectRatio(aspect);
     if (aspect < 1.0) {
       // 画面が縦長になったら、幅基準でfovを求める
@@ -82,16 +114,62 @@ public:
     }
     DOUT << "camera fov:" << camera_.getFov()
          << " aspect ratio:" << aspect
-         << " window size:" << ci::app::getWindowSize()
+         << " window size:" << size_
          << std::endl;
   }
 
   ci::CameraPersp& body() { return camera_; }
 
+  // 直前のtickとの間を補間した描画用のカメラ
+  ci::CameraPersp interpolate(const float rate) const {
+    ci::CameraPersp camera(camera_);
+    camera.setEyePoint(prev_eye_pos_.lerp(rate, current_eye_pos_));
+    camera.setCenterOfInterestPoint(prev_interest_pos_.lerp(rate, current_interest_pos_));
+    return camera;
+  }
+
+
+  // スナップショット
+  // TIPS:表示領域の大きさは入力側の状態なので保存しない
+  template <typename Self, typename Stream>
+  static void transfer(Self& self, Stream& stream) {
+    stream & self.target_eye_pos_ & self.target_interest_pos_
+           & self.current_eye_pos_ & self.current_interest_pos_
+           & self.prev_eye_pos_ & self.prev_interest_pos_;
+  }
+
+  void save(BinaryWriter& writer) const { transfer(*this, writer); }
+
+  // 途中で読めなくなったらfalse(その時は何も書き換えない)
+  bool load(BinaryReader& reader) {
+    struct {
+      ci::Vec3f target_eye_pos_;
+      ci::Vec3f target_interest_pos_;
+      ci::Vec3f current_eye_pos_;
+      ci::Vec3f current_interest_pos_;
+      ci::Vec3f prev_eye_pos_;
+      ci::Vec3f prev_interest_pos_;
+    } saved;
+    transfer(saved, reader);
+    if (!reader.good()) return false;
+
+    target_eye_pos_       = saved.target_eye_pos_;
+    target_interest_pos_  = saved.target_interest_pos_;
+    current_eye_pos_      = saved.current_eye_pos_;
+    current_interest_pos_ = saved.current_interest_pos_;
+    prev_eye_pos_         = saved.prev_eye_pos_;
+    prev_interest_pos_    = saved.prev_interest_pos_;
+
+    world_read_ = false;
+    camera_.setEyePoint(current_eye_pos_);
+    camera_.setCenterOfInterestPoint(current_interest_pos_);
+    return true;
+  }
+
 
   ci::Ray generateRay(const ci::Vec2f& pos) {
-    float u = pos.x / (float) ci::app::getWindowWidth();
-    float v = pos.y / (float) ci::app::getWindowHeight();
+    float u = pos.x / (float) size_.x;
+    float v = pos.y / (float) size_.y;
     // because OpenGL and Cinder use a coordinate system
     // where (0, 0) is in the LOWERleft corner, we have to flip the v-coordinate
     return std::move(camera_.generateRay(u, 1.0f - v, camera_.getAspectRatio()));
@@ -100,49 +178,85 @@ public:
   
 private:
   void update(const Message::Connection& connection, Param& params) {
-    float easing_rate = ease_cube_stop_;
-
-    const auto& cube_info = boost::any_cast<const std::vector<CubeInfo>& >(params["playerInfo"]);
-    if (!cube_info.empty()) {
-      const auto cube_it = std::find_if(std::begin(cube_info), std::end(cube_info),
-                                        [](const CubeInfo& info) {
-                                          return info.manipulate;
-                                        });
-      
-      const auto& player_pos = cube_it->pos;
-
-      // Stageの中心から左右への移動量 -> offset
-      float stage_width  = boost::any_cast<float>(params["stageWidth"]);
-      float center_x = stage_width / 2;
-
-      // Stageの下端からの移動量 -> offset
-      // float stage_length = boost::any_cast<float>(params["stageLength"]);
-      float bottom_z     = boost::any_cast<float>(params["stageBottomZ"]);
-
-      ci::Vec3f pos;
-      pos.x = center_x + (player_pos.x - center_x) * center_rate_;
-      pos.z = bottom_z + (player_pos.z - bottom_z) * bottom_rate_;
-        
-      target_eye_pos_      = eye_pos_ + pos;
-      target_interest_pos_ = interest_pos_ + pos;
-
-      if (cube_it->now_rotation) easing_rate = ease_cube_move_;
+    prev_eye_pos_      = current_eye_pos_;
+    prev_interest_pos_ = current_interest_pos_;
+
+    if (!world_read_ || (world_version_ != world_.version())) {
+      updateTarget();
+      world_version_ = world_.version();
+      world_read_    = true;
     }
 
+    float easing_rate = follow_rotation_ ? ease_cube_move_ : ease_cube_stop_;
+
     // TODO:なめらか補完
-    auto eye_pos = camera_.getEyePoint();
-    camera_.setEyePoint(eye_pos + (target_eye_pos_ - eye_pos) * easing_rate);
+    current_eye_pos_      += (target_eye_pos_ - current_eye_pos_) * easing_rate;
+    current_interest_pos_ += (target_interest_pos_ - current_interest_pos_) * easing_rate;
 
-    auto interest_pos = camera_.getCenterOfInterestPoint();
-    camera_.setCenterOfInterestPoint(interest_pos + (target_interest_pos_ - interest_pos) * easing_rate);
+    camera_.setEyePoint(current_eye_pos_);
+    camera_.setCenterOfInterestPoint(current_interest_pos_);
+  }
+
+  // 操作しているCubeとStageの位置から目標位置を決める
+  void updateTarget() {
+    follow_rotation_ = false;
+
+    const auto* cube = world_.manipulatedCube();
+    if (!cube) return;
+
+    const auto& player_pos = cube->pos;
+    const auto& stage      = world_.stage();
+
+    // Stageの中心から左右への移動量 -> offset
+    float center_x = stage.width / 2;
+
+    // Stageの下端からの移動量 -> offset
+    float bottom_z = stage.bottom_z;
+
+    ci::Vec3f pos;
+    pos.x = center_x + (player_pos.x - center_x) * center_rate_;
+    pos.z = bottom_z + (player_pos.z - bottom_z) * bottom_rate_;
+
+    target_eye_pos_      = eye_pos_ + pos;
+    target_interest_pos_ = interest_pos_ + pos;
+
+    follow_rotation_ = cube->now_rotation;
+  }
+
+  // 書き換えた設定値を読み直す
+  // TIPS:今の位置はそのままで、新しい目標位置へ追いかける
+  void paramsChanged(const Message::Connection& connection, Param& param) {
+    const auto& paths = boost::any_cast<const std::vector<std::string>& >(param["paths"]);
+    if (!Json::isChanged(paths, "camera")) return;
+
+    eye_pos_      = Json::getVec3<float>(params_["camera.eyePos"]);
+    interest_pos_ = Json::getVec3<float>(params_["camera.interestPos"]);
+
+    fov_  = params_.getValueForKey<float>("camera.fov");
+    near_ = params_.getValueForKey<float>("camera.nearZ");
+    camera_.setPerspective(fov_, camera_.getAspectRatio(),
+                           near_, params_.getValueForKey<float>("camera.farZ"));
+    resize(size_);
+
+    center_rate_    = params_.getValueForKey<float>("camera.centerRate");
+    bottom_rate_    = params_.getValueForKey<float>("camera.bottomRate");
+    ease_cube_stop_ = params_.getValueForKey<float>("camera.easeCubeStop");
+    ease_cube_move_ = params_.getValueForKey<float>("camera.easeCubeMove");
+
+    world_read_ = false;
   }
 
   void reset(const Message::Connection& connection, Param& param) {
     eye_pos_      = Json::getVec3<float>(params_["camera.eyePos"]);
     interest_pos_ = Json::getVec3<float>(params_["camera.interestPos"]);
 
-    camera_.setEyePoint(eye_pos_);
-    camera_.setCenterOfInterestPoint(interest_pos_);
+    current_eye_pos_      = eye_pos_;
+    current_interest_pos_ = interest_pos_;
+    camera_.setEyePoint(current_eye_pos_);
+    camera_.setCenterOfInterestPoint(current_interest_pos_);
+
+    prev_eye_pos_      = eye_pos_;
+    prev_interest_pos_ = interest_pos_;
   }
   
 };
@@ -0,0 +1,121 @@
+﻿#pragma once
+
+//
+// Cinderのaudioで音を鳴らす
+// 再生ノードはcategory(pool)ごとに声の数だけ最初に作って繋いでおき、鳴らす時に作らない
+// TODO:fade in/out
+// TODO:Pan
+//
+
+#include <vector>
+#include "cinder/audio/Context.h"
+#include "cinder/audio/SamplePlayerNode.h"
+#include "cinder/audio/NodeEffects.h"
+#include "SoundBackend.hpp"
+
+
+namespace ngs {
+
+class CinderSoundBackend : public SoundBackend {
+  ci::audio::Context* ctx_;
+  // TIPS:読み込み用のスレッドからContextを触らないよう、先に調べておく
+  size_t sample_rate_;
+
+  // 1つの声
+  // TIPS:typeが"file"ならストリーミング再生用、それ以外は効果音用のノードを持つ
+  struct Voice {
+    ci::audio::FilePlayerNodeRef file;
+    ci::audio::BufferPlayerNodeRef buffer;
+    ci::audio::SamplePlayerNodeRef node;
+    ci::audio::GainNodeRef gain;
+  };
+
+  // poolの番号で引く
+  std::vector<std::vector<Voice> > voices_;
+
+
+public:
+  CinderSoundBackend() :
+    ctx_(ci::audio::Context::master())
+  {
+    ctx_->enable();
+    sample_rate_ = ctx_->getSampleRate();
+  }
+
+  ~CinderSoundBackend() {
+    for (auto& pool : voices_) {
+      for (auto& voice : pool) {
+        voice.node->stop();
+        voice.node->disconnectAll();
+        voice.gain->disconnectAll();
+      }
+    }
+  }
+
+
+  boost::any load(const std::string& type, const std::string& path) override {
+    try {
+      auto source = ci::audio::load(ci::app::loadAsset(path), sample_rate_);
+      loads_ += 1;
+      if (type == "buffer") return boost::any(source->loadBuffer());
+      return boost::any(source);
+    }
+    catch (const std::exception& exception) {
+      DOUT << "Can't load sound:" << path << " " << exception.what() << std::endl;
+      return boost::any();
+    }
+  }
+
+  void setupVoices(const std::string& type, const size_t pool, const size_t num) override {
+    SoundBackend::setupVoices(type, pool, num);
+
+    if (voices_.size() <= pool) voices_.resize(pool + 1);
+    auto& voices = voices_[pool];
+    voices.resize(num);
+    for (auto& voice : voices) {
+      if (type == "file") {
+        voice.file = ctx_->makeNode(new ci::audio::FilePlayerNode());
+        voice.node = voice.file;
+      }
+      else {
+        voice.buffer = ctx_->makeNode(new ci::audio::BufferPlayerNode());
+        voice.node   = voice.buffer;
+      }
+      voice.gain = ctx_->makeNode(new ci::audio::GainNode(1.0f));
+
+      voice.node >> voice.gain >> ctx_->getOutput();
+    }
+  }
+
+  void play(const size_t pool, const size_t index,
+            const boost::any& source, const bool loop, const float gain) override {
+    SoundBackend::play(pool, index, source, loop, gain);
+
+    auto& voice = voices_[pool][index];
+    voice.node->stop();
+    if (voice.file) {
+      voice.file->setSourceFile(boost::any_cast<const ci::audio::SourceFileRef&>(source));
+    }
+    else {
+      voice.buffer->setBuffer(boost::any_cast<const ci::audio::BufferRef&>(source));
+    }
+    voice.node->setLoopEnabled(loop);
+    voice.gain->setValue(gain);
+
+    voice.node->start();
+  }
+
+  void stop(const size_t pool, const size_t index) override {
+    SoundBackend::stop(pool, index);
+
+    voices_[pool][index].node->stop();
+  }
+
+  bool isPlaying(const size_t pool, const size_t index) const override {
+    const auto& node = voices_[pool][index].node;
+    return node->isEnabled() && !node->isEof();
+  }
+
+};
+
+}
@@ -0,0 +1,100 @@
+﻿#pragma once
+
+//
+// 固定長のロックを使わない命令の待ち行列
+// pushはどのスレッドからでも呼べる。popは受け取る側の1つのスレッドから呼ぶ
+// 最初に全て確保するので、push/popでは確保しない(いっぱいならpushは失敗する)
+//
+// TIPS:各要素に順番を持たせ、書き込みが終わったかどうかを判断する
+//      (Dmitry Vyukovのbounded MPMC queueと同じ仕組み)
+//
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+
+namespace ngs {
+
+template <typename T>
+class CommandQueue {
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T data;
+  };
+
+  std::unique_ptr<Cell[]> cells_;
+  size_t mask_;
+
+  // TIPS:書く側と読む側が同じキャッシュラインを取り合わないよう離しておく
+  char pad0_[64];
+  std::atomic<size_t> push_pos_;
+  char pad1_[64];
+  std::atomic<size_t> pop_pos_;
+  char pad2_[64];
+
+
+  // TIPS:コピー不可
+  CommandQueue(const CommandQueue&) = delete;
+  CommandQueue& operator=(const CommandQueue&) = delete;
+
+
+public:
+  // capacityは2のべき乗に切り上げる
+  explicit CommandQueue(const size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) size *= 2;
+
+    cells_ = std::unique_ptr<Cell[]>(new Cell[size]);
+    mask_  = size - 1;
+    for (size_t i = 0; i < size; ++i) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    push_pos_.store(0, std::memory_order_relaxed);
+    pop_pos_.store(0, std::memory_order_relaxed);
+  }
+
+
+  // いっぱいならfalse
+  bool push(const T& data) {
+    Cell* cell;
+    size_t pos = push_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &cells_[pos & mask_];
+      size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      auto diff = std::ptrdiff_t(sequence) - std::ptrdiff_t(pos);
+      if (diff == 0) {
+        // 他のスレッドに先を越されたらposが更新されるので、やり直す
+        if (push_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+      }
+      else if (diff < 0) {
+        return false;
+      }
+      else {
+        pos = push_pos_.load(std::memory_order_relaxed);
+      }
+    }
+
+    cell->data = data;
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // 空ならfalse
+  bool pop(T& data) {
+    size_t pos = pop_pos_.load(std::memory_order_relaxed);
+    Cell* cell = &cells_[pos & mask_];
+    size_t sequence = cell->sequence.load(std::memory_order_acquire);
+    if (std::ptrdiff_t(sequence) - std::ptrdiff_t(pos + 1) < 0) return false;
+
+    data = cell->data;
+    cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+    pop_pos_.store(pos + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  size_t capacity() const { return mask_ + 1; }
+
+};
+
+}
@@ -0,0 +1,304 @@
+﻿#pragma once
+
+//
+// 設定ファイルの監視
+// 書き換えられたら別スレッドで読み込み、前回の内容との差分(変わった節)を作っておく
+// 呼び出し側は差分を受け取り、設定値の変わった節だけを置き換える
+//
+// Linuxではinotify、それ以外は更新時刻を一定間隔で調べる
+//
+// TIPS:差分の基準は前回読み込んだ内容(呼び出し側の設定値は読まない)
+//
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "cinder/Json.h"
+#include "cinder/DataSource.h"
+#include "cinder/Filesystem.h"
+
+#if defined (__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+
+namespace ngs {
+
+class ConfigWatcher {
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  struct Change {
+    // 根からたどる子の番号
+    std::vector<size_t> indices;
+    // "camera.easeCubeStop" "stage.data.1.collapseSpeed" の形式
+    std::string path;
+    ci::JsonTree value;
+  };
+
+  struct Update {
+    std::vector<Change> changes;
+    // 一番上の節が増減した(全体を置き換えたので、作り直さないと反映されない値がある)
+    bool restart;
+    // 読み込めなかった時の理由
+    std::string error;
+
+    // 書き換えを検出した時刻
+    Clock::time_point detected;
+    // 読み込みと差分にかかった時間(秒)
+    double parse_time;
+  };
+
+
+private:
+  std::string path_;
+  // 更新時刻を調べる間隔(秒)
+  double interval_;
+  // 書き換えが続いている間は読み込まない時間(秒)
+  double settle_;
+
+  // 前回読み込んだ内容
+  // TIPS:監視スレッドだけが使う
+  ci::JsonTree base_;
+
+  std::mutex mutex_;
+  std::condition_variable wakeup_;
+  std::deque<Update> updates_;
+  bool quit_;
+
+  std::thread thread_;
+
+
+  // TIPS:コピー不可
+  ConfigWatcher(const ConfigWatcher&) = delete;
+  ConfigWatcher& operator=(const ConfigWatcher&) = delete;
+
+
+public:
+  // params:pathから読み込んだ今の設定値
+  ConfigWatcher(const std::string& path, const ci::JsonTree& params,
+                const double interval, const double settle) :
+    path_(path),
+    interval_(interval),
+    settle_(settle),
+    base_(params),
+    quit_(false)
+  {
+    thread_ = std::thread([this]() { watch(); });
+  }
+
+  ~ConfigWatcher() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      quit_ = true;
+    }
+    wakeup_.notify_all();
+    thread_.join();
+  }
+
+
+  // 読み込み済みの変更を1つ取り出す(なければfalse)
+  bool fetch(Update& update) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (updates_.empty()) return false;
+
+    update = std::move(updates_.front());
+    updates_.pop_front();
+    return true;
+  }
+
+  // 変更をparamsへ書き込む
+  // TIPS:変わった節だけを置き換えるので、それ以外の節の値はそのまま
+  static void apply(ci::JsonTree& params, const Change& change) {
+    if (change.indices.empty()) {
+      params = change.value;
+      return;
+    }
+
+    ci::JsonTree* node = &params;
+    for (size_t i = 0; (i + 1) < change.indices.size(); ++i) {
+      node = &node->getChild(change.indices[i]);
+    }
+    node->replaceChild(change.indices.back(), change.value);
+  }
+
+  // 書き換えを検出してからの時間(秒)
+  static double elapsed(const Clock::time_point& detected) {
+    return std::chrono::duration<double>(Clock::now() - detected).count();
+  }
+
+
+private:
+  void watch() {
+#if defined (__linux__)
+    if (watchNotify()) return;
+#endif
+    watchTime();
+  }
+
+  // 終了を指示されるまで待つ(指示されたらtrue)
+  bool wait(const double seconds) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return wakeup_.wait_for(lock, std::chrono::duration<double>(seconds),
+                            [this]() { return quit_; });
+  }
+
+  bool isQuit() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return quit_;
+  }
+
+
+#if defined (__linux__)
+  // 置き場所ごと監視する(エディタは別名で書いてから置き換えることがある)
+  // TIPS:inotifyが使えなければfalse
+  bool watchNotify() {
+    auto separator = path_.find_last_of('/');
+    std::string directory = (separator == std::string::npos) ? "." : path_.substr(0, separator);
+    std::string name      = (separator == std::string::npos) ? path_ : path_.substr(separator + 1);
+
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) return false;
+    if (inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+      close(fd);
+      return false;
+    }
+
+    while (!isQuit()) {
+      // TIPS:終了を調べるため、一定時間で戻る
+      pollfd target = { fd, POLLIN, 0 };
+      if (poll(&target, 1, int(interval_ * 1000.0)) <= 0) continue;
+      if (!readNotify(fd, name)) continue;
+
+      auto detected = Clock::now();
+      if (wait(settle_)) break;
+      // 待っている間の通知は読み捨てる
+      readNotify(fd, name);
+
+      load(detected);
+    }
+
+    close(fd);
+    return true;
+  }
+
+  // nameへの通知があったらtrue
+  static bool readNotify(const int fd, const std::string& name) {
+    alignas(inotify_event) char buffer[4096];
+
+    bool notified = false;
+    ssize_t length;
+    while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+      for (char* p = buffer; p < (buffer + length); ) {
+        const auto* event = reinterpret_cast<const inotify_event*>(p);
+        if (event->len && (name == event->name)) notified = true;
+        p += sizeof(inotify_event) + event->len;
+      }
+    }
+    return notified;
+  }
+#endif
+
+  void watchTime() {
+    ci::fs::path path(path_);
+    boost::system::error_code error;
+    auto last_time = ci::fs::last_write_time(path, error);
+
+    while (!wait(interval_)) {
+      auto time = ci::fs::last_write_time(path, error);
+      if (error || (time == last_time)) continue;
+
+      auto detected = Clock::now();
+      last_time = time;
+      if (wait(settle_)) break;
+
+      load(detected);
+    }
+  }
+
+
+  // 読み込んで差分を作る
+  void load(const Clock::time_point& detected) {
+    Update update;
+    update.restart  = false;
+    update.detected = detected;
+
+    auto start = Clock::now();
+    try {
+      ci::JsonTree params = ci::JsonTree(ci::loadFile(path_));
+
+      std::vector<size_t> indices;
+      diff(base_, params, indices, "", update.changes);
+      update.restart = !update.changes.empty() && update.changes.front().indices.empty();
+      base_ = params;
+    }
+    catch (const std::exception& exception) {
+      update.error = exception.what();
+    }
+    update.parse_time = elapsed(start);
+
+    if (update.changes.empty() && update.error.empty()) return;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    updates_.push_back(std::move(update));
+  }
+
+
+  // 同じ形の節か(値の節は値を比べない)
+  static bool isSameShape(const ci::JsonTree& prev, const ci::JsonTree& next) {
+    if (prev.getNodeType() != next.getNodeType()) return false;
+    if (prev.getNumChildren() != next.getNumChildren()) return false;
+    if (next.getNodeType() != ci::JsonTree::NODE_OBJECT) return true;
+
+    auto it = prev.begin();
+    for (const auto& child : next) {
+      if (child.getKey() != it->getKey()) return false;
+      ++it;
+    }
+    return true;
+  }
+
+  // 子を順に比べる
+  // TIPS:形が違う時は節ごと置き換える(根なら全体)
+  static void diff(const ci::JsonTree& prev, const ci::JsonTree& next,
+                   std::vector<size_t>& indices, const std::string& path,
+                   std::vector<Change>& changes) {
+    if (!isSameShape(prev, next)) {
+      Change change = { indices, path, next };
+      changes.push_back(std::move(change));
+      return;
+    }
+
+    if (next.getNodeType() == ci::JsonTree::NODE_VALUE) {
+      if ((prev.getValueType() != next.getValueType())
+          || (prev.getValue<std::string>() != next.getValue<std::string>())) {
+        Change change = { indices, path, next };
+        changes.push_back(std::move(change));
+      }
+      return;
+    }
+
+    bool array = next.getNodeType() == ci::JsonTree::NODE_ARRAY;
+    auto it = prev.begin();
+    size_t index = 0;
+    for (const auto& child : next) {
+      std::string name = array ? std::to_string(index) : child.getKey();
+
+      indices.push_back(index);
+      diff(*it, child, indices, path.empty() ? name : (path + "." + name), changes);
+      indices.pop_back();
+
+      ++it;
+      ++index;
+    }
+  }
+
+};
+
+}
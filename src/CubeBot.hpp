@@ -0,0 +1,254 @@
+﻿#pragma once
+
+//
+// CubePlayerの自動操作
+// 人と同じくキー入力(Game::keyDown)で操作する
+//
+// 一定の手数だけ先を読み、崩壊端に追いつかれずに一番奥へ進める一手を選ぶ
+// 崩壊端の速さは、見えている位置の変化から見積もる
+//
+// TIPS:長時間の動作確認(soak)用。腕前は先読みの深さ・操作の間隔・読み違いの確率で変える
+//
+
+#include <algorithm>
+#include <vector>
+#include "cinder/app/KeyEvent.h"
+#include "cinder/Json.h"
+#include "Game.hpp"
+#include "Random.hpp"
+
+
+namespace ngs {
+
+class CubeBot {
+public:
+  struct Skill {
+    // 先読みする手数
+    u_int depth;
+    // 次に操作するまでのtick数
+    u_int interval;
+    // 読みを無視してランダムに動く確率
+    float mistake_rate;
+  };
+
+
+private:
+  enum {
+    MOVE_NONE = -1,
+
+    MOVE_UP,
+    MOVE_DOWN,
+    MOVE_LEFT,
+    MOVE_RIGHT
+  };
+
+  struct Node {
+    // yはここに着いた時のCubeの高さ
+    ci::Vec3i pos;
+    // ここへ来るための最初の一手
+    int first;
+    int depth;
+  };
+
+  Skill skill_;
+  int player_;
+  Random rand_;
+
+  float cube_size_;
+  // 1手にかかるtick数
+  float ticks_per_move_;
+  // 崩壊端から空けておく行数
+  float margin_;
+
+  // 崩壊端の位置(行)と、1tickに進む行数
+  float front_;
+  float front_speed_;
+  bool  front_observed_;
+
+  u_int wait_;
+  u_int moves_;
+
+  // 探索用(毎回確保しない)
+  std::vector<Node> nodes_;
+  std::vector<bool> visited_;
+
+
+  // TIPS:コピー不可
+  CubeBot(const CubeBot&) = delete;
+  CubeBot& operator=(const CubeBot&) = delete;
+
+
+public:
+  // player:操作する人
+  CubeBot(const ci::JsonTree& params, const Skill& skill, const int player, const u_int seed) :
+    skill_(skill),
+    player_(player),
+    rand_(seed, RANDOM_BOT, player),
+    cube_size_(params.getValueForKey<float>("cube.size")),
+    ticks_per_move_(params.getValueForKey<float>("cubePlayer.moveRotateTime")
+                    * params.getValueForKey<float>("app.tickRate")),
+    margin_(params.getValueForKey<float>("bot.margin")),
+    front_(0.0f),
+    front_speed_(0.0f),
+    front_observed_(false),
+    wait_(0),
+    moves_(0)
+  {
+    if (skill_.interval == 0) skill_.interval = 1;
+  }
+
+  // 設定値(bot.skills)から腕前を読む
+  // TIPS:範囲外は一番上手な設定にする
+  static Skill readSkill(const ci::JsonTree& params, const size_t level) {
+    const auto& skills = params["bot.skills"];
+    const auto& values = skills[std::min(level, skills.getNumChildren() - 1)];
+
+    Skill skill = {
+      values.getValueForKey<u_int>("depth"),
+      values.getValueForKey<u_int>("interval"),
+      values.getValueForKey<float>("mistakeRate")
+    };
+    return skill;
+  }
+
+
+  // 毎tick、Game::stepの前に呼ぶ
+  void update(Game& game) {
+    const auto& world = game.world();
+    observeFront(world.stage().bottom_z / cube_size_);
+
+    if (wait_ > 0) {
+      wait_ -= 1;
+      return;
+    }
+
+    const auto* cube = world.manipulatedCube(player_);
+    if (!cube || cube->now_rotation) return;
+
+    int direction = plan(game, *cube);
+    if (rand_.nextFloat() < skill_.mistake_rate) {
+      direction = rand_.nextInt(4);
+    }
+    if (direction == MOVE_NONE) return;
+
+    int keycode = keyCode(direction);
+    game.keyDown(keycode, 0, player_);
+    game.keyUp(keycode, 0);
+
+    moves_ += 1;
+    wait_ = skill_.interval;
+  }
+
+  const Skill& skill() const { return skill_; }
+  u_int moves() const { return moves_; }
+
+
+private:
+  // 崩壊端の速さを見積もる
+  void observeFront(const float front) {
+    if (front_observed_) {
+      float delta = front - front_;
+      // TIPS:Stageを作り直すと戻るので、その時は見積もりを続けない
+      if ((delta >= 0.0f) && (delta < 1.0f)) {
+        front_speed_ += (delta - front_speed_) * 0.1f;
+      }
+    }
+    front_ = front;
+    front_observed_ = true;
+  }
+
+  // 先読みして最初の一手を決める(動かない方が良ければMOVE_NONE)
+  int plan(Game& game, const CubeInfo& cube) {
+    const ci::Vec3i move_table[] = {
+      ci::Vec3i( 0, 0,  1),
+      ci::Vec3i( 0, 0, -1),
+      ci::Vec3i( 1, 0,  0),
+      ci::Vec3i(-1, 0,  0),
+    };
+
+    const int depth = int(skill_.depth);
+    const int span  = depth * 2 + 1;
+    visited_.assign(span * span, false);
+    visited_[depth * span + depth] = true;
+
+    nodes_.clear();
+    Node start = { cube.block_pos, MOVE_NONE, 0 };
+    nodes_.push_back(start);
+
+    int   best       = MOVE_NONE;
+    float best_score = score(start);
+
+    // 幅優先で手数の少ない順に調べる
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+      // TIPS:追加で再確保されるのでコピーしておく
+      Node node = nodes_[i];
+      if (node.depth == depth) continue;
+
+      for (int direction = 0; direction < 4; ++direction) {
+        auto pos = node.pos + move_table[direction];
+        int index = (pos.z - cube.block_pos.z + depth) * span + (pos.x - cube.block_pos.x + depth);
+        if (visited_[index]) continue;
+        visited_[index] = true;
+
+        // 親ノードの高さから移動できるか調べ、着いた高さを持たせる
+        int landing_y;
+        if (!isPassable(game, cube, node.pos.y, pos, landing_y)) continue;
+        pos.y = landing_y;
+        // たどり着く前に崩れてしまう
+        if (!isSafe(pos.z, node.depth + 1)) continue;
+
+        Node next = { pos, (node.first == MOVE_NONE) ? direction : node.first, node.depth + 1 };
+        nodes_.push_back(next);
+
+        float value = score(next);
+        if (value > best_score) {
+          best_score = value;
+          best       = next.first;
+        }
+      }
+    }
+
+    return best;
+  }
+
+  // 奥へ進むほど良い。着いた後すぐに崩れる場所は避ける
+  float score(const Node& node) const {
+    float value = float(node.pos.z) - 0.1f * node.depth;
+    if (!isSafe(node.pos.z, node.depth + 1)) value -= 1000.0f;
+    return value;
+  }
+
+  // CubePlayerと同じ条件で、高さfrom_yのCubeが隣のposへ移動できるか
+  // landing_y:移動後のCubeの高さ
+  // TIPS:CubePlayer::startRotationMoveは移動元より高い段へは転がらず、
+  //      転がった後も高さは変わらない
+  bool isPassable(Game& game, const CubeInfo& cube, const int from_y, const ci::Vec3i& pos, int& landing_y) const {
+    int height;
+    if (!game.stageHeight(pos, height)) return false;
+    if (height > from_y) return false;
+
+    u_int id = game.occupancy().occupant(pos);
+    if ((id != 0) && (id != cube.id)) return false;
+
+    landing_y = from_y;
+    return true;
+  }
+
+  // moves手後に、その行がまだ崩れていないか
+  bool isSafe(const int z, const int moves) const {
+    return float(z) > (front_ + front_speed_ * ticks_per_move_ * moves + margin_);
+  }
+
+  static int keyCode(const int direction) {
+    switch (direction) {
+    case MOVE_UP:    return ci::app::KeyEvent::KEY_UP;
+    case MOVE_DOWN:  return ci::app::KeyEvent::KEY_DOWN;
+    case MOVE_LEFT:  return ci::app::KeyEvent::KEY_LEFT;
+    case MOVE_RIGHT: return ci::app::KeyEvent::KEY_RIGHT;
+    }
+    return 0;
+  }
+
+};
+
+}
@@ -4,8 +4,15 @@
 // お邪魔Cube
 //
 
+#include "cinder/Sphere.h"
 #include "Message.hpp"
 #include "Entity.hpp"
+#include "RenderQueue.hpp"
+#include "Pose.hpp"
+#include "Random.hpp"
+#include "OccupancyGrid.hpp"
+#include "WorldState.hpp"
+#include "FlowField.hpp"
 
 
 namespace ngs {
@@ -17,10 +24,22 @@ class CubeEnemy : public Entity {
 
   u_int id_;
 
+  Random rand_;
+
+  // 他のCubeとの重なり判定
+  OccupancyGrid* occupancy_;
+  // 状態の公開先
+  WorldState* world_;
+  // Playerを追いかける時の道しるべ
+  FlowField* flow_;
+
   ci::Vec3i pos_block_;
   ci::Vec3f pos_;
   ci::Quatf rot_;
 
+  // 直前のtickの姿勢(描画補間用)
+  Pose prev_pose_;
+
   enum {
     MOVE_NONE = -1,
 
@@ -45,38 +64,103 @@ class CubeEnemy : public Entity {
   float size_;
   ci::Color color_;
 
+  // 1tickあたりに移動を始める確率と、その時にPlayerを追いかける確率
+  float move_rate_;
+  float chase_rate_;
+
   
 public:
   explicit CubeEnemy(Message& message, ci::JsonTree& params) :
     message_(message),
     params_(params),
     active_(true),
-    id_(getUniqueNumber()),
-    now_rotation_(false)
+    occupancy_(nullptr),
+    world_(nullptr),
+    flow_(nullptr),
+    now_rotation_(false),
+    move_direction_(MOVE_NONE),
+    move_speed_(0),
+    move_rotate_time_(0.0f)
   { }
 
   // FIXME:コンストラクタではshared_ptrが決まっていないための措置
   void setup(boost::shared_ptr<CubeEnemy> obj_sp,
+             const u_int id, const u_int seed,
+             OccupancyGrid& occupancy, WorldState& world, FlowField& flow,
              const ci::Vec3i& entry_pos_block) {
 
+    readParams();
+
+    occupancy_ = &occupancy;
+    world_     = &world;
+    flow_      = &flow;
+    id_ = id;
+    rand_.seed(seed, RANDOM_ENEMY, id);
+
     rot_       = ci::Quatf::identity();
-    size_      = params_["cube.size"].getValue<float>();
     pos_block_ = entry_pos_block;
     pos_       = ci::Vec3f(entry_pos_block) * size_;
+
+    prev_pose_ = pose();
+    occupancy_->place(id_, pos_block_);
+    publish();
+
+    connect(obj_sp);
+  }
+
+  // スナップショットから復元
+  void restore(boost::shared_ptr<CubeEnemy> obj_sp, BinaryReader& reader, OccupancyGrid& occupancy, WorldState& world, FlowField& flow) {
+    readParams();
+    transfer(*this, reader);
+
+    occupancy_ = &occupancy;
+    world_     = &world;
+    flow_      = &flow;
+    occupancy_->place(id_, pos_block_);
+    publish();
+
+    connect(obj_sp);
+  }
+
+  ~CubeEnemy() {
+    if (occupancy_) occupancy_->remove(id_, pos_block_);
+    if (world_) world_->removeCube(id_);
+  }
+
+
+private:
+  void readParams() {
+    size_      = params_["cube.size"].getValue<float>();
     color_     = Json::getColor<float>(params_["cubeEnemy.color"]);
 
     move_rotate_time_end_ = params_["cubeEnemy.moveRotateTime"].getValue<float>();
 
+    move_rate_  = params_["cubeEnemy.moveRate"].getValue<float>();
+    chase_rate_ = params_["cubeEnemy.chaseRate"].getValue<float>();
+  }
+
+  void connect(boost::shared_ptr<CubeEnemy> obj_sp) {
     message_.connect(Msg::UPDATE, obj_sp, &CubeEnemy::update);
-    message_.connect(Msg::DRAW, obj_sp, &CubeEnemy::draw);
 
     message_.connect(Msg::RESET_STAGE, obj_sp, &CubeEnemy::inactive);
-    message_.connect(Msg::GATHER_INFORMATION, obj_sp, &CubeEnemy::gatherInfo);
   }
 
 
-private:
   bool isActive() const override { return active_; }
+  int type() const override { return ENTITY_CUBEENEMY; }
+
+
+  template <typename Self, typename Stream>
+  static void transfer(Self& self, Stream& stream) {
+    stream & self.id_
+           & self.pos_block_ & self.pos_ & self.rot_ & self.prev_pose_
+           & self.now_rotation_ & self.move_direction_ & self.move_speed_
+           & self.move_rotate_ & self.move_rotate_start_ & self.move_rotate_end_ & self.rotate_pivpot_
+           & self.move_rotate_time_;
+    Random::transfer(self.rand_, stream);
+  }
+
+  void save(BinaryWriter& writer) const override { transfer(*this, writer); }
 
   
   void inactive(const Message::Connection& connection, Param& params) {
@@ -86,6 +170,8 @@ private:
   void update(const Message::Connection& connection, Param& params) {
     double delta_time = boost::any_cast<double>(params.at("deltaTime"));
 
+    prev_pose_ = pose();
+
     if (now_rotation_) {
       move_rotate_time_ += delta_time;
       if (move_rotate_time_ >= move_rotate_time_end_) {
@@ -109,14 +195,15 @@ private:
       }
     }
     else {
-      if (ci::randFloat() < 0.01f) {
-        int directions[] = { MOVE_UP, MOVE_DOWN, MOVE_LEFT, MOVE_RIGHT };
-        
-        move_direction_ = directions[ci::randInt(elemsof(directions))];
+      // 登場した時に他のCubeがいて確保できなかった場合に備える
+      occupancy_->place(id_, pos_block_);
+
+      if (rand_.nextFloat() < move_rate_) {
+        if ((rand_.nextFloat() >= chase_rate_) || !chasePlayer()) {
+          int directions[] = { MOVE_UP, MOVE_DOWN, MOVE_LEFT, MOVE_RIGHT };
         
-        auto& information = boost::any_cast<std::vector<CubeInfo>& >(params["playerInfo"]);
-        if (startRotationMove(information)) {
-          updateInformation(pos_block_, information);
+          move_direction_ = directions[rand_.nextInt(elemsof(directions))];
+          startRotationMove();
         }
       }
 
@@ -136,51 +223,91 @@ private:
         message_.signal(Msg::CREATE_FALLCUBE, params);
           
         active_ = false;
+        world_->removeCube(id_);
         return;
       }
     }
+
+    publish();
   }
 
 
-  void draw(const Message::Connection& connection, Param& params) {
-    ci::gl::color(color_);
+  void draw(RenderQueue::List& list) const override {
+    auto pose = Pose::interpolate(prev_pose_, this->pose(), list.interpolation());
+    if (!list.isVisible(ci::Sphere(pose.pos, size_))) return;
+
+    auto transform = pose.transform(size_);
+    list.add(RenderQueue::STATE_LIT, RenderQueue::MATERIAL_COLOR, transform, color_);
+  }
 
+  // 回転移動中の中心のずれを含めた現在の姿勢
+  Pose pose() const {
     // 下の平面が(y = 0)
     ci::Vec3f pos(pos_);
     pos.y += size_ / 2;
-
-    ci::gl::pushModelView();
-
-    ci::gl::translate(pos);
-    if (now_rotation_) {
-      ci::gl::translate(-rotate_pivpot_);
-      ci::gl::rotate(move_rotate_);
-      ci::gl::translate(rotate_pivpot_);
+    if (!now_rotation_) {
+      Pose pose = { pos, rot_ };
+      return pose;
     }
-    ci::gl::rotate(rot_);
-    
-    ci::gl::drawCube(ci::Vec3f::zero(), ci::Vec3f(size_, size_, size_));
-    
-    ci::gl::popModelView();
+
+    Pose pose = {
+      pos + move_rotate_ * rotate_pivpot_ - rotate_pivpot_,
+      move_rotate_ * rot_
+    };
+    return pose;
   }
 
   
-  void gatherInfo(const Message::Connection& connection, Param& params) {
-    auto& informations = boost::any_cast<std::vector<CubeInfo>& >(params["playerInfo"]);
-
+  // 今の状態をWorldStateへ(変化がなければ何も起きない)
+  void publish() {
     CubeInfo info = {
       id_,
       false,
+      -1,
       pos_block_,
       pos_,
       now_rotation_
     };
     
-    informations.push_back(std::move(info));
+    world_->updateCube(info);
   }
 
   
-  bool startRotationMove(const std::vector<CubeInfo>& information) {
+  // Playerに近づく方向へ移動
+  // 近づける方向が複数ある時はランダムに選び、他のCubeがいたら残りを試す
+  // TIPS:たどり着けない時はfalse
+  bool chasePlayer() {
+    int distance = flow_->distance(pos_block_);
+    if (distance == FlowField::UNREACHABLE) return false;
+    // Playerに隣接していたら、そのまま行く手をふさぐ
+    if (distance <= 1) return true;
+
+    ci::Vec3i move_table[] = {
+      ci::Vec3i( 0, 0,  1),
+      ci::Vec3i( 0, 0, -1),
+      ci::Vec3i( 1, 0,  0),
+      ci::Vec3i(-1, 0,  0),
+    };
+
+    int candidates[4];
+    int num = 0;
+    for (int i = 0; i < 4; ++i) {
+      int next = flow_->distance(pos_block_ + move_table[i]);
+      if ((next != FlowField::UNREACHABLE) && (next < distance)) {
+        candidates[num++] = i;
+      }
+    }
+    if (num == 0) return false;
+
+    int first = rand_.nextInt(num);
+    for (int i = 0; i < num; ++i) {
+      move_direction_ = candidates[(first + i) % num];
+      if (startRotationMove()) break;
+    }
+    return true;
+  }
+
+  bool startRotationMove() {
     ci::Quatf rotate_table[] = {
       ci::Quatf(ci::Vec3f(1, 0, 0),  M_PI / 2),
       ci::Quatf(ci::Vec3f(1, 0, 0), -M_PI / 2),
@@ -214,7 +341,8 @@ private:
       if (pos.y > pos_block_.y) return false;
     }
 
-    if (searchOtherPlayer(pos_block_ + move_table[move_direction_], information)) {
+    // 他のCubeがいなければ移動先を確保
+    if (!occupancy_->move(id_, pos_block_, pos_block_ + move_table[move_direction_])) {
       return false;
     }
 
@@ -230,28 +358,6 @@ private:
     return true;
   }
 
-  bool searchOtherPlayer(const ci::Vec3i block_pos, const std::vector<CubeInfo>& information) {
-    for (auto& info : information) {
-      if (info.id == id_) continue;
-
-      // 高さ判定はしない
-      if ((info.block_pos.x == block_pos.x)
-          && (info.block_pos.z == block_pos.z)) {
-        return true;
-      }
-    }
-    return false;
-  }
-  
-  void updateInformation(const ci::Vec3i block_pos, std::vector<CubeInfo>& information) {
-    for (auto& info : information) {
-      if (info.id != id_) continue;
-
-      info.block_pos = block_pos;
-      break;
-    }
-  }
-  
 };
 
 }
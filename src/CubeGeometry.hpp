@@ -0,0 +1,75 @@
+﻿#pragma once
+
+//
+// 単位立方体の形状データ
+// 中心が原点で、各辺の長さが1
+//
+
+#include "cinder/Vector.h"
+
+
+namespace ngs {
+
+namespace CubeGeometry {
+
+enum {
+  FACE_RIGHT,                   // +X
+  FACE_LEFT,                    // -X
+  FACE_TOP,                     // +Y
+  FACE_BOTTOM,                  // -Y
+  FACE_FRONT,                   // +Z
+  FACE_BACK,                    // -Z
+
+  FACE_NUM,
+
+  // 面あたりの頂点数(三角形2枚)
+  FACE_VERTEX_NUM = 6,
+  VERTEX_NUM      = FACE_NUM * FACE_VERTEX_NUM
+};
+
+
+inline const ci::Vec3f& faceNormal(const int face) {
+  static const ci::Vec3f normal[] = {
+    ci::Vec3f( 1,  0,  0),
+    ci::Vec3f(-1,  0,  0),
+    ci::Vec3f( 0,  1,  0),
+    ci::Vec3f( 0, -1,  0),
+    ci::Vec3f( 0,  0,  1),
+    ci::Vec3f( 0,  0, -1),
+  };
+
+  return normal[face];
+}
+
+// 面の頂点(反時計回りの三角形2枚)
+// TIPS:u × v = normal になる接線から頂点を求める
+inline void faceVertices(const int face, ci::Vec3f* vertices) {
+  static const ci::Vec3f tangent[][2] = {
+    { ci::Vec3f(0, 1, 0), ci::Vec3f(0, 0, 1) },
+    { ci::Vec3f(0, 0, 1), ci::Vec3f(0, 1, 0) },
+    { ci::Vec3f(0, 0, 1), ci::Vec3f(1, 0, 0) },
+    { ci::Vec3f(1, 0, 0), ci::Vec3f(0, 0, 1) },
+    { ci::Vec3f(1, 0, 0), ci::Vec3f(0, 1, 0) },
+    { ci::Vec3f(0, 1, 0), ci::Vec3f(1, 0, 0) },
+  };
+
+  const auto  center = faceNormal(face) * 0.5f;
+  const auto& u = tangent[face][0];
+  const auto& v = tangent[face][1];
+
+  ci::Vec3f corner[] = {
+    center + (-u - v) * 0.5f,
+    center + ( u - v) * 0.5f,
+    center + ( u + v) * 0.5f,
+    center + (-u + v) * 0.5f,
+  };
+
+  int index[] = { 0, 1, 2, 0, 2, 3 };
+  for (int i = 0; i < FACE_VERTEX_NUM; ++i) {
+    vertices[i] = corner[index[i]];
+  }
+}
+
+}
+
+}
@@ -0,0 +1,45 @@
+﻿#pragma once
+
+//
+// 立方体の面を結合したメッシュ
+//
+
+#include <vector>
+#include "cinder/Vector.h"
+#include "cinder/Color.h"
+#include "CubeGeometry.hpp"
+
+
+namespace ngs {
+
+struct CubeMesh {
+  std::vector<ci::Vec3f> vertices;
+  std::vector<ci::Vec3f> normals;
+  std::vector<ci::ColorA> colors;
+
+
+  void clear() {
+    vertices.clear();
+    normals.clear();
+    colors.clear();
+  }
+
+  size_t vertexNum() const { return vertices.size(); }
+  bool empty() const { return vertices.empty(); }
+
+  // 単位立方体の面を移動・拡大して追加
+  void addFace(const int face,
+               const ci::Vec3f& center, const float size, const ci::ColorA& color) {
+    ci::Vec3f face_vertices[CubeGeometry::FACE_VERTEX_NUM];
+    CubeGeometry::faceVertices(face, face_vertices);
+
+    for (const auto& v : face_vertices) {
+      vertices.push_back(center + v * size);
+      normals.push_back(CubeGeometry::faceNormal(face));
+      colors.push_back(color);
+    }
+  }
+  
+};
+
+}
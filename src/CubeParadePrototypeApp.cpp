@@ -7,8 +7,17 @@
 #include "cinder/gl/gl.h"
 #include "cinder/Json.h"
 #include "cinder/System.h"
+#include <random>
+#include <sstream>
 #include "Touch.hpp"
 #include "Game.hpp"
+#include "GlRenderBackend.hpp"
+#include "CinderSoundBackend.hpp"
+#include "InputRecorder.hpp"
+#include "InputReplayer.hpp"
+#include "ConfigWatcher.hpp"
+#include "ParamsCache.hpp"
+#include "StartupProfile.hpp"
 
 
 using namespace ci;
@@ -18,11 +27,25 @@ using namespace ci::app;
 namespace ngs {
 
 class CubeParadePrototypeApp : public AppNative {
+  // 起動から最初の描画までの計測
+  // TIPS:設定値を読むより前から計るので、一番最初に置く
+  StartupProfile startup_;
+  bool startup_done_;
+  bool params_cached_;
+
   ci::JsonTree params_;
   std::unique_ptr<Game> game_;
   bool paused_;
   bool boost_update_;
 
+  // 入力の記録と再生
+  InputRecorder recorder_;
+  InputReplayer replayer_;
+  bool replaying_;
+
+  // params.jsonの書き換えを反映する
+  std::unique_ptr<ConfigWatcher> config_watcher_;
+
   double elapsed_time_;
 
   ci::Vec2f mouse_pos_;
@@ -33,7 +56,17 @@ class CubeParadePrototypeApp : public AppNative {
   //      privateになっていて構わない
   
   void prepareSettings(Settings *settings) override {
-    params_ = JsonTree(loadAsset("params.json"));
+    startup_done_ = false;
+
+    // 前回の起動で作ったキャッシュが使えれば、JSONを解析しない
+    auto result = ParamsCache::load(params_,
+                                    getAssetPath("params.json").string(),
+                                    (getDocumentsDirectory() / "params.cache").string());
+    if (result == ParamsCache::SOURCE_ERROR) {
+      params_ = JsonTree(loadAsset("params.json"));
+    }
+    params_cached_ = result == ParamsCache::CACHE_HIT;
+    startup_.mark(std::string("params ") + ParamsCache::resultName(result));
     
     settings->setWindowSize(params_["app.width"].getValue<int>(),
                             params_["app.height"].getValue<int>());
@@ -62,10 +95,20 @@ class CubeParadePrototypeApp : public AppNative {
     // 縦横画面両対応
     getSignalSupportedOrientations().connect([](){ return ci::app::InterfaceOrientation::All; });
 #endif
+    startup_.mark("window");
     
-    game_   = std::unique_ptr<Game>(new Game(params_));
+    createGame(std::random_device()());
+    startup_.mark("game");
     paused_ = false;
     boost_update_ = false;
+    replaying_ = false;
+
+    if (params_["app.watchParams"].getValue<bool>()) {
+      config_watcher_ = std::unique_ptr<ConfigWatcher>(new ConfigWatcher(getAssetPath("params.json").string(), params_,
+                                                                         params_["app.watchInterval"].getValue<double>(),
+                                                                         params_["app.watchSettle"].getValue<double>()));
+    }
+    startup_.mark("config watcher");
                             
     elapsed_time_ = getElapsedSeconds();
   }
@@ -73,7 +116,7 @@ class CubeParadePrototypeApp : public AppNative {
 
   // FIXME:Windowsではtouchイベントとmouseイベントが同時に呼ばれる
 	void mouseDown(MouseEvent event) override {
-    if (!event.isLeft()) return;
+    if (!event.isLeft() || replaying_) return;
 
     mouse_pos_ = event.getPos();
     mouse_prev_pos_ = mouse_pos_;
@@ -90,7 +133,7 @@ class CubeParadePrototypeApp : public AppNative {
   }
 
 	void mouseDrag(MouseEvent event) override {
-    if (!event.isLeftDown()) return;
+    if (!event.isLeftDown() || replaying_) return;
 
     mouse_prev_pos_ = mouse_pos_;
     mouse_pos_ = event.getPos();
@@ -107,7 +150,7 @@ class CubeParadePrototypeApp : public AppNative {
   }
 
 	void mouseUp(MouseEvent event) override {
-    if (!event.isLeft()) return;
+    if (!event.isLeft() || replaying_) return;
 
     mouse_prev_pos_ = mouse_pos_;
     mouse_pos_ = event.getPos();
@@ -126,16 +169,22 @@ class CubeParadePrototypeApp : public AppNative {
 
   // TIPS:OSX版はTrackPadの領域をWindowにマップした座標になっている
   void touchesBegan(TouchEvent event) override {
+    if (replaying_) return;
+
     auto touches = createTouchInfo(event);
     game_->touchesBegan(touches);
   }
 
   void touchesMoved(TouchEvent event) override {
+    if (replaying_) return;
+
     auto touches = createTouchInfo(event);
     game_->touchesMoved(touches);
   }
 
   void touchesEnded(TouchEvent event) override {
+    if (replaying_) return;
+
     auto touches = createTouchInfo(event);
     game_->touchesEnded(touches);
   }
@@ -145,6 +194,14 @@ class CubeParadePrototypeApp : public AppNative {
     int keycode   = event.getCode();
     int charactor = event.getChar();
 
+    if (charactor == 'P') {
+      // 記録した入力の再生開始/中断
+      replayInput();
+      return;
+    }
+    // 再生中は入力を受け付けない
+    if (replaying_) return;
+
     game_->keyDown(keycode, charactor);
 
     if (keycode == ci::app::KeyEvent::KEY_ESCAPE) {
@@ -157,13 +214,19 @@ class CubeParadePrototypeApp : public AppNative {
     if (charactor == 'R') {
       DOUT << "Reset Game." << std::endl;
 
-      // TIPS:[先に解放]リソースを二重に使うのを回避
-      game_.reset();
-      game_ = std::unique_ptr<Game>(new Game(params_));
-      // 初回起動時に合わせ、resizeを実行
-      game_->resize();
-      // Pause状態を維持
-      game_->pause(paused_);
+      stopRecord();
+      resetGame(std::random_device()());
+    }
+
+    if (charactor == 'C') {
+      // 入力の記録開始/終了
+      if (recorder_.isRecording()) {
+        stopRecord();
+      }
+      else {
+        DOUT << "Start recording." << std::endl;
+        resetGame(std::random_device()(), &recorder_);
+      }
     }
 
     if ((keycode == ci::app::KeyEvent::KEY_LSHIFT)
@@ -174,6 +237,8 @@ class CubeParadePrototypeApp : public AppNative {
   }
 
   void keyUp(KeyEvent event) override {
+    if (replaying_) return;
+
     int keycode   = event.getCode();
     int charactor = event.getChar();
 
@@ -188,20 +253,33 @@ class CubeParadePrototypeApp : public AppNative {
   
 
   void resize() override {
-    game_->resize();
+    game_->resize(getWindowSize());
   }
   
   
 	void update() override {
+    applyParams();
+
     double current_time = getElapsedSeconds();
 
     double delta_time = current_time - elapsed_time_;
-    if (boost_update_) delta_time *= 4.0;
-    game_->update(delta_time);
+    if (replaying_) {
+      // 記録したフレームの経過時間で更新
+      if (!replayer_.frame(*game_)) {
+        DOUT << "Replay finished. frames:" << replayer_.frameNum() << std::endl;
+        replaying_ = false;
+      }
+    }
+    else {
+      // 早送り中は4倍の回数更新する
+      game_->update(delta_time, boost_update_ ? 4 : 1);
+    }
 
     // DOUT << current_time - elapsed_time_ << std::endl;
     
     elapsed_time_ = current_time;
+
+    if (!startup_done_) startup_.mark("first update");
   }
 
 	void draw() override {
@@ -209,6 +287,104 @@ class CubeParadePrototypeApp : public AppNative {
     gl::clear(Color(0.2, 0.2, 0.2));
 
     game_->draw();
+
+    if (!startup_done_) {
+      startup_.mark("first draw");
+      startup_done_ = true;
+
+      std::ostringstream text;
+      startup_.print(text, params_cached_ ? "warm" : "cold", params_["app.startupTarget"].getValue<double>());
+      DOUT << text.str();
+    }
+  }
+
+  
+  void createGame(const u_int seed) {
+    game_ = std::unique_ptr<Game>(new Game(params_, seed));
+    game_->renderBackend(std::unique_ptr<RenderBackend>(new GlRenderBackend));
+    // TIPS:読み込めない音源は鳴らさないだけなので、assetsに無くても動く
+    if (params_["app.sound"].getValue<bool>()) {
+      game_->soundBackend(std::unique_ptr<SoundBackend>(new CinderSoundBackend));
+    }
+  }
+
+  // recorder:作り直したGameの入力を記録する
+  void resetGame(const u_int seed, InputRecorder* recorder = nullptr) {
+    // TIPS:[先に解放]リソースを二重に使うのを回避
+    game_.reset();
+    createGame(seed);
+    game_->record(recorder);
+    // 初回起動時に合わせ、resizeを実行
+    game_->resize(getWindowSize());
+    // Pause状態を維持
+    game_->pause(paused_);
+  }
+
+
+  // 書き換えられたparams.jsonの、変わった節だけを置き換える
+  void applyParams() {
+    if (!config_watcher_) return;
+
+    ConfigWatcher::Update update;
+    while (config_watcher_->fetch(update)) {
+      if (!update.error.empty()) {
+        DOUT << "Can't reload params:" << update.error << std::endl;
+        continue;
+      }
+
+      std::vector<std::string> paths;
+      for (const auto& change : update.changes) {
+        ConfigWatcher::apply(params_, change);
+        paths.push_back(change.path);
+        DOUT << "params changed:" << (change.path.empty() ? "(all)" : change.path) << std::endl;
+      }
+      DOUT << "params parse:" << update.parse_time * 1000.0 << "ms" << std::endl;
+      if (update.restart) {
+        DOUT << "Some params need reset(R)." << std::endl;
+      }
+
+      game_->changeParams(paths, ConfigWatcher::elapsed(update.detected));
+    }
+  }
+
+
+  ci::fs::path recordPath() const {
+    return getDocumentsDirectory() / params_["app.recordFile"].getValue<std::string>();
+  }
+
+  void stopRecord() {
+    if (!recorder_.isRecording()) return;
+
+    recorder_.stop();
+    game_->record(nullptr);
+
+    auto path = recordPath();
+    bool result = recorder_.write(path.string());
+    DOUT << "Stop recording. frames:" << recorder_.frameNum()
+         << " " << path.string() << (result ? "" : " write error.")
+         << std::endl;
+  }
+
+  void replayInput() {
+    if (replaying_) {
+      DOUT << "Stop replay." << std::endl;
+      replaying_ = false;
+      return;
+    }
+
+    stopRecord();
+
+    auto path = recordPath();
+    if (!replayer_.read(path.string())) {
+      DOUT << "Can't read record:" << path.string() << std::endl;
+      return;
+    }
+
+    DOUT << "Start replay." << std::endl;
+    // 記録した時と同じ種、同じ初期状態から始める
+    paused_ = false;
+    resetGame(replayer_.seed());
+    replaying_ = true;
   }
 
   
@@ -0,0 +1,174 @@
+﻿#pragma once
+
+//
+// タッチしたCubeを探す
+// 視線をブロック単位の格子に沿って手前から順にたどり(3D DDA)、
+// 最初にCubeがいたマスのCubeを返す
+//
+// TIPS:同時に来たタッチはまとめて調べる(CubeごとのAABB判定はしない)
+//
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "cinder/Ray.h"
+#include "cinder/Timer.h"
+#include "Touch.hpp"
+#include "OccupancyGrid.hpp"
+#include "WorldState.hpp"
+
+
+namespace ngs {
+
+class CubePicker {
+  const OccupancyGrid& occupancy_;
+  const WorldState& world_;
+
+  float size_;
+
+  // 直近に調べたタッチの数と時間
+  u_int  last_num_;
+  double last_time_;
+
+
+  // TIPS:コピー不可
+  CubePicker(const CubePicker&) = delete;
+  CubePicker& operator=(const CubePicker&) = delete;
+
+
+public:
+  CubePicker(const ci::JsonTree& params, const OccupancyGrid& occupancy, const WorldState& world) :
+    occupancy_(occupancy),
+    world_(world),
+    size_(params.getValueForKey<float>("cube.size")),
+    last_num_(0),
+    last_time_(0.0)
+  { }
+
+
+  // 各タッチで最初に当たったCubeのid(いなければ0)をpickedへ
+  // TIPS:処理済み(handled)や優先でない(prior)タッチは調べない
+  template <typename F>
+  void pick(const std::vector<Touch>& touches, std::vector<u_int>& picked, F generate_ray) {
+    ci::Timer timer(true);
+
+    picked.assign(touches.size(), 0);
+    last_num_ = 0;
+
+    // Cubeのいる高さの範囲だけをたどる
+    int y_min = std::numeric_limits<int>::max();
+    int y_max = std::numeric_limits<int>::min();
+    for (const auto& cube : world_.cubes()) {
+      y_min = std::min(y_min, cube.second.block_pos.y);
+      y_max = std::max(y_max, cube.second.block_pos.y);
+    }
+
+    if (y_min <= y_max) {
+      for (size_t i = 0; i < touches.size(); ++i) {
+        const auto& touch = touches[i];
+        if (!touch.prior || touch.handled) continue;
+
+        picked[i] = march(generate_ray(touch.pos), y_min, y_max);
+        last_num_ += 1;
+      }
+    }
+
+    last_time_ = timer.getSeconds();
+  }
+
+  // 1つのタッチを調べるのにかかった時間
+  double latency() const {
+    return last_num_ ? (last_time_ / last_num_) : 0.0;
+  }
+
+
+private:
+  // 高さがy_min〜y_maxの範囲を、視線が通過するマスの順に調べる
+  u_int march(const ci::Ray& ray, const int y_min, const int y_max) const {
+    // マスの境界が整数になる座標へ変換
+    // TIPS:Cubeはxzが中心、yが底面の位置
+    ci::Vec3f origin(ray.getOrigin().x / size_ + 0.5f,
+                     ray.getOrigin().y / size_,
+                     ray.getOrigin().z / size_ + 0.5f);
+    ci::Vec3f dir(ray.getDirection() / size_);
+
+    // 範囲の高さを通過する区間[t_begin, t_end]
+    float t_begin = 0.0f;
+    float t_end;
+    if (dir.y != 0.0f) {
+      float t0 = (float(y_min) - origin.y) / dir.y;
+      float t1 = (float(y_max + 1) - origin.y) / dir.y;
+      t_begin = std::max(std::min(t0, t1), 0.0f);
+      t_end   = std::max(t0, t1);
+      if (t_end < t_begin) return 0;
+    }
+    else {
+      if ((origin.y < y_min) || (origin.y >= (y_max + 1))) return 0;
+      t_end = std::numeric_limits<float>::max();
+    }
+
+    auto start = origin + dir * t_begin;
+    int cell[] = {
+      int(std::floor(start.x)),
+      int(std::floor(start.y)),
+      int(std::floor(start.z))
+    };
+    // TIPS:範囲の境界から入った時に、外側のマスから始めないようにする
+    cell[1] = std::min(std::max(cell[1], y_min), y_max);
+
+    const float d[]     = { dir.x, dir.y, dir.z };
+    const float p[]     = { start.x, start.y, start.z };
+    int   step[3];
+    float t_next[3];
+    float t_delta[3];
+    for (int i = 0; i < 3; ++i) {
+      if (d[i] > 0.0f) {
+        step[i]    = 1;
+        t_next[i]  = t_begin + (float(cell[i] + 1) - p[i]) / d[i];
+        t_delta[i] = 1.0f / d[i];
+      }
+      else if (d[i] < 0.0f) {
+        step[i]    = -1;
+        t_next[i]  = t_begin + (float(cell[i]) - p[i]) / d[i];
+        t_delta[i] = -1.0f / d[i];
+      }
+      else {
+        step[i]    = 0;
+        t_next[i]  = std::numeric_limits<float>::max();
+        t_delta[i] = std::numeric_limits<float>::max();
+      }
+    }
+
+    // 水平な視線でも止まるよう、格子の一周分で打ち切る
+    int max_steps = (y_max - y_min + 1) + occupancy_.width() + occupancy_.rows();
+    for (int n = 0; n < max_steps; ++n) {
+      if ((cell[1] < y_min) || (cell[1] > y_max)) break;
+
+      u_int id = occupant(cell[0], cell[1], cell[2]);
+      if (id) return id;
+
+      // 一番近い境界を越える
+      int axis = (t_next[0] < t_next[1]) ? ((t_next[0] < t_next[2]) ? 0 : 2)
+                                         : ((t_next[1] < t_next[2]) ? 1 : 2);
+      if (t_next[axis] > t_end) break;
+
+      cell[axis]   += step[axis];
+      t_next[axis] += t_delta[axis];
+    }
+    return 0;
+  }
+
+  u_int occupant(const int x, const int y, const int z) const {
+    u_int id = occupancy_.occupant(ci::Vec3i(x, 0, z));
+    if (!id) return 0;
+
+    // 格子は高さを持たないので、WorldStateで確かめる
+    const auto& cubes = world_.cubes();
+    auto it = cubes.find(id);
+    return ((it != std::end(cubes)) && (it->second.block_pos.y == y)) ? id : 0;
+  }
+
+};
+
+}
@@ -5,9 +5,13 @@
 //
 
 #include "cinder/Vector.h"
-#include "cinder/AxisAlignedBox.h"
+#include "cinder/Sphere.h"
 #include "Message.hpp"
 #include "Camera.hpp"
+#include "RenderQueue.hpp"
+#include "Pose.hpp"
+#include "OccupancyGrid.hpp"
+#include "WorldState.hpp"
 #include "Entity.hpp"
 #include "Utility.hpp"
 
@@ -20,13 +24,23 @@ class CubePlayer : public Entity {
 
   bool active_;
 
+  // 他のCubeとの重なり判定
+  OccupancyGrid* occupancy_;
+  // 状態の公開先
+  WorldState* world_;
+
   u_int id_;
+  // 操作する人
+  int owner_;
   bool paused_;
   
   ci::Vec3i pos_block_;
   ci::Vec3f pos_;
   ci::Quatf rot_;
 
+  // 直前のtickの姿勢(描画補間用)
+  Pose prev_pose_;
+
   float size_;
   ci::Color color_;
 
@@ -74,23 +88,69 @@ public:
     message_(message),
     params_(params),
     active_(true),
-    id_(getUniqueNumber()),
+    occupancy_(nullptr),
+    world_(nullptr),
     picking_(false),
+    picking_id_(0),
+    picking_timestamp_record_(false),
+    picking_timestamp_(0.0),
     now_rotation_(false),
-    begin_rotation_(false)
+    begin_rotation_(false),
+    move_direction_(MOVE_NONE),
+    move_speed_(0),
+    move_rotate_time_(0.0f),
+    move_rotate_time_end_(0.0f)
   { }
 
 
   // FIXME:コンストラクタではshared_ptrが決まっていないための措置
   void setup(boost::shared_ptr<CubePlayer> obj_sp,
+             const u_int id,
+             const int owner,
+             OccupancyGrid& occupancy, WorldState& world,
              const ci::Vec3i& entry_pos_block,
              const bool paused = false) {
 
+    readParams();
+
+    occupancy_ = &occupancy;
+    world_     = &world;
+    id_        = id;
+    owner_     = owner;
     paused_    = paused;
     rot_       = ci::Quatf::identity();
-    size_      = params_["cube.size"].getValue<float>();
     pos_block_ = entry_pos_block;
     pos_       = ci::Vec3f(entry_pos_block) * size_;
+    
+    prev_pose_ = pose();
+    occupancy_->place(id_, pos_block_);
+    publish();
+
+    connect(obj_sp);
+  }
+
+  // スナップショットから復元
+  void restore(boost::shared_ptr<CubePlayer> obj_sp, BinaryReader& reader, OccupancyGrid& occupancy, WorldState& world) {
+    readParams();
+    transfer(*this, reader);
+
+    occupancy_ = &occupancy;
+    world_     = &world;
+    occupancy_->place(id_, pos_block_);
+    publish();
+
+    connect(obj_sp);
+  }
+
+  ~CubePlayer() {
+    if (occupancy_) occupancy_->remove(id_, pos_block_);
+    if (world_) world_->removeCube(id_);
+  }
+  
+  
+private:
+  void readParams() {
+    size_      = params_["cube.size"].getValue<float>();
     color_     = Json::getColor<float>(params_["cubePlayer.color"]);
     
     move_rotate_time_end_max_ = params_["cubePlayer.moveRotateTime"].getValue<float>();
@@ -99,13 +159,13 @@ public:
     speed_rate_     = params_["cubePlayer.speedRate"].getValue<float>();
     max_move_speed_ = params_["cubePlayer.maxMoveSpeed"].getValue<int>();
     speed_table_ = Json::getArray<float>(params_["cubePlayer.moveSpeed"]);
-    
+  }
+
+  void connect(boost::shared_ptr<CubePlayer> obj_sp) {
     // 必要なメッセージを受け取るように指示
     // TIPS:オブジェクトが消滅すると自動的に解除される
     message_.connect(Msg::UPDATE, obj_sp, &CubePlayer::update);
-    message_.connect(Msg::DRAW, obj_sp, &CubePlayer::draw);
     
-    message_.connect(Msg::GATHER_INFORMATION, obj_sp, &CubePlayer::gatherInfo);
     message_.connect(Msg::CUBE_PLAYER_CHECK_FINISH, obj_sp, &CubePlayer::postPlayerZ);
     message_.connect(Msg::PARADE_FINISH, obj_sp, &CubePlayer::unpause);
     
@@ -117,10 +177,26 @@ public:
 
     message_.connect(Msg::KEY_DOWN, obj_sp, &CubePlayer::keyDown);
   }
-  
-  
-private:
+
+
   bool isActive() const override { return active_; }
+  int type() const override { return ENTITY_CUBEPLAYER; }
+
+
+  template <typename Self, typename Stream>
+  static void transfer(Self& self, Stream& stream) {
+    stream & self.id_ & self.owner_ & self.paused_
+           & self.pos_block_ & self.pos_ & self.rot_ & self.prev_pose_
+           & self.picking_ & self.picking_id_
+           & self.picking_timestamp_record_ & self.picking_timestamp_
+           & self.picking_plane_ & self.picking_pos_ & self.move_pos_block_
+           & self.now_rotation_ & self.begin_rotation_
+           & self.move_direction_ & self.move_speed_
+           & self.move_rotate_ & self.move_rotate_start_ & self.move_rotate_end_ & self.rotate_pivpot_
+           & self.move_rotate_time_ & self.move_rotate_time_end_;
+  }
+
+  void save(BinaryWriter& writer) const override { transfer(*this, writer); }
 
   
   void inactive(const Message::Connection& connection, Param& params) {
@@ -131,11 +207,10 @@ private:
   void update(const Message::Connection& connection, Param& params) {
     double delta_time = boost::any_cast<double>(params.at("deltaTime"));
 
+    prev_pose_ = pose();
+
     if (begin_rotation_) {
-      auto& information = boost::any_cast<std::vector<CubeInfo>& >(params["playerInfo"]);
-      if (startRotationMove(information)) {
-        updateInformation(pos_block_, information);
-      }
+      startRotationMove();
       begin_rotation_ = false;
     }
 
@@ -155,10 +230,7 @@ private:
         }
 
         // まだ移動するか判定
-        auto& information = boost::any_cast<std::vector<CubeInfo>& >(params["playerInfo"]);
-        if (continueRotationMove(information)) {
-          updateInformation(pos_block_, information);
-        }
+        continueRotationMove();
       }
       else {
         move_rotate_ = move_rotate_start_.slerp(move_rotate_time_ / move_rotate_time_end_,
@@ -166,6 +238,9 @@ private:
       }
     }
     else {
+      // 登場した時に他のCubeがいて確保できなかった場合に備える
+      occupancy_->place(id_, pos_block_);
+
       {
         Param params = {
           { "block_pos", pos_block_ },
@@ -184,48 +259,53 @@ private:
           message_.signal(Msg::CUBE_PLAYER_DEAD, params);
           
           active_ = false;
+          world_->removeCube(id_);
           return;
         }
       }
     }
+
+    publish();
   }
 
   
-  void draw(const Message::Connection& connection, Param& params) {
-    // ci::gl::color(pick_id_.empty() ? color_ : ci::Color(1, 0, 0));
-    ci::gl::color(picking_ ? ci::Color(1, 0, 0) : color_);
+  void draw(RenderQueue::List& list) const override {
+    auto pose = Pose::interpolate(prev_pose_, this->pose(), list.interpolation());
+    if (!list.isVisible(ci::Sphere(pose.pos, size_))) return;
 
+    auto transform = pose.transform(size_);
+    list.add(RenderQueue::STATE_LIT, RenderQueue::MATERIAL_COLOR, transform, picking_ ? ci::Color(1, 0, 0) : color_);
+  }
+
+  // 回転移動中の中心のずれを含めた現在の姿勢
+  Pose pose() const {
     // 下の平面が(y = 0)
     ci::Vec3f pos(pos_);
     pos.y += size_ / 2;
-
-    ci::gl::pushModelView();
-
-    ci::gl::translate(pos);
-    if (now_rotation_) {
-      ci::gl::translate(-rotate_pivpot_);
-      ci::gl::rotate(move_rotate_);
-      ci::gl::translate(rotate_pivpot_);
+    if (!now_rotation_) {
+      Pose pose = { pos, rot_ };
+      return pose;
     }
-    ci::gl::rotate(rot_);
-    
-    ci::gl::drawCube(ci::Vec3f::zero(), ci::Vec3f(size_, size_, size_));
-    
-    ci::gl::popModelView();
-  }
 
-  void gatherInfo(const Message::Connection& connection, Param& params) {
-    auto& informations = boost::any_cast<std::vector<CubeInfo>& >(params["playerInfo"]);
+    Pose pose = {
+      pos + move_rotate_ * rotate_pivpot_ - rotate_pivpot_,
+      move_rotate_ * rot_
+    };
+    return pose;
+  }
 
+  // 今の状態をWorldStateへ(変化がなければ何も起きない)
+  void publish() {
     CubeInfo info = {
       id_,
       true,
+      owner_,
       pos_block_,
       pos_,
       now_rotation_
     };
     
-    informations.push_back(std::move(info));
+    world_->updateCube(info);
   }
 
   void postPlayerZ(const Message::Connection& connection, Param& params) {
@@ -239,6 +319,7 @@ private:
   
   void touchesBegan(const Message::Connection& connection, Param& params) {
     if (picking_ || paused_) return;
+    if (boost::any_cast<int>(params.at("player")) != owner_) return;
 
     auto* touches = boost::any_cast<std::vector<Touch>* >(params.at("touch"));
 #if 0
@@ -248,11 +329,14 @@ private:
     }
 #endif
 
+    const auto* picked = boost::any_cast<std::vector<u_int>* >(params.at("picked"));
     auto* camera = boost::any_cast<Camera* >(params.at("camera"));
-    for (auto& touch : *touches) {
+    for (size_t i = 0; i < touches->size(); ++i) {
+      auto& touch = (*touches)[i];
       if (!touch.prior || touch.handled) continue;
       
-      if (isBodyPicked(touch, *camera)) {
+      // TIPS:どのCubeに当たったかはGameがまとめて調べている
+      if ((*picked)[i] == id_) {
         // pick開始
         touch.handled = true;
         
@@ -366,6 +450,7 @@ private:
     // キー入力で４方向へ回転移動する
     // DEBUG用
     if (now_rotation_ || paused_) return;
+    if (boost::any_cast<int>(params.at("player")) != owner_) return;
     
     int keycode = boost::any_cast<int>(params.at("keycode"));
 
@@ -409,20 +494,7 @@ private:
   }
   
   
-  ci::AxisAlignedBox3f getBoundingBox() {
-    return std::move(ci::AxisAlignedBox3f(ci::Vec3f(-size_ / 2,     0, -size_ / 2) + pos_,
-                                          ci::Vec3f( size_ / 2, size_,  size_ / 2) + pos_));
-  }
-  
-  bool isBodyPicked(const Touch& touch, Camera& camera) {
-    auto ray = camera.generateRay(touch.pos);
-
-    float z_cross[2];
-    int num = getBoundingBox().intersect(ray, z_cross);
-    return num > 0;
-  }
-
-  bool startRotationMove(const std::vector<CubeInfo>& information) {
+  bool startRotationMove() {
     ci::Quatf rotate_table[] = {
       ci::Quatf(ci::Vec3f(1, 0, 0),  M_PI / 2),
       ci::Quatf(ci::Vec3f(1, 0, 0), -M_PI / 2),
@@ -456,7 +528,8 @@ private:
       if (pos.y > pos_block_.y) return false;
     }
 
-    if (searchOtherPlayer(pos_block_ + move_table[move_direction_], information)) {
+    // 他のCubeがいなければ移動先を確保
+    if (!occupancy_->move(id_, pos_block_, pos_block_ + move_table[move_direction_])) {
       return false;
     }
 
@@ -480,33 +553,11 @@ private:
     return true;
   }
 
-  bool continueRotationMove(const std::vector<CubeInfo>& information) {
+  bool continueRotationMove() {
     if (move_speed_ == 0) return false;
     move_speed_ -= 1;
 
-    return startRotationMove(information);
-  }
-
-  bool searchOtherPlayer(const ci::Vec3i block_pos, const std::vector<CubeInfo>& information) {
-    for (auto& info : information) {
-      if (info.id == id_) continue;
-
-      // 高さ判定はしない
-      if ((info.block_pos.x == block_pos.x)
-          && (info.block_pos.z == block_pos.z)) {
-        return true;
-      }
-    }
-    return false;
-  }
-
-  void updateInformation(const ci::Vec3i block_pos, std::vector<CubeInfo>& information) {
-    for (auto& info : information) {
-      if (info.id != id_) continue;
-
-      info.block_pos = block_pos;
-      break;
-    }
+    return startRotationMove();
   }
 
   
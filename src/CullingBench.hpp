@@ -0,0 +1,154 @@
+﻿#pragma once
+
+//
+// 長いステージでの描画の計測(headless用)
+// stage.startをrows行に伸ばした設定でGameを作り、描画コマンドを記録するだけの描画(RecordRenderBackend)で
+// chunk単位の視錐台カリングを有効にした場合と無効にした場合の時間を比べる
+//
+// TIPS:描画内容を集める時間(カリングを含む)と、RenderBackendへ流し込む時間を分けて計る
+//      同じ状態を繰り返し描画するので、記録したコマンド列は毎フレーム同じhash値になるはず
+//
+
+#include <iostream>
+#include "cinder/Json.h"
+#include "Game.hpp"
+#include "RecordRenderBackend.hpp"
+
+
+namespace ngs {
+
+class CullingBench {
+public:
+  struct Result {
+    bool culling;
+
+    // 1フレームあたりの平均(秒)
+    double extract_time;
+    double submit_time;
+
+    // 最後のフレームの結果
+    u_int visible;
+    u_int culled;
+    u_int draw_calls;
+    u_int mesh_vertices;
+    // 記録したコマンド列のhash値と、全てのフレームで同じだったか
+    u_int hash;
+    bool  stable;
+  };
+
+  struct Report {
+    u_int rows;
+    u_int frames;
+
+    // [0]:カリングあり [1]:なし
+    Result results[2];
+
+    // カリングしても描画の数は増えない
+    bool isValid() const {
+      return results[0].stable && results[1].stable
+          && (results[0].draw_calls <= results[1].draw_calls)
+          && (results[0].mesh_vertices <= results[1].mesh_vertices);
+    }
+  };
+
+
+  static Report run(const ci::JsonTree& params, const u_int rows, const u_int frames, const u_int seed) {
+    Report report = {};
+    report.rows   = rows;
+    report.frames = std::max(frames, 1u);
+
+    for (int i = 0; i < 2; ++i) {
+      auto bench_params = makeParams(params, rows, i == 0);
+      report.results[i] = measure(bench_params, report.frames, seed);
+    }
+    return report;
+  }
+
+  static void print(std::ostream& output, const Report& report) {
+    output << "stage rows:" << report.rows
+           << " frames:" << report.frames
+           << std::endl;
+
+    for (const auto& result : report.results) {
+      output << (result.culling ? "culling on " : "culling off")
+             << " extract:" << result.extract_time * 1000.0 << "ms"
+             << " submit:" << result.submit_time * 1000.0 << "ms"
+             << " draw:" << (result.extract_time + result.submit_time) * 1000.0 << "ms"
+             << " visible:" << result.visible
+             << " culled:" << result.culled
+             << " draw calls:" << result.draw_calls
+             << " mesh vertices:" << result.mesh_vertices
+             << " hash:" << std::hex << result.hash << std::dec
+             << (result.stable ? "" : " (unstable)")
+             << std::endl;
+    }
+    output << "stream:" << (report.isValid() ? "OK" : "NG") << std::endl;
+  }
+
+
+private:
+  static Result measure(ci::JsonTree& params, const u_int frames, const u_int seed) {
+    Result result = {};
+    result.culling = params.getValueForKey<bool>("stage.chunkCulling");
+    result.stable  = true;
+
+    Game game(params, seed);
+    game.resize(ci::Vec2i(params.getValueForKey<int>("app.width"),
+                          params.getValueForKey<int>("app.height")));
+    // chunkはupdateで作り直されるので、1tick進めてから計る
+    game.step();
+
+    RecordRenderBackend backend;
+    for (u_int i = 0; i < frames; ++i) {
+      game.render(backend);
+      result.extract_time += game.extractTime();
+      result.submit_time  += backend.stats().submit_time;
+
+      u_int hash = backend.hash();
+      if ((i > 0) && (hash != result.hash)) result.stable = false;
+      result.hash = hash;
+    }
+    result.extract_time /= frames;
+    result.submit_time  /= frames;
+
+    result.visible       = game.cullingStats().visible;
+    result.culled        = game.cullingStats().culled;
+    result.draw_calls    = backend.stats().draw_calls;
+    result.mesh_vertices = backend.stats().mesh_vertices;
+    return result;
+  }
+
+  // stage.startの行を繰り返してrows行にし、最初から全て表示する
+  static ci::JsonTree makeParams(const ci::JsonTree& params, const u_int rows, const bool culling) {
+    ci::JsonTree result(params);
+    auto& stage = result.getChild("stage");
+
+    const auto& body = params["stage.start.body"];
+    auto long_body = ci::JsonTree::makeArray("body");
+    for (u_int i = 0; i < rows; ++i) {
+      long_body.pushBack(body[i % body.getNumChildren()]);
+    }
+    auto start = ci::JsonTree::makeObject("start");
+    start.addChild(long_body);
+
+    replace(stage, start);
+    replace(stage, ci::JsonTree("startLength", int(rows)));
+    // 全ての行が敵の道しるべに収まるように
+    replace(stage, ci::JsonTree("occupancyRows", int(rows + params.getValueForKey<int>("stage.occupancyRows"))));
+    replace(stage, ci::JsonTree("chunkCulling", culling));
+    return result;
+  }
+
+  static void replace(ci::JsonTree& node, const ci::JsonTree& child) {
+    for (size_t i = 0; i < node.getNumChildren(); ++i) {
+      if (node.getChild(i).getKey() == child.getKey()) {
+        node.replaceChild(i, child);
+        return;
+      }
+    }
+    node.addChild(child);
+  }
+
+};
+
+}
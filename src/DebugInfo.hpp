@@ -0,0 +1,93 @@
+﻿#pragma once
+
+//
+// デバッグ情報を表示
+// Msg::DEBUG_INFO で受け取った項目を画面左上に並べる
+//
+
+#include <map>
+#include <string>
+#include "Entity.hpp"
+
+
+namespace ngs {
+
+class DebugInfo : public Entity {
+  Message& message_;
+  const ci::JsonTree& params_;
+
+  bool active_;
+
+  std::map<std::string, std::string> info_;
+  bool display_;
+
+
+public:
+  explicit DebugInfo(Message& message, ci::JsonTree& params) :
+    message_(message),
+    params_(params),
+    active_(true),
+    display_(false)
+  { }
+
+
+  // FIXME:コンストラクタではshared_ptrが決まっていないための措置
+  void setup(boost::shared_ptr<DebugInfo> obj_sp) {
+    connect(obj_sp);
+  }
+
+  // スナップショットから復元
+  // TIPS:表示する項目は毎フレーム送られてくるので保存しない
+  void restore(boost::shared_ptr<DebugInfo> obj_sp, BinaryReader& reader) {
+    reader.get(display_);
+    connect(obj_sp);
+  }
+
+
+private:
+  void connect(boost::shared_ptr<DebugInfo> obj_sp) {
+    message_.connect(Msg::DEBUG_INFO, obj_sp, &DebugInfo::post);
+    message_.connect(Msg::DEBUGINFO_TOGGLE, obj_sp, &DebugInfo::display);
+
+    message_.connect(Msg::DRAW_2D, obj_sp, &DebugInfo::draw);
+
+    message_.connect(Msg::RESET_STAGE, obj_sp, &DebugInfo::inactive);
+  }
+
+
+  bool isActive() const override { return active_; }
+  int type() const override { return ENTITY_DEBUGINFO; }
+
+  void save(BinaryWriter& writer) const override { writer.put(display_); }
+
+
+  void inactive(const Message::Connection& connection, Param& params) {
+    active_ = false;
+  }
+
+  void post(const Message::Connection& connection, Param& params) {
+    const auto& name  = boost::any_cast<const std::string& >(params["name"]);
+    const auto& value = boost::any_cast<const std::string& >(params["value"]);
+    info_[name] = value;
+  }
+
+  void display(const Message::Connection& connection, Param& params) {
+    display_ = !display_;
+
+    DOUT << "DebugInfo:" << (display_ ? "ON" : "OFF") << std::endl;
+  }
+
+
+  void draw(const Message::Connection& connection, Param& params) {
+    if (!display_) return;
+
+    ci::Vec2f pos(10, 10);
+    for (const auto& it : info_) {
+      ci::gl::drawString(it.first + ": " + it.second, pos);
+      pos.y += 14;
+    }
+  }
+
+};
+
+}
@@ -13,11 +13,18 @@
 #endif
 
 
+// TIPS:Windowを持たないビルド(NGS_HEADLESS)では標準出力へ
+#if defined (NGS_HEADLESS)
+#define CONSOLE_OUT std::cout
+#else
+#define CONSOLE_OUT ci::app::console()
+#endif
+
 // TIPS:console() をReleaseビルドで排除する
 #ifdef DEBUG
-#define DOUT ci::app::console()
+#define DOUT CONSOLE_OUT
 #else
-#define DOUT 0 && ci::app::console()
+#define DOUT 0 && CONSOLE_OUT
 #endif
 
 // TIPS:プリプロセッサを文字列として定義する
@@ -6,7 +6,11 @@
 
 #include <memory>
 #include <vector>
+#include <algorithm>
 #include <boost/range/algorithm_ext/erase.hpp>
+#include "RenderQueue.hpp"
+#include "ThreadPool.hpp"
+#include "BinaryStream.hpp"
 
 
 namespace ngs {
@@ -16,6 +20,15 @@ struct Entity {
   virtual ~Entity() = default;
 
   virtual bool isActive() const = 0;
+
+  // スナップショット用
+  // TIPS:EntityFactoryがtypeから同じ種類のEntityを作り直し、saveした内容を読み込ませる
+  virtual int type() const = 0;
+  virtual void save(BinaryWriter& writer) const {}
+
+  // 描画内容の登録
+  // TIPS:複数のスレッドから同時に呼ばれるので、自身の状態を変更しないこと
+  virtual void draw(RenderQueue::List& list) const {}
 };
 
 
@@ -25,18 +38,57 @@ class EntityHolder {
 
   std::vector<EntityPtr> entities_;
 
+  // 1つのListへ登録するEntityの数
+  enum { DRAW_BLOCK_SIZE = 256 };
+
   
 public:
   void add(EntityPtr entity) {
     entities_.push_back(entity);
   }
 
+  void clear() {
+    entities_.clear();
+  }
+
+  // 生きているEntityを登録順に保存
+  void save(BinaryWriter& writer) const {
+    u_int num = u_int(std::count_if(std::begin(entities_), std::end(entities_),
+                                    [](const EntityPtr& e) {
+                                      return e->isActive();
+                                    }));
+    writer.put(num);
+    for (const auto& entity : entities_) {
+      if (!entity->isActive()) continue;
+
+      writer.put(entity->type());
+      entity->save(writer);
+    }
+  }
+
   void eraseInactiveEntity() {
     boost::remove_erase_if(entities_,
                            [](EntityPtr& e) {
                              return !e->isActive();
                            });
   }
+
+  // 一定数ずつに分けて並列に描画内容を登録する
+  // TIPS:分割単位ごとのListを順番に結合するので、スレッド数によらず同じ結果になる
+  void draw(ThreadPool& thread_pool, RenderQueue& queue) const {
+    size_t block_num = (entities_.size() + DRAW_BLOCK_SIZE - 1) / DRAW_BLOCK_SIZE;
+    auto* lists = queue.lists(block_num);
+
+    thread_pool.parallelFor(block_num,
+                            [this, lists](size_t block, size_t thread) {
+                              auto& list = lists[block];
+                              size_t first = block * DRAW_BLOCK_SIZE;
+                              size_t last  = std::min(first + DRAW_BLOCK_SIZE, entities_.size());
+                              for (size_t i = first; i < last; ++i) {
+                                entities_[i]->draw(list);
+                              }
+                            });
+  }
 };
 
 }
@@ -12,6 +12,11 @@
 #include "FallCube.hpp"
 #include "EntryCube.hpp"
 #include "TouchPreview.hpp"
+#include "DebugInfo.hpp"
+#include "BinaryStream.hpp"
+#include "OccupancyGrid.hpp"
+#include "WorldState.hpp"
+#include "FlowField.hpp"
 
 
 namespace ngs {
@@ -22,13 +27,36 @@ class EntityFactory {
 
   ci::JsonTree& params_;
   EntityHolder& entity_holder_;
+  OccupancyGrid& occupancy_;
+  WorldState& world_;
+  FlowField& flow_;
+
+  // TIPS:Gameごとに持つことで、複数のGameを同時に動かしても結果が変わらない
+  u_int unique_number_;
+  // TIPS:Entityごとの乱数は、この種とEntityのidから系統を分けて作る
+  u_int seed_;
+
+  // 操作する人数と、途中で登場したCubePlayerを割り当てた数
+  u_int players_;
+  u_int assigned_players_;
 
 
 public:
-  EntityFactory(Message& message, ci::JsonTree& params, EntityHolder& entity_holder) :
+  // seed:生成するEntityへ配る乱数の種
+  // players:CubePlayerを割り当てる人数
+  EntityFactory(Message& message, ci::JsonTree& params, EntityHolder& entity_holder,
+                OccupancyGrid& occupancy, WorldState& world, FlowField& flow,
+                const u_int seed, const u_int players = 1) :
     message_(message),
     params_(params),
-    entity_holder_(entity_holder)
+    entity_holder_(entity_holder),
+    occupancy_(occupancy),
+    world_(world),
+    flow_(flow),
+    unique_number_(0),
+    seed_(seed),
+    players_(players),
+    assigned_players_(0)
   {
     connection_holder_ += message.connect(Msg::SETUP_GAME, this, &EntityFactory::setupGame);
 
@@ -39,6 +67,55 @@ public:
   }
 
 
+  // 生成に使う状態と全Entityを保存
+  void save(BinaryWriter& writer) const {
+    writer.put(unique_number_);
+    writer.put(assigned_players_);
+    entity_holder_.save(writer);
+  }
+
+  // 今あるEntityを全て破棄し、保存した順に作り直す
+  // TIPS:作り直す順番がメッセージを受け取る順番になる
+  // TIPS:Cubeの居場所、WorldState、敵の道しるべは保存せず、復元したEntityが登録し直す
+  bool restore(BinaryReader& reader) {
+    u_int unique_number;
+    u_int assigned_players;
+    u_int num;
+    if (!reader.get(unique_number) || !reader.get(assigned_players) || !reader.get(num)) return false;
+
+    entity_holder_.clear();
+    occupancy_.clear();
+    world_.clear();
+    flow_.clear();
+
+    unique_number_    = unique_number;
+    assigned_players_ = assigned_players;
+
+    for (u_int i = 0; i < num; ++i) {
+      int type;
+      if (!reader.get(type)) return false;
+
+      switch (type) {
+      case ENTITY_LIGHT:        restoreEntity<Light>(reader);                                break;
+      case ENTITY_STAGE:        restoreEntity<Stage>(reader, world_, flow_);                 break;
+      case ENTITY_STAGEWATCHER: restoreEntity<StageWatcher>(reader);                         break;
+      case ENTITY_CUBEPLAYER:   restoreEntity<CubePlayer>(reader, occupancy_, world_);       break;
+      case ENTITY_CUBEENEMY:    restoreEntity<CubeEnemy>(reader, occupancy_, world_, flow_); break;
+      case ENTITY_FALLCUBE:     restoreEntity<FallCube>(reader);                             break;
+      case ENTITY_ENTRYCUBE:    restoreEntity<EntryCube>(reader);                            break;
+      case ENTITY_TOUCHPREVIEW: restoreEntity<TouchPreview>(reader);                         break;
+      case ENTITY_DEBUGINFO:    restoreEntity<DebugInfo>(reader);                            break;
+
+      default:
+        DOUT << "unknown entity type:" << type << std::endl;
+        return false;
+      }
+    }
+
+    return reader.good();
+  }
+
+
 private:
   // TIPS:コピー不可
   EntityFactory(const EntityFactory&) = delete;
@@ -49,21 +126,32 @@ private:
     DOUT << "Msg::SETUP_GAME" << std::endl;
     
     createAndAddEntity<Light>();
-    createAndAddEntity<Stage>();
+    createAndAddEntity<Stage>(seed_, uniqueNumber(), world_, flow_);
     createAndAddEntity<StageWatcher>();
     createAndAddEntity<TouchPreview>();
+    createAndAddEntity<DebugInfo>();
   }
 
   
   void createCubePlayer(const Message::Connection& connection, Param& params) {
     const auto& entry_pos = boost::any_cast<const ci::Vec3i& >(params["entry_pos"]);
     bool paused = boost::any_cast<bool>(params["paused"]);
-    createAndAddEntity<CubePlayer>(entry_pos, paused);
+
+    // 指定がなければ順番に割り当てる
+    int owner;
+    if (params.count("owner")) {
+      owner = boost::any_cast<int>(params["owner"]);
+    }
+    else {
+      owner = int(assigned_players_ % players_);
+      assigned_players_ += 1;
+    }
+    createAndAddEntity<CubePlayer>(uniqueNumber(), owner, occupancy_, world_, entry_pos, paused);
   }
   
   void createCubeEnemy(const Message::Connection& connection, Param& params) {
     const auto& entry_pos = boost::any_cast<const ci::Vec3i& >(params["entry_pos"]);
-    createAndAddEntity<CubeEnemy>(entry_pos);
+    createAndAddEntity<CubeEnemy>(uniqueNumber(), seed_, occupancy_, world_, flow_, entry_pos);
   }
   
   void createFallcube(const Message::Connection& connection, Param& params) {
@@ -83,6 +171,12 @@ private:
     createAndAddEntity<EntryCube>(pos, offset_y, active_time, color);
   }
 
+
+  // 0は使わない
+  u_int uniqueNumber() {
+    return ++unique_number_;
+  }
+
   
   // Entityを生成してHolderに追加
   // FIXME:可変長引数がconst参照になってたりしてる??
@@ -107,6 +201,14 @@ private:
 
     entity_holder_.add(obj);
   }
+
+  template<typename T, typename... Args>
+  void restoreEntity(BinaryReader& reader, Args&... args) {
+    boost::shared_ptr<T> obj = boost::shared_ptr<T>(new T(message_, params_));
+    obj->restore(obj, reader, args...);
+
+    entity_holder_.add(obj);
+  }
   
 };
 
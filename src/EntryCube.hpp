@@ -8,6 +8,7 @@
 #include "cinder/gl/gl.h"
 #include "cinder/Vector.h"
 #include "cinder/Sphere.h"
+#include "RenderQueue.hpp"
 #include "Message.hpp"
 #include "Entity.hpp"
 
@@ -23,6 +24,8 @@ class EntryCube : public Entity {
   float size_;
   
   ci::Vec3f pos_;
+  // 直前のtickの位置(描画補間用)
+  ci::Vec3f prev_pos_;
   ci::Vec3f pos_start_;
   ci::Vec3f pos_end_;
   
@@ -55,14 +58,38 @@ public:
     
     active_time_end_ = active_time;
     
-    message_.connect(Msg::UPDATE, obj_sp, &EntryCube::update);
-    message_.connect(Msg::DRAW, obj_sp, &EntryCube::draw);
-    message_.connect(Msg::RESET_STAGE, obj_sp, &EntryCube::inactive);
+    prev_pos_ = pos_;
+
+    connect(obj_sp);
+  }
+
+  // スナップショットから復元
+  void restore(boost::shared_ptr<EntryCube> obj_sp, BinaryReader& reader) {
+    size_ = params_["cube.size"].getValue<float>();
+    transfer(*this, reader);
+
+    connect(obj_sp);
   }
   
 
 private:
+  void connect(boost::shared_ptr<EntryCube> obj_sp) {
+    message_.connect(Msg::UPDATE, obj_sp, &EntryCube::update);
+    message_.connect(Msg::RESET_STAGE, obj_sp, &EntryCube::inactive);
+  }
+
+
   bool isActive() const override { return active_; }
+  int type() const override { return ENTITY_ENTRYCUBE; }
+
+
+  template <typename Self, typename Stream>
+  static void transfer(Self& self, Stream& stream) {
+    stream & self.pos_ & self.prev_pos_ & self.pos_start_ & self.pos_end_
+           & self.active_time_ & self.active_time_end_ & self.color_;
+  }
+
+  void save(BinaryWriter& writer) const override { transfer(*this, writer); }
 
   
   void inactive(const Message::Connection& connection, Param& params) {
@@ -72,6 +99,8 @@ private:
   void update(const Message::Connection& connection, Param& params) {
     auto delta_time = boost::any_cast<double>(params.at("deltaTime"));
 
+    prev_pos_ = pos_;
+
     active_time_ += delta_time;
     pos_.y = pos_start_.y + (pos_end_.y - pos_start_.y) * (active_time_ / active_time_end_);
     
@@ -81,14 +110,14 @@ private:
     }
   }
 
-  void draw(const Message::Connection& connection, Param& params) {
-    ci::gl::color(color_);
+  void draw(RenderQueue::List& list) const override {
 
-    ci::Vec3f pos(pos_);
+    ci::Vec3f pos = prev_pos_.lerp(list.interpolation(), pos_);
     // 上平面が(y = 0)
     pos.y -= size_ / 2;
+    if (!list.isVisible(ci::Sphere(pos, size_))) return;
     
-    ci::gl::drawCube(pos, ci::Vec3f(size_, size_, size_));
+    list.add(RenderQueue::STATE_LIT, RenderQueue::MATERIAL_COLOR, pos, size_, color_);
   }
   
 };
@@ -0,0 +1,152 @@
+﻿#pragma once
+
+//
+// 描画内容を集める処理の計測(headless用)
+// 全て視錐台に入るよう格子状に並べたN個のCubeを用意し、
+// EntityHolder::drawで並列に描画内容を集めてRenderQueueへ結合する時間をスレッド数ごとに計る
+// 集めた内容はRecordRenderBackendへ流し込み、記録したコマンド列のhash値を出す
+//
+// TIPS:各CubeはFallCubeと同じ描画内容の登録をする(球での判定と立方体1つの登録)
+//      コマンド列はスレッド数によらず同じになるので、hash値が違えば並べ方が壊れている
+//
+
+#include <cmath>
+#include <iostream>
+#include "cinder/Camera.h"
+#include "cinder/Sphere.h"
+#include "cinder/Timer.h"
+#include "GameEnvironment.hpp"
+#include "Entity.hpp"
+#include "RenderQueue.hpp"
+#include "RecordRenderBackend.hpp"
+#include "ThreadPool.hpp"
+
+
+namespace ngs {
+
+class ExtractBench {
+  struct Cube : public Entity {
+    ci::Vec3f pos;
+    float size;
+    ci::Color color;
+
+    bool isActive() const override { return true; }
+    int type() const override { return ENTITY_FALLCUBE; }
+
+    void draw(RenderQueue::List& list) const override {
+      if (!list.isVisible(ci::Sphere(pos, size))) return;
+
+      list.add(RenderQueue::STATE_LIT, RenderQueue::MATERIAL_COLOR, pos, size, color);
+    }
+  };
+
+  u_int cube_num_;
+  EntityHolder entity_holder_;
+  RenderQueue render_queue_;
+  RecordRenderBackend backend_;
+  ci::CameraPersp camera_;
+
+
+  // TIPS:コピー不可
+  ExtractBench(const ExtractBench&) = delete;
+  ExtractBench& operator=(const ExtractBench&) = delete;
+
+
+public:
+  struct Report {
+    u_int cubes;
+    u_int frames;
+    u_int threads;
+
+    // 1フレームあたりの平均と最大(秒)
+    double extract_time;
+    double max_time;
+    // RecordRenderBackendへ流し込む時間(1フレームあたりの平均)
+    double submit_time;
+
+    // 最後のフレームの結果(visibleがcubesと同じなら全て見えている)
+    u_int visible;
+    u_int commands;
+    u_int draw_calls;
+    // 記録したコマンド列のhash値と、全てのフレームで同じだったか
+    u_int hash;
+    bool  stable;
+  };
+
+
+  explicit ExtractBench(const u_int cube_num) :
+    cube_num_(cube_num)
+  {
+    const float size    = 1.0f;
+    const float spacing = 1.5f;
+    int side = int(std::ceil(std::sqrt(double(cube_num_))));
+    float half = side * spacing / 2.0f;
+
+    for (u_int i = 0; i < cube_num_; ++i) {
+      auto cube = boost::shared_ptr<Cube>(new Cube());
+      cube->pos   = ci::Vec3f((i % side) * spacing - half, size / 2.0f, (i / side) * spacing - half);
+      cube->size  = size;
+      cube->color = ((i & 1) ? ci::Color(0.8f, 0.8f, 0.8f) : ci::Color(0.6f, 0.6f, 0.6f));
+      entity_holder_.add(cube);
+    }
+
+    // 格子を囲む球が、画角(60度)の半分の円錐に収まる距離から斜めに見下ろす
+    float radius   = half * std::sqrt(2.0f) + size;
+    float distance = radius * 2.0f + size;
+    camera_ = ci::CameraPersp(1, 1, 60.0f, 1.0f, distance + radius * 2.0f);
+    camera_.setEyePoint(ci::Vec3f(0.0f, distance, -distance) / std::sqrt(2.0f));
+    camera_.setCenterOfInterestPoint(ci::Vec3f::zero());
+  }
+
+
+  Report run(ThreadPool& thread_pool, const u_int frames) {
+    Report report = {};
+    report.cubes   = cube_num_;
+    report.frames  = std::max(frames, 1u);
+    report.threads = u_int(thread_pool.threadNum());
+    report.stable  = true;
+
+    for (u_int i = 0; i < report.frames; ++i) {
+      ci::Timer timer(true);
+      render_queue_.begin(camera_);
+      entity_holder_.draw(thread_pool, render_queue_);
+      render_queue_.merge();
+      double time = timer.getSeconds();
+
+      report.extract_time += time;
+      report.max_time = std::max(report.max_time, time);
+
+      backend_.render(render_queue_);
+      report.submit_time += backend_.stats().submit_time;
+
+      u_int hash = backend_.hash();
+      if ((i > 0) && (hash != report.hash)) report.stable = false;
+      report.hash = hash;
+    }
+    report.extract_time /= report.frames;
+    report.submit_time  /= report.frames;
+
+    report.visible    = render_queue_.stats().visible;
+    report.commands   = u_int(backend_.commands().size());
+    report.draw_calls = backend_.stats().draw_calls;
+    return report;
+  }
+
+  static void print(std::ostream& output, const Report& report) {
+    output << "cubes:" << report.cubes
+           << " frames:" << report.frames
+           << " threads:" << report.threads
+           << " extract:" << report.extract_time * 1000.0 << "ms"
+           << " max:" << report.max_time * 1000.0 << "ms"
+           << " submit:" << report.submit_time * 1000.0 << "ms"
+           << " visible:" << report.visible
+           << " commands:" << report.commands
+           << " draw calls:" << report.draw_calls
+           << " hash:" << std::hex << report.hash << std::dec
+           << (report.stable ? "" : " (unstable)")
+           << std::endl;
+  }
+
+};
+
+}
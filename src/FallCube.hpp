@@ -8,6 +8,7 @@
 #include "cinder/gl/gl.h"
 #include "cinder/Vector.h"
 #include "cinder/Sphere.h"
+#include "RenderQueue.hpp"
 #include "Message.hpp"
 #include "Entity.hpp"
 
@@ -23,6 +24,8 @@ class FallCube : public Entity {
   float size_;
   
   ci::Vec3f pos_;
+  // 直前のtickの位置(描画補間用)
+  ci::Vec3f prev_pos_;
 
   float active_time_;
   
@@ -52,15 +55,39 @@ public:
     acc_ = Json::getVec3<float>(params_["fallCube.acc"]);
     acc_.y = acc_.y * speed;
     
-    message_.connect(Msg::UPDATE, obj_sp, &FallCube::update);
-    message_.connect(Msg::DRAW, obj_sp, &FallCube::draw);
+    prev_pos_ = pos_;
 
-    message_.connect(Msg::RESET_STAGE, obj_sp, &FallCube::inactive);
+    connect(obj_sp);
+  }
+
+  // スナップショットから復元
+  void restore(boost::shared_ptr<FallCube> obj_sp, BinaryReader& reader) {
+    size_ = params_["cube.size"].getValue<float>();
+    transfer(*this, reader);
+
+    connect(obj_sp);
   }
   
 
 private:
+  void connect(boost::shared_ptr<FallCube> obj_sp) {
+    message_.connect(Msg::UPDATE, obj_sp, &FallCube::update);
+
+    message_.connect(Msg::RESET_STAGE, obj_sp, &FallCube::inactive);
+  }
+
+
   bool isActive() const override { return active_; }
+  int type() const override { return ENTITY_FALLCUBE; }
+
+
+  template <typename Self, typename Stream>
+  static void transfer(Self& self, Stream& stream) {
+    stream & self.pos_ & self.prev_pos_
+           & self.active_time_ & self.vec_ & self.acc_ & self.color_;
+  }
+
+  void save(BinaryWriter& writer) const override { transfer(*this, writer); }
 
 
   void inactive(const Message::Connection& connection, Param& params) {
@@ -70,6 +97,8 @@ private:
   void update(const Message::Connection& connection, Param& params) {
     double delta_time = boost::any_cast<double>(params.at("deltaTime"));
 
+    prev_pos_ = pos_;
+
     // s = v0 * t + 0.5 * a * t^2
     // v = v0 + a * t
     pos_ += vec_ * delta_time + acc_ * 0.5f * delta_time * delta_time;
@@ -86,14 +115,14 @@ private:
     }
   }
 
-  void draw(const Message::Connection& connection, Param& params) {
-    ci::gl::color(color_);
+  void draw(RenderQueue::List& list) const override {
 
-    ci::Vec3f pos(pos_);
+    ci::Vec3f pos = prev_pos_.lerp(list.interpolation(), pos_);
     // 上平面が(y = 0)
     pos.y -= size_ / 2;
+    if (!list.isVisible(ci::Sphere(pos, size_))) return;
     
-    ci::gl::drawCube(pos, ci::Vec3f(size_, size_, size_));
+    list.add(RenderQueue::STATE_LIT, RenderQueue::MATERIAL_COLOR, pos, size_, color_);
   }
   
 };
@@ -0,0 +1,208 @@
+﻿#pragma once
+
+//
+// 敵がPlayerを追いかけるための距離場
+// Stageの各マスから一番近いPlayerまでの歩数を幅優先探索で求めておき、
+// 全ての敵で共有する(敵ごとの経路探索はしない)
+//
+// Stageの高さは行単位で受け取り(崩壊・追加された行だけ書き換える)、
+// 行かPlayerの居場所が変わった時だけ、次に参照された時に距離を求め直す
+//
+// 移動できるのは、高さが同じか低いマスだけ(穴には入れない)
+// 他のCubeがいるかどうかは、移動する時にOccupancyGridで調べる
+//
+// TIPS:zはStageと同じくリング状に使い回す
+//
+
+#include <algorithm>
+#include <deque>
+#include <limits>
+#include <vector>
+#include "cinder/Timer.h"
+#include "StageCube.hpp"
+#include "WorldState.hpp"
+
+
+namespace ngs {
+
+class FlowField {
+  enum {
+    // 穴
+    HOLE = std::numeric_limits<int>::min(),
+    // 行が無い
+    NO_LINE = std::numeric_limits<int>::min()
+  };
+
+  const WorldState& world_;
+
+  int width_;
+  int rows_;
+
+  // 行ごとのz(NO_LINEは空き)
+  std::vector<int> line_z_;
+  std::vector<int> heights_;
+  std::vector<int> distances_;
+
+  // 距離を求め直す必要がある
+  bool  dirty_;
+  u_int player_version_;
+
+  std::deque<int> queue_;
+
+  // 求め直した回数と時間(計測用)
+  u_int  rebuild_num_;
+  double rebuild_time_;
+
+
+  // TIPS:コピー不可
+  FlowField(const FlowField&) = delete;
+  FlowField& operator=(const FlowField&) = delete;
+
+
+public:
+  enum {
+    // Playerまでたどり着けない
+    UNREACHABLE = -1
+  };
+
+
+  // rows:2のべき乗に切り上げる
+  FlowField(const WorldState& world, const int width, const int rows) :
+    world_(world),
+    width_(width),
+    rows_(1),
+    dirty_(true),
+    player_version_(0),
+    rebuild_num_(0),
+    rebuild_time_(0.0)
+  {
+    while (rows_ < rows) rows_ <<= 1;
+
+    line_z_.resize(rows_);
+    heights_.resize(width_ * rows_);
+    distances_.resize(width_ * rows_);
+    clear();
+  }
+
+
+  void clear() {
+    std::fill(std::begin(line_z_), std::end(line_z_), int(NO_LINE));
+    std::fill(std::begin(distances_), std::end(distances_), int(UNREACHABLE));
+    dirty_ = true;
+  }
+
+  // 行の追加・書き換え
+  void setLine(const int z, const std::vector<StageCube>& line) {
+    int row = z & (rows_ - 1);
+    line_z_[row] = z;
+
+    int* heights = &heights_[row * width_];
+    for (int x = 0; x < width_; ++x) {
+      heights[x] = ((x < int(line.size())) && line[x].isActive()) ? line[x].posBlock().y
+                                                                  : int(HOLE);
+    }
+    dirty_ = true;
+  }
+
+  // 崩壊した行を取り除く
+  void removeLine(const int z) {
+    int row = z & (rows_ - 1);
+    if (line_z_[row] != z) return;
+
+    line_z_[row] = NO_LINE;
+    dirty_ = true;
+  }
+
+  // 一番近いPlayerまでの歩数(UNREACHABLE:たどり着けない)
+  int distance(const ci::Vec3i& pos) {
+    if ((pos.x < 0) || (pos.x >= width_)) return UNREACHABLE;
+
+    update();
+
+    int row = pos.z & (rows_ - 1);
+    if (line_z_[row] != pos.z) return UNREACHABLE;
+    return distances_[row * width_ + pos.x];
+  }
+
+
+  // 計測用
+  u_int rebuildNum() const { return rebuild_num_; }
+  double rebuildTime() const { return rebuild_time_; }
+
+  void resetStats() {
+    rebuild_num_  = 0;
+    rebuild_time_ = 0.0;
+  }
+
+
+private:
+  void update() {
+    if (!dirty_ && (player_version_ == world_.playerVersion())) return;
+
+    ci::Timer timer(true);
+    rebuild();
+    rebuild_time_ += timer.getSeconds();
+    rebuild_num_  += 1;
+
+    dirty_ = false;
+    player_version_ = world_.playerVersion();
+  }
+
+  // Playerのいるマスから逆向きにたどる
+  void rebuild() {
+    std::fill(std::begin(distances_), std::end(distances_), int(UNREACHABLE));
+    queue_.clear();
+
+    for (const auto& cube : world_.cubes()) {
+      const auto& info = cube.second;
+      if (!info.manipulate) continue;
+
+      int index = cellIndex(info.block_pos.x, info.block_pos.z);
+      if ((index < 0) || (heights_[index] == HOLE) || (distances_[index] == 0)) continue;
+
+      distances_[index] = 0;
+      queue_.push_back(info.block_pos.x);
+      queue_.push_back(info.block_pos.z);
+    }
+
+    const int dx[] = { 0, 0, 1, -1 };
+    const int dz[] = { 1, -1, 0, 0 };
+    while (!queue_.empty()) {
+      int x = queue_.front();
+      queue_.pop_front();
+      int z = queue_.front();
+      queue_.pop_front();
+
+      int index = cellIndex(x, z);
+      int distance = distances_[index];
+      int height   = heights_[index];
+      for (int i = 0; i < 4; ++i) {
+        int nx = x + dx[i];
+        int nz = z + dz[i];
+        int next = cellIndex(nx, nz);
+        if (next < 0) continue;
+        if (distances_[next] != UNREACHABLE) continue;
+
+        // 隣(next)からここへ移動できるか
+        // TIPS:穴の高さはどの値よりも低いので、height以上にはならない
+        if (heights_[next] < height) continue;
+
+        distances_[next] = distance + 1;
+        queue_.push_back(nx);
+        queue_.push_back(nz);
+      }
+    }
+  }
+
+  // 範囲外や行が無い時は-1
+  int cellIndex(const int x, const int z) const {
+    if ((x < 0) || (x >= width_)) return -1;
+
+    int row = z & (rows_ - 1);
+    if (line_z_[row] != z) return -1;
+    return row * width_ + x;
+  }
+
+};
+
+}
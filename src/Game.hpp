@@ -4,12 +4,11 @@
 // ゲーム本編
 //
 
+#include <cmath>
 #include "GameEnvironment.hpp"
 #include "cinder/Json.h"
-#include "cinder/Rand.h"
 #include "cinder/Camera.h"
 #include "cinder/Frustum.h"
-#include "cinder/gl/Light.h"
 #include "Entity.hpp"
 #include "Message.hpp"
 #include "JsonUtil.hpp"
@@ -17,61 +16,166 @@
 #include "Sound.hpp"
 #include "EntityFactory.hpp"
 #include "TimerTask.hpp"
+#include "RenderQueue.hpp"
+#include "RenderBackend.hpp"
+#include "ThreadPool.hpp"
+#include "InputRecorder.hpp"
+#include "BinaryStream.hpp"
+#include "OccupancyGrid.hpp"
+#include "WorldState.hpp"
+#include "CubePicker.hpp"
+#include "FlowField.hpp"
+#include "cinder/Timer.h"
 
 
 namespace ngs {
 
 class Game {
+public:
+  // スナップショットの識別子と版
+  enum {
+    SNAPSHOT_ID      = 0x5353474e,    // 'NGSS'
+    SNAPSHOT_VERSION = 2
+  };
+
+
+private:
   ci::JsonTree& params_;
   Message message_;
 
+  // Cubeの居場所と、各Entityが公開している状態
+  // TIPS:Entityより先に破棄されないよう、entity_holder_より前に置く
+  OccupancyGrid occupancy_;
+  WorldState    world_;
+  // 敵がPlayerを追いかける時の道しるべ(全ての敵で共有)
+  FlowField     flow_;
+
+  // タッチしたCubeを探す
+  CubePicker picker_;
+  // TOUCH_BEGANの各タッチで見つかったCubeのid
+  std::vector<u_int> picked_;
+
   EntityHolder  entity_holder_;
   EntityFactory factory_;
   
   Camera camera_;
 
-  // Sound sound_;
+  // TIPS:描画する時に初めて用意する(headlessではスレッドを作らない)
+  std::unique_ptr<ThreadPool> thread_pool_;
+  RenderQueue render_queue_;
+  std::unique_ptr<RenderBackend> render_backend_;
+  double extract_time_;
+
+  // TIPS:音を扱う時だけ用意する(headlessでは作らない)
+  std::unique_ptr<Sound> sound_;
 
-  TimerTask<double> timer_tasks_;
+  // 時間経過で行う処理
+  // TIPS:データで積んでおくとスナップショットに保存できる
+  enum {
+    TIMER_RESTART
+  };
+  TimerTask<double, int> timer_tasks_;
+
+  // 固定間隔の更新
+  double tick_time_;
+  u_int  max_ticks_;
+  double accumulated_time_;
+  u_int  tick_num_;
 
   bool pause_;
 
+  u_int seed_;
+  // 同じGameを操作する人数
+  u_int players_;
+  // 入力の記録先(記録しない時はnullptr)
+  InputRecorder* recorder_;
+
+  // デバッグ用のクイックセーブ
+  BinaryWriter quick_snapshot_;
+
+
+public:
+  // 結果の集計(長時間の実行で使う)
+  // TIPS:プレイの状態ではないのでスナップショットには保存しない
+  struct Results {
+    u_int clears;
+    u_int misses;
+    u_int all_clears;
+  };
+
+
+private:
+  Results results_;
+
 
 public:
-  explicit Game(ci::JsonTree& params) :
+  // seed:乱数の種(同じ種と入力なら同じ結果になる)
+  // players:操作する人数(CubePlayerを順番に割り当てる)
+  Game(ci::JsonTree& params, const u_int seed, const u_int players = 1) :
     params_(params),
-    factory_(message_, params, entity_holder_),
-    camera_(message_, params),
-    // sound_(message_, params),
-    pause_(false)
+    occupancy_(params.getValueForKey<int>("stage.width"), params.getValueForKey<int>("stage.occupancyRows")),
+    flow_(world_, params.getValueForKey<int>("stage.width"), params.getValueForKey<int>("stage.occupancyRows")),
+    picker_(params, occupancy_, world_),
+    factory_(message_, params, entity_holder_, occupancy_, world_, flow_, seed, players),
+    camera_(message_, params, world_),
+    extract_time_(0.0),
+    timer_tasks_(1.0 / params.getValueForKey<double>("app.tickRate")),
+    tick_time_(1.0 / params.getValueForKey<double>("app.tickRate")),
+    max_ticks_(params.getValueForKey<u_int>("app.maxTicksPerFrame")),
+    accumulated_time_(0.0),
+    tick_num_(0),
+    pause_(false),
+    seed_(seed),
+    players_(players),
+    recorder_(nullptr)
   {
+    results_ = Results();
+
     message_.connect(Msg::PARADE_MISS, this, &Game::restartStage);
     message_.connect(Msg::ALL_STAGE_CLEAR, this, &Game::restartStage);
+
+    message_.connect(Msg::PARADE_FINISH, this, &Game::countClear);
+    message_.connect(Msg::PARADE_MISS, this, &Game::countMiss);
+    message_.connect(Msg::ALL_STAGE_CLEAR, this, &Game::countAllClear);
     
     setup();
   }
 
-  void resize() {
-    camera_.resize();
+  void resize(const ci::Vec2i& size) {
+    if (recorder_) recorder_->resize(size);
+    camera_.resize(size);
   }
 
   
   void touchesBegan(std::vector<Touch>& touches) {
+    if (recorder_) recorder_->touches(InputRecorder::TOUCH_BEGAN, touches);
+
+    // 同時に始まったタッチをまとめて調べておく
+    picker_.pick(touches, picked_,
+                 [this](const ci::Vec2f& pos) { return camera_.generateRay(pos); });
+    postDebugInfo("pick(us)", std::to_string(picker_.latency() * 1000000.0));
+
     signalTouchMessage(Msg::TOUCH_BEGAN, touches);
   }
   
   void touchesMoved(std::vector<Touch>& touches) {
+    if (recorder_) recorder_->touches(InputRecorder::TOUCH_MOVED, touches);
     signalTouchMessage(Msg::TOUCH_MOVED, touches);
   }
   
   void touchesEnded(std::vector<Touch>& touches) {
+    if (recorder_) recorder_->touches(InputRecorder::TOUCH_ENDED, touches);
     signalTouchMessage(Msg::TOUCH_ENDED, touches);
   }
 
 
-  void keyDown(const int keycode, const int charactor) {
+  // player:入力した人(自分の操作するCubePlayerだけが反応する)
+  void keyDown(const int keycode, const int charactor, const int player = 0) {
+    if (recorder_) recorder_->key(InputRecorder::KEY_DOWN, keycode, charactor);
+
     Param params = {
-      { "keycode", keycode }
+      { "keycode", keycode },
+      { "player", player },
     };
     
     message_.signal(Msg::KEY_DOWN, params);
@@ -79,82 +183,232 @@ public:
     if (charactor == 'T') {
       message_.signal(Msg::TOUCHPREVIEW_TOGGLE, Param());
     }
+    if (charactor == 'I') {
+      message_.signal(Msg::DEBUGINFO_TOGGLE, Param());
+    }
+
+    // クイックセーブとロード
+    if (charactor == 'S') {
+      ci::Timer timer(true);
+      quick_snapshot_.clear();
+      save(quick_snapshot_);
+      postDebugInfo("snapshot size", std::to_string(quick_snapshot_.size()));
+      postDebugInfo("snapshot save(us)", std::to_string(timer.getSeconds() * 1000000.0));
+    }
+    if ((charactor == 'L') && (quick_snapshot_.size() > 0)) {
+      ci::Timer timer(true);
+      BinaryReader reader(quick_snapshot_.data());
+      if (!load(reader)) {
+        DOUT << "snapshot load failed." << std::endl;
+      }
+      postDebugInfo("snapshot load(us)", std::to_string(timer.getSeconds() * 1000000.0));
+    }
   }
 
   void keyUp(const int keycode, const int charactor) {
+    if (recorder_) recorder_->key(InputRecorder::KEY_UP, keycode, charactor);
   }
   
   
-  void update(const double delta_time) {
+  // 経過時間を固定間隔のtickに分けて更新する
+  // speed:早送りの倍率(時間を引き伸ばさず、tickの回数を増やす)
+  void update(const double delta_time, const u_int speed = 1) {
+    if (recorder_) recorder_->frame(delta_time, speed);
+
+    // TIPS:読み込めた音源はpause中でも受け取る
+    if (sound_) sound_->update();
+
+    tick_num_ = 0;
     if (pause_) return;
 
-    timer_tasks_(delta_time);
+    accumulated_time_ += delta_time * speed;
+
+    u_int max_ticks = max_ticks_ * speed;
+    while (accumulated_time_ >= tick_time_) {
+      if (tick_num_ == max_ticks) {
+        // TIPS:処理が追いつかない時は残りの時間を捨てて、
+        //      tickが雪だるま式に増えるのを防ぐ
+        accumulated_time_ = std::fmod(accumulated_time_, tick_time_);
+        break;
+      }
+
+      step();
+      accumulated_time_ -= tick_time_;
+      tick_num_ += 1;
+    }
+  }
+
+  // 1tick分の更新
+  void step() {
+    const double delta_time = tick_time_;
+
+    timer_tasks_(delta_time, [this](const int event) { timerEvent(event); });
     
-    // FIXME:VS2013 update1はboost::anyの初期化リストにコンテナの右辺値を入れると
-    //       実行時エラーになる??
-    auto cube_info = std::vector<CubeInfo>();
+    // TIPS:各Entityの状態はWorldStateから読む
     Param params = {
       { "deltaTime", delta_time },
       { "frustum", ci::Frustumf(camera_.body()) },
       { "camera", &camera_ },
-      { "playerInfo", cube_info },
-      { "stageWidth", 0.0f },
-      { "stageLength", 0.0f },
-      { "stageBottomZ", 0.0f },
     };
     
-    message_.signal(Msg::GATHER_INFORMATION, params);
     message_.signal(Msg::UPDATE, params);
 
+    if (flow_.rebuildNum() > 0) {
+      postDebugInfo("flow field(us)", std::to_string(flow_.rebuildTime() * 1000000.0));
+      flow_.resetStats();
+    }
+
     // 他のすべてが更新されてから更新したいもの(カメラとか)
     message_.signal(Msg::POST_UPDATE, params);
 
     entity_holder_.eraseInactiveEntity();
   }
 
+  // TIPS:描画先が無い場合(headless)は呼び出さないこと
   void draw() {
     // 3D向け描画
-    ci::gl::pushMatrices();
-    ci::gl::setMatrices(camera_.body());
+    render(*render_backend_);
 
-    ci::gl::enable(GL_CULL_FACE);
-    glCullFace(GL_BACK);
+    // 2D向け描画
+    postDebugInfo("ticks", std::to_string(tick_num_));
+    postRenderStats();
+    if (sound_) postSoundStats();
+    message_.signal(Msg::DRAW_2D, Param());
+  }
 
-    ci::gl::enable(GL_LIGHTING);
-    ci::gl::enable(GL_NORMALIZE);
-    
-    message_.signal(Msg::LIGHT_ENABLE, Param());
-
-    // FIXME: ci::gl::colorで色を決める
-    //        ci::gl::Materialを使わない
-    glEnable(GL_COLOR_MATERIAL);
-#if !(TARGET_OS_IPHONE)
-    // OpenGL ESは未対応
-    glColorMaterial(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE);
-#endif
-    
-    ci::gl::enableDepthRead();
-    ci::gl::enableDepthWrite();
-    
+  // 指定したBackendで3D部分を描画
+  // 各Entityの描画内容を並列に集めてから、このスレッドでまとめて描画する
+  void render(RenderBackend& backend) {
+    ci::Timer timer(true);
+    // 前回のtickから経過した分だけ補間して描画
+    float interpolation = float(accumulated_time_ / tick_time_);
+    render_queue_.begin(camera_.interpolate(interpolation), interpolation);
+    entity_holder_.draw(threadPool(), render_queue_);
+    render_queue_.merge();
+    extract_time_ = timer.getSeconds();
+
+    backend.render(render_queue_);
+  }
 
-    message_.signal(Msg::DRAW, Param());
+  
+  // 描画の実装を差し替える(計測や検証用)
+  void renderBackend(std::unique_ptr<RenderBackend> backend) {
+    render_backend_ = std::move(backend);
+  }
+  const RenderBackend& renderBackend() const { return *render_backend_; }
 
-    message_.signal(Msg::LIGHT_DISABLE, Param());
-    ci::gl::disable(GL_LIGHTING);
-    
-    ci::gl::popMatrices();
+  // 直前のrenderで描画内容を集めるのにかかった時間(秒)と、視錐台カリングの結果
+  double extractTime() const { return extract_time_; }
+  const RenderQueue::Stats& cullingStats() const { return render_queue_.stats(); }
 
-    // 2D向け描画
-    ci::gl::disableDepthRead();
-    ci::gl::disableDepthWrite();
+  // 音の再生の実装を指定して、音を扱えるようにする
+  void soundBackend(std::unique_ptr<SoundBackend> backend) {
+    sound_ = std::unique_ptr<Sound>(new Sound(message_, params_, std::move(backend)));
+  }
 
-    ci::gl::disable(GL_CULL_FACE);
-    message_.signal(Msg::DRAW_2D, Param());
+  ThreadPool& threadPool() {
+    if (!thread_pool_) {
+      thread_pool_ = std::unique_ptr<ThreadPool>(new ThreadPool(params_.getValueForKey<size_t>("app.renderThreads")));
+    }
+    return *thread_pool_;
   }
 
+  double tickTime() const { return tick_time_; }
+  // 直前のupdateで進めたtick数
+  u_int tickNum() const { return tick_num_; }
+
+  // メッセージ処理時間の計測
+  void profiling(const bool profiling) { message_.profiling(profiling); }
+  const Message::Profile& profile() const { return message_.profile(); }
+
   
   bool isPause() const { return pause_; }
-  void pause(const bool pause) { pause_ = pause; }
+  void pause(const bool pause) {
+    if (recorder_) recorder_->pause(pause);
+    pause_ = pause;
+  }
+
+  u_int seed() const { return seed_; }
+
+  // 書き換えた設定値を反映させる
+  // paths:変わった項目("camera.easeCubeStop"など)
+  // detected_time:書き換えを検出してからここまでの時間(秒)
+  // TIPS:作り直さないと反映されない値もある(stage.widthなど)
+  void changeParams(const std::vector<std::string>& paths, const double detected_time) {
+    ci::Timer timer(true);
+    Param params = {
+      { "paths", paths },
+    };
+    message_.signal(Msg::PARAMS_CHANGED, params);
+
+    double latency = detected_time + timer.getSeconds();
+    postDebugInfo("params reload(ms)", std::to_string(latency * 1000.0));
+    DOUT << "params changed:" << paths.size() << " latency:" << latency * 1000.0 << "ms" << std::endl;
+  }
+
+  const Results& results() const { return results_; }
+
+  // 自動操作などで盤面を調べる時に使う
+  const WorldState& world() const { return world_; }
+  const OccupancyGrid& occupancy() const { return occupancy_; }
+
+  // Stageの(x, z)にあるCubeの高さ(なければfalse)
+  bool stageHeight(const ci::Vec3i& block_pos, int& height) {
+    Param params = {
+      { "block_pos", block_pos },
+      { "is_cube", false },
+    };
+    message_.signal(Msg::CUBE_STAGE_HEIGHT, params);
+    if (!boost::any_cast<bool>(params["is_cube"])) return false;
+
+    height = boost::any_cast<const ci::Vec3i&>(params["height"]).y;
+    return true;
+  }
+
+
+  // スナップショット
+  // 更新に関わる全ての状態(時間、乱数、タイマー、カメラ、Entity)を保存する
+  // TIPS:tickの途中では呼び出さないこと
+  //      pauseと画面の大きさは入力側の状態なので保存しない
+  void save(BinaryWriter& writer) const {
+    writer.put(u_int(SNAPSHOT_ID));
+    writer.put(u_int(SNAPSHOT_VERSION));
+
+    writer.put(accumulated_time_);
+    timer_tasks_.save(writer);
+    camera_.save(writer);
+    factory_.save(writer);
+  }
+
+  // 今の状態を捨てて、スナップショットの状態にする
+  // 読めなかった時はfalse(今の状態のまま)
+  // TIPS:Entityは破棄しながら作り直すので、途中で読めなくなったら
+  //      先に保存しておいた今の状態から作り直して戻す
+  bool load(BinaryReader& reader) {
+    BinaryWriter backup;
+    save(backup);
+    if (read(reader)) return true;
+
+    BinaryReader backup_reader(backup.data());
+    if (!read(backup_reader)) {
+      DOUT << "Can't restore the state before load." << std::endl;
+    }
+    return false;
+  }
+
+  // 状態のハッシュ値(同じ状態なら同じ値)
+  u_int stateHash() const {
+    BinaryWriter writer;
+    save(writer);
+    return writer.hash();
+  }
+
+  // 入力の記録を開始
+  // TIPS:作ったばかりのGameで開始しないと再現できない
+  void record(InputRecorder* recorder) {
+    recorder_ = recorder;
+    if (recorder_) recorder_->start(seed_);
+  }
 
   
 private:
@@ -166,20 +420,99 @@ private:
   void signalTouchMessage(const int msg, std::vector<Touch>& touches) {
     Param params = {
       { "touch",  &touches },
+      { "picked", &picked_ },
       { "camera", &camera_ },
-      { "handled", false }
+      { "handled", false },
+      // TIPS:touchはこの端末の操作(player 0)だけ
+      { "player", 0 },
     };
     message_.signal(msg, params);
   }
 
 
+  void postDebugInfo(const std::string& name, const std::string& value) {
+    Param params = {
+      { "name", name },
+      { "value", value },
+    };
+    message_.signal(Msg::DEBUG_INFO, params);
+  }
+
+  void postRenderStats() {
+    const auto& stats = render_backend_->stats();
+    postDebugInfo("draw calls", std::to_string(stats.draw_calls));
+    postDebugInfo("state changes", std::to_string(stats.state_changes));
+    postDebugInfo("cubes", std::to_string(stats.cubes));
+    postDebugInfo("mesh vertices", std::to_string(stats.mesh_vertices));
+
+    postDebugInfo("extract time(ms)", std::to_string(extract_time_ * 1000.0));
+    postDebugInfo("render threads", std::to_string(threadPool().threadNum()));
+
+    const auto& culling = render_queue_.stats();
+    postDebugInfo("visible", std::to_string(culling.visible));
+    postDebugInfo("culled", std::to_string(culling.culled));
+    postDebugInfo("submit time(ms)", std::to_string(stats.submit_time * 1000.0));
+  }
+
+
+  // スナップショットを読んで状態を置き換える
+  // TIPS:Entityより前の部分は全て読めてから書き換える
+  bool read(BinaryReader& reader) {
+    u_int id;
+    u_int version;
+    if (!reader.get(id) || !reader.get(version)) return false;
+    if ((id != SNAPSHOT_ID) || (version != SNAPSHOT_VERSION)) return false;
+
+    double accumulated_time;
+    if (!reader.get(accumulated_time)) return false;
+    TimerTask<double, int> timer_tasks(tick_time_);
+    if (!timer_tasks.load(reader)) return false;
+    if (!camera_.load(reader)) return false;
+
+    accumulated_time_ = accumulated_time;
+    timer_tasks_.swap(timer_tasks);
+    return factory_.restore(reader);
+  }
+
+
+  void postSoundStats() {
+    auto stats = sound_->stats();
+    postDebugInfo("sound loaded", std::to_string(stats.loaded) + "/" + std::to_string(stats.entries));
+    postDebugInfo("sound pending", std::to_string(stats.pending)
+                                   + " dropped:" + std::to_string(stats.dropped)
+                                   + " failed:" + std::to_string(stats.failed));
+    postDebugInfo("sound voices", std::to_string(stats.voices.active) + "/" + std::to_string(stats.voices.voices)
+                                  + " steals:" + std::to_string(stats.voices.steals));
+  }
+
+
   void restartStage(const Message::Connection& connection, Param& params) {
-    timer_tasks_.add(3.0, [this]() {
+    timer_tasks_.add(3.0, int(TIMER_RESTART));
+  }
+
+  void countClear(const Message::Connection& connection, Param& params) {
+    results_.clears += 1;
+  }
+
+  void countMiss(const Message::Connection& connection, Param& params) {
+    results_.misses += 1;
+  }
+
+  void countAllClear(const Message::Connection& connection, Param& params) {
+    results_.all_clears += 1;
+  }
+
+  void timerEvent(const int event) {
+    switch (event) {
+    case TIMER_RESTART:
+      {
         message_.signal(Msg::RESET_STAGE, Param());
         // この場でentityを破棄
         entity_holder_.eraseInactiveEntity();
         setup();
-      });
+      }
+      break;
+    }
   }
 
   void setup() {
@@ -189,12 +522,17 @@ private:
     message_.signal(Msg::SETUP_STAGE, Param());
 
     // 最後にPlayerの生成
-    for (const auto& pos : params_["game.entry"]) {
+    // 複数人の時は一人ずつ順番に割り当てる
+    const auto& entry = params_[(players_ > 1) ? "game.versusEntry" : "game.entry"];
+    int owner = 0;
+    for (const auto& pos : entry) {
       Param params = {
         { "entry_pos", Json::getVec3<int>(pos) },
         { "paused", false },
+        { "owner", owner },
       };
       message_.signal(Msg::CREATE_CUBEPLAYER, params);
+      owner = (owner + 1) % players_;
     }
   }
   
@@ -10,7 +10,6 @@ enum Msg {
   UPDATE,
   POST_UPDATE,
 
-  DRAW,
   DRAW_2D,
 
   TOUCH_BEGAN,
@@ -21,6 +20,9 @@ enum Msg {
 
   SETUP_GAME,
 
+  // 設定値の変更(変わった項目をbroadcast)
+  PARAMS_CHANGED,
+
   // Stage生成
   SETUP_STAGE,
   RESET_STAGE,
@@ -31,9 +33,6 @@ enum Msg {
 
   ALL_STAGE_CLEAR,
   
-  // 各種情報を収集
-  GATHER_INFORMATION,
-
   // 確定したPlayerの位置をbroadcast
   CUBE_PLAYER_POS,
   CUBE_PLAYER_CHECK_FINISH,
@@ -53,21 +52,41 @@ enum Msg {
   CREATE_FALLCUBE,
   CREATE_ENTRYCUBE,
 
-  LIGHT_ENABLE,
-  LIGHT_DISABLE,
-
   
   SOUND_PLAY,
   SOUND_STOP,
+  // 音源の読み込みを始めておく
+  SOUND_PRELOAD,
 
 
   TOUCHPREVIEW_TOGGLE,
+
+  // デバッグ情報
+  DEBUG_INFO,
+  DEBUGINFO_TOGGLE,
+};
+
+
+// Entityの種類(スナップショットの復元に使う)
+// TIPS:保存したデータの互換性のため、途中に追加しない
+enum EntityType {
+  ENTITY_LIGHT,
+  ENTITY_STAGE,
+  ENTITY_STAGEWATCHER,
+  ENTITY_CUBEPLAYER,
+  ENTITY_CUBEENEMY,
+  ENTITY_FALLCUBE,
+  ENTITY_ENTRYCUBE,
+  ENTITY_TOUCHPREVIEW,
+  ENTITY_DEBUGINFO,
 };
 
 
 struct CubeInfo {
   u_int id;
   bool manipulate;
+  // 操作する人(敵は-1)
+  int owner;
   
   ci::Vec3i block_pos;
   ci::Vec3f pos;
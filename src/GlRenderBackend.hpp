@@ -0,0 +1,165 @@
+﻿#pragma once
+
+//
+// OpenGLによる描画
+// materialごとに1回のdraw callで描画する
+// TIPS:OpenGL ES 1.x でも動くよう、instancingではなく
+//      CPUで頂点を展開してvertex arrayで描画している
+//
+
+#include "cinder/gl/gl.h"
+#include "cinder/gl/Light.h"
+#include "CubeGeometry.hpp"
+#include "RenderBackend.hpp"
+
+
+namespace ngs {
+
+class GlRenderBackend : public RenderBackend {
+  ci::gl::Light light_;
+  bool light_enabled_;
+
+  // 単位立方体
+  ci::Vec3f cube_vertices_[CubeGeometry::VERTEX_NUM];
+  ci::Vec3f cube_normals_[CubeGeometry::VERTEX_NUM];
+
+  // 展開した頂点(毎フレーム使い回す)
+  std::vector<ci::Vec3f> vertices_;
+  std::vector<ci::Vec3f> normals_;
+  std::vector<ci::ColorA> colors_;
+
+
+  // TIPS:コピー不可
+  GlRenderBackend(const GlRenderBackend&) = delete;
+  GlRenderBackend& operator=(const GlRenderBackend&) = delete;
+
+
+public:
+  GlRenderBackend() :
+    light_(ci::gl::Light::POINT, 0),
+    light_enabled_(false)
+  {
+    for (int face = 0; face < CubeGeometry::FACE_NUM; ++face) {
+      int offset = face * CubeGeometry::FACE_VERTEX_NUM;
+      CubeGeometry::faceVertices(face, &cube_vertices_[offset]);
+      for (int i = 0; i < CubeGeometry::FACE_VERTEX_NUM; ++i) {
+        cube_normals_[offset + i] = CubeGeometry::faceNormal(face);
+      }
+    }
+  }
+
+
+  void begin(const RenderQueue& queue) override {
+    RenderBackend::begin(queue);
+
+    ci::gl::pushMatrices();
+    ci::gl::setMatrices(queue.camera());
+
+    light_enabled_ = queue.hasLight();
+    if (light_enabled_) {
+      const auto& light = queue.light();
+      light_.setPosition(light.pos);
+      light_.setAttenuation(light.constant_attenuation,
+                            light.linear_attenuation,
+                            light.quadratic_attenuation);
+      light_.setDiffuse(light.diffuse);
+      light_.setAmbient(light.ambient);
+      light_.setSpecular(light.specular);
+    }
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+  }
+
+  void state(const int state) override {
+    RenderBackend::state(state);
+
+    switch (state) {
+    case RenderQueue::STATE_LIT:
+      {
+        ci::gl::enable(GL_CULL_FACE);
+        glCullFace(GL_BACK);
+
+        ci::gl::enable(GL_LIGHTING);
+        ci::gl::enable(GL_NORMALIZE);
+        if (light_enabled_) light_.enable();
+
+        // FIXME: ci::gl::colorで色を決める
+        //        ci::gl::Materialを使わない
+        glEnable(GL_COLOR_MATERIAL);
+#if !(TARGET_OS_IPHONE)
+        // OpenGL ESは未対応
+        glColorMaterial(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE);
+#endif
+
+        ci::gl::enableDepthRead();
+        ci::gl::enableDepthWrite();
+      }
+      break;
+    }
+  }
+
+  void drawCubes(const int material,
+                 const RenderQueue::Command* commands, const size_t num) override {
+    RenderBackend::drawCubes(material, commands, num);
+
+    expand(commands, num);
+
+    glVertexPointer(3, GL_FLOAT, 0, &vertices_[0]);
+    glNormalPointer(GL_FLOAT, 0, &normals_[0]);
+    glColorPointer(4, GL_FLOAT, 0, &colors_[0]);
+    glDrawArrays(GL_TRIANGLES, 0, GLsizei(vertices_.size()));
+  }
+
+  void drawMesh(const int material, const CubeMesh& mesh) override {
+    RenderBackend::drawMesh(material, mesh);
+    if (mesh.empty()) return;
+
+    glVertexPointer(3, GL_FLOAT, 0, &mesh.vertices[0]);
+    glNormalPointer(GL_FLOAT, 0, &mesh.normals[0]);
+    glColorPointer(4, GL_FLOAT, 0, &mesh.colors[0]);
+    glDrawArrays(GL_TRIANGLES, 0, GLsizei(mesh.vertexNum()));
+  }
+
+  void end() override {
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+
+    if (light_enabled_) light_.disable();
+    ci::gl::disable(GL_LIGHTING);
+
+    ci::gl::popMatrices();
+
+    ci::gl::disableDepthRead();
+    ci::gl::disableDepthWrite();
+    ci::gl::disable(GL_CULL_FACE);
+
+    RenderBackend::end();
+  }
+
+
+private:
+  void expand(const RenderQueue::Command* commands, const size_t num) {
+    size_t vertex_num = num * CubeGeometry::VERTEX_NUM;
+    vertices_.resize(vertex_num);
+    normals_.resize(vertex_num);
+    colors_.resize(vertex_num);
+
+    size_t index = 0;
+    for (size_t n = 0; n < num; ++n) {
+      const auto& command = commands[n];
+      for (int i = 0; i < CubeGeometry::VERTEX_NUM; ++i) {
+        vertices_[index] = command.transform.transformPoint(cube_vertices_[i]);
+        // TIPS:GL_NORMALIZEで正規化される
+        normals_[index]  = command.transform.transformVec(cube_normals_[i]);
+        colors_[index]   = command.color;
+        index += 1;
+      }
+    }
+  }
+
+};
+
+}
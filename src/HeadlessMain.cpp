@@ -0,0 +1,350 @@
+﻿//
+// Cube Parade Windowなし実行
+// usage: CubeParadeHeadless <params.json>[,<params.json>...] <ticks> [script]
+//                           [--profile] [--seed N] [--replay record]
+//                           [--batch N] [--threads N] [--scaling]
+//                           [--verify-snapshot N] [--rollback]
+//                           [--bench-occupancy N] [--soak L,L,...] [--startup]
+//                           [--bench-sound N] [--bench-culling N] [--bench-extract N]
+//                           [--bench-timers N] [--render N out.png [--golden ref.png]]
+//
+// --replay  記録した入力を再生(ticksは無視)
+// --verify-snapshot ticks進めた後でスナップショットを取り、復元してもN tick後に同じ状態になるか調べる
+// --rollback 2つのGameを遅延と欠落のある通信路でつなぎ、ロールバック方式でticksまで進める
+// --bench-occupancy N個のCubeをticks回転がし、重なり判定の時間を計る(--threadsで同時に動かす)
+// --bench-timers N個のタイマーを(ticks * 2)tickの範囲にばらけさせて登録し、半分を取り消してからticks回更新する
+//                登録・取り消し・1tickの更新にかかる時間を以前のstd::listによる実装と比べる
+// --bench-culling stage.startをN行に伸ばしたステージをticksフレーム描画し、chunkのカリングの有無で時間を比べる
+// --bench-extract 全て見えているN個のCubeの描画内容をticksフレーム集め、スレッド数を1から倍々に増やして時間を計る
+// --bench-sound N個の音源を音の出ない環境で読み込み、最初のフレームまでの時間と鳴らすまでの時間を計る
+//               続けて効果音を毎フレーム鳴らし、声の使われ方と混ぜる時間を計る
+//               最後に別のスレッドから1秒間に1万回鳴らし、1回あたりの時間を計る
+// --render  ticks進めた状態をCPUで描画(SoftRenderBackend)してN回の描画時間を計り、最後のフレームをPNGに書き出す
+//           --goldenを指定すると基準画像と比べ、違えば終了コード1
+// --soak    腕前L(bot.skillsの番号)の自動操作ごとにGameを動かし、処理時間・メモリ・クリア率を出力(ticksが0なら止めるまで続ける)
+// --startup 設定値のキャッシュを消した状態(cold)と作った後(warm)で、最初のtickまでの時間を段階ごとに出力
+// --batch   ステージ設定ごとに乱数の種を0〜N-1に変えてN回ずつ同時に実行
+// --scaling スレッド数を1から倍々に増やして実行
+//
+// TIPS:CubeParadePrototypeApp.cppの代わりにこのファイルをビルドする
+//
+
+#ifndef NGS_HEADLESS
+#define NGS_HEADLESS
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Defines.hpp"
+#include "cinder/Json.h"
+#include "cinder/DataSource.h"
+#include "HeadlessRunner.hpp"
+#include "BatchRunner.hpp"
+#include "RollbackSession.hpp"
+#include "OccupancyBench.hpp"
+#include "TimerBench.hpp"
+#include "SoakRunner.hpp"
+#include "ParamsCache.hpp"
+#include "StartupProfile.hpp"
+#include "SoundBench.hpp"
+#include "CullingBench.hpp"
+#include "ExtractBench.hpp"
+#include "SoftRenderBench.hpp"
+
+
+namespace {
+
+std::vector<std::string> split(const std::string& text, const char delimiter) {
+  std::vector<std::string> result;
+  std::istringstream input(text);
+  std::string item;
+  while (std::getline(input, item, delimiter)) {
+    if (!item.empty()) result.push_back(item);
+  }
+  return result;
+}
+
+// スレッド数を1から倍々に増やしてfunc(num)を呼ぶ(threadsが0ならCPUのコア数まで)
+template <typename Func>
+void eachThreadNum(const ngs::u_int threads, Func func) {
+  ngs::u_int max_threads = threads ? threads : std::max(std::thread::hardware_concurrency(), 1u);
+  for (ngs::u_int num = 1; ; num *= 2) {
+    if (num > max_threads) num = max_threads;
+
+    func(num);
+
+    if (num == max_threads) break;
+  }
+}
+
+}
+
+
+int main(int argc, char* argv[]) {
+  if (argc < 3) {
+    std::cerr << "usage: " << argv[0]
+              << " <params.json>[,<params.json>...] <ticks> [script]"
+              << " [--profile] [--seed N] [--replay record] [--batch N] [--threads N] [--scaling]"
+              << " [--verify-snapshot N] [--rollback] [--bench-occupancy N]"
+              << " [--soak L,L,...] [--startup] [--bench-sound N] [--bench-culling N] [--bench-extract N]"
+              << " [--bench-timers N] [--render N out.png [--golden ref.png]]" << std::endl;
+    return 1;
+  }
+
+  std::vector<ci::JsonTree> packs;
+  for (const auto& path : split(argv[1], ',')) {
+    packs.push_back(ci::JsonTree(ci::loadFile(path)));
+  }
+  ngs::u_int ticks = std::strtoul(argv[2], nullptr, 10);
+
+  bool profiling     = false;
+  bool scaling       = false;
+  bool rollback      = false;
+  bool startup       = false;
+  ngs::u_int seed    = 0;
+  ngs::u_int batch   = 0;
+  ngs::u_int threads = 0;
+  ngs::u_int verify_ticks = 0;
+  ngs::u_int bench_cubes  = 0;
+  ngs::u_int bench_timers = 0;
+  ngs::u_int bench_sounds = 0;
+  ngs::u_int bench_rows   = 0;
+  ngs::u_int bench_extract = 0;
+  ngs::u_int render_frames = 0;
+  std::vector<size_t> soak_levels;
+  std::string script_path;
+  std::string render_path;
+  std::string golden_path;
+  std::string replay_path;
+  for (int i = 3; i < argc; ++i) {
+    std::string arg(argv[i]);
+    bool has_value = (i + 1) < argc;
+    if (arg == "--profile") {
+      profiling = true;
+    }
+    else if (arg == "--scaling") {
+      scaling = true;
+    }
+    else if (arg == "--rollback") {
+      rollback = true;
+    }
+    else if (arg == "--startup") {
+      startup = true;
+    }
+    else if ((arg == "--seed") && has_value) {
+      seed = std::strtoul(argv[++i], nullptr, 10);
+    }
+    else if ((arg == "--replay") && has_value) {
+      replay_path = argv[++i];
+    }
+    else if ((arg == "--batch") && has_value) {
+      batch = std::strtoul(argv[++i], nullptr, 10);
+    }
+    else if ((arg == "--threads") && has_value) {
+      threads = std::strtoul(argv[++i], nullptr, 10);
+    }
+    else if ((arg == "--verify-snapshot") && has_value) {
+      verify_ticks = std::strtoul(argv[++i], nullptr, 10);
+    }
+    else if ((arg == "--bench-occupancy") && has_value) {
+      bench_cubes = std::strtoul(argv[++i], nullptr, 10);
+    }
+    else if ((arg == "--bench-culling") && has_value) {
+      bench_rows = std::strtoul(argv[++i], nullptr, 10);
+    }
+    else if ((arg == "--bench-extract") && has_value) {
+      bench_extract = std::strtoul(argv[++i], nullptr, 10);
+    }
+    else if ((arg == "--bench-timers") && has_value) {
+      bench_timers = std::strtoul(argv[++i], nullptr, 10);
+    }
+    else if ((arg == "--bench-sound") && has_value) {
+      bench_sounds = std::strtoul(argv[++i], nullptr, 10);
+    }
+    else if ((arg == "--render") && ((i + 2) < argc)) {
+      render_frames = std::strtoul(argv[++i], nullptr, 10);
+      render_path   = argv[++i];
+    }
+    else if ((arg == "--golden") && has_value) {
+      golden_path = argv[++i];
+    }
+    else if ((arg == "--soak") && has_value) {
+      for (const auto& level : split(argv[++i], ',')) {
+        soak_levels.push_back(std::strtoul(level.c_str(), nullptr, 10));
+      }
+    }
+    else {
+      script_path = arg;
+    }
+  }
+
+  if (bench_cubes > 0) {
+    auto report = ngs::OccupancyBench::run(bench_cubes, ticks, seed, threads);
+    ngs::OccupancyBench::print(std::cout, report);
+    return report.isValid() ? 0 : 1;
+  }
+
+  if (bench_timers > 0) {
+    double tick_time = 1.0 / packs.front().getValueForKey<double>("app.tickRate");
+    auto report = ngs::TimerBench::run(bench_timers, ticks, tick_time, ticks * 2 * tick_time, seed);
+    ngs::TimerBench::print(std::cout, report);
+    return report.isValid() ? 0 : 1;
+  }
+
+  if (bench_rows > 0) {
+    auto report = ngs::CullingBench::run(packs.front(), bench_rows, ticks, seed);
+    ngs::CullingBench::print(std::cout, report);
+    return report.isValid() ? 0 : 1;
+  }
+
+  if (bench_extract > 0) {
+    // TIPS:記録したコマンド列は、スレッド数によらず同じになるはず
+    ngs::ExtractBench bench(bench_extract);
+    std::vector<ngs::ExtractBench::Report> reports;
+    eachThreadNum(threads,
+                  [&bench, &reports, ticks](const ngs::u_int num) {
+                    ngs::ThreadPool thread_pool(num);
+                    auto report = bench.run(thread_pool, ticks);
+                    ngs::ExtractBench::print(std::cout, report);
+                    reports.push_back(report);
+                  });
+
+    bool valid = std::all_of(std::begin(reports), std::end(reports),
+                             [&reports](const ngs::ExtractBench::Report& report) {
+                               return report.stable && (report.hash == reports.front().hash);
+                             });
+    std::cout << "stream:" << (valid ? "OK" : "NG") << std::endl;
+    return valid ? 0 : 1;
+  }
+
+  if (render_frames > 0) {
+    // TIPS:浮動小数点の計算順の違いで1くらいはずれるので、それを超えた差だけを数える
+    const int threshold = 1;
+    ngs::ThreadPool thread_pool(threads);
+    auto report = ngs::SoftRenderBench::run(packs.front(), thread_pool, ticks, render_frames, seed,
+                                            render_path, golden_path, threshold);
+    ngs::SoftRenderBench::print(std::cout, report);
+    return report.isValid() ? 0 : 1;
+  }
+
+  if (bench_sounds > 0) {
+    auto report = ngs::SoundBench::run(packs.front(), bench_sounds);
+    ngs::SoundBench::print(std::cout, report);
+    return report.played ? 0 : 1;
+  }
+
+  if (startup) {
+    std::string path = split(argv[1], ',').front();
+    std::string cache_path = path + ".cache";
+    std::remove(cache_path.c_str());
+
+    for (int i = 0; i < 2; ++i) {
+      ngs::StartupProfile profile;
+
+      ci::JsonTree params;
+      auto result = ngs::ParamsCache::load(params, path, cache_path);
+      if (result == ngs::ParamsCache::SOURCE_ERROR) {
+        std::cerr << "can't read:" << path << std::endl;
+        return 1;
+      }
+      profile.mark(std::string("params ") + ngs::ParamsCache::resultName(result));
+
+      ngs::Game game(params, seed);
+      game.resize(ci::Vec2i(params.getValueForKey<int>("app.width"),
+                            params.getValueForKey<int>("app.height")));
+      profile.mark("game");
+
+      game.step();
+      profile.mark("first step");
+
+      profile.print(std::cout, (result == ngs::ParamsCache::CACHE_HIT) ? "warm" : "cold",
+                    params.getValueForKey<double>("app.startupTarget"));
+    }
+    return 0;
+  }
+
+  if (!soak_levels.empty()) {
+    ngs::SoakRunner runner(packs.front(), soak_levels, seed);
+    runner.run(ticks, std::cout);
+    return 0;
+  }
+
+  if (rollback) {
+    ngs::RollbackSession session(packs.front(), seed);
+    auto report = session.run(ticks);
+    ngs::RollbackSession::print(std::cout, report);
+    return report.isValid() ? 0 : 1;
+  }
+
+  if (!replay_path.empty()) {
+    ngs::InputReplayer replayer;
+    if (!replayer.read(replay_path)) {
+      std::cerr << "can't read record:" << replay_path << std::endl;
+      return 1;
+    }
+
+    ngs::HeadlessRunner runner(packs.front(), replayer.seed());
+    auto report = runner.replay(replayer, profiling);
+    ngs::HeadlessRunner::print(std::cout, report);
+    return 0;
+  }
+
+  std::string script;
+  if (!script_path.empty()) {
+    std::ifstream input(script_path);
+    if (!input) {
+      std::cerr << "can't open:" << script_path << std::endl;
+      return 1;
+    }
+    script.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+  }
+
+  if (batch == 0) {
+    ngs::HeadlessRunner runner(packs.front(), seed);
+    std::istringstream input(script);
+    runner.script(input);
+
+    auto report = runner.run(ticks, profiling);
+    ngs::HeadlessRunner::print(std::cout, report);
+
+    if (verify_ticks > 0) {
+      auto snapshot = runner.verifySnapshot(verify_ticks);
+      ngs::HeadlessRunner::print(std::cout, snapshot);
+      return snapshot.isValid() ? 0 : 1;
+    }
+    return 0;
+  }
+
+  // ステージ設定 × 乱数の種
+  std::vector<ngs::BatchRunner::Job> jobs;
+  for (const auto& pack : packs) {
+    for (ngs::u_int i = 0; i < batch; ++i) {
+      ngs::BatchRunner::Job job = { &pack, seed + i };
+      jobs.push_back(job);
+    }
+  }
+
+  if (!scaling) {
+    ngs::ThreadPool thread_pool(threads);
+    auto report = ngs::BatchRunner::run(thread_pool, jobs, ticks, script);
+    ngs::BatchRunner::print(std::cout, report);
+    return 0;
+  }
+
+  eachThreadNum(threads,
+                [&jobs, ticks, &script](const ngs::u_int num) {
+                  ngs::ThreadPool thread_pool(num);
+                  auto report = ngs::BatchRunner::run(thread_pool, jobs, ticks, script);
+                  ngs::BatchRunner::print(std::cout, report);
+                });
+
+  return 0;
+}
@@ -0,0 +1,326 @@
+﻿#pragma once
+
+//
+// Windowを持たない実行環境
+// 描画もSoundも行わず、CPUの許す限り速く固定tickでGameを進める
+// 入力はスクリプトで与える
+//
+// スクリプトの書式(1行1イベント、#以降はコメント)
+//   <tick> key <UP|DOWN|LEFT|RIGHT|文字>
+//   <tick> began|moved|ended <touch id> <x> <y>
+//
+
+#include <algorithm>
+#include <cctype>
+#include <istream>
+#include <map>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "cinder/app/KeyEvent.h"
+#include "cinder/Json.h"
+#include "cinder/Timer.h"
+#include "Touch.hpp"
+#include "Game.hpp"
+#include "InputReplayer.hpp"
+
+
+namespace ngs {
+
+class HeadlessRunner {
+public:
+  enum {
+    EVENT_KEY,
+    EVENT_TOUCH_BEGAN,
+    EVENT_TOUCH_MOVED,
+    EVENT_TOUCH_ENDED
+  };
+
+  struct Event {
+    u_int tick;
+    int type;
+
+    int keycode;
+    int charactor;
+
+    u_int touch_id;
+    ci::Vec2f touch_pos;
+  };
+
+  // 実行結果
+  struct Report {
+    u_int  ticks;
+    double sim_time;
+    double wall_time;
+
+    Message::Profile profile;
+  };
+
+  // スナップショットの検証結果
+  struct SnapshotReport {
+    size_t size;
+    double save_time;
+    double load_time;
+
+    // 復元した直後の状態が保存した状態と一致したか
+    bool round_trip;
+
+    // 保存した状態からticksだけ進めた結果と、復元してから同じだけ進めた結果
+    u_int ticks;
+    u_int hash;
+    u_int restored_hash;
+
+    bool isValid() const { return round_trip && (hash == restored_hash); }
+  };
+
+
+private:
+  Game game_;
+
+  std::vector<Event> events_;
+  size_t event_index_;
+
+  u_int tick_;
+
+  // タッチの直前の位置
+  std::map<u_int, ci::Vec2f> touch_pos_;
+
+
+  // TIPS:コピー不可
+  HeadlessRunner(const HeadlessRunner&) = delete;
+  HeadlessRunner& operator=(const HeadlessRunner&) = delete;
+
+
+public:
+  HeadlessRunner(ci::JsonTree& params, const u_int seed) :
+    game_(params, seed),
+    event_index_(0),
+    tick_(0)
+  {
+    // Windowの代わりに設定値の大きさで画面を決める
+    game_.resize(ci::Vec2i(params.getValueForKey<int>("app.width"),
+                           params.getValueForKey<int>("app.height")));
+  }
+
+
+  // スクリプトを読み込んで、入力イベントを追加する
+  // 書式の誤りがあった行は無視する
+  void script(std::istream& stream) {
+    std::string line;
+    while (std::getline(stream, line)) {
+      line = line.substr(0, line.find('#'));
+
+      std::istringstream input(line);
+      std::string command;
+      Event event = {};
+      if (!(input >> event.tick >> command)) continue;
+
+      if (command == "key") {
+        std::string key;
+        if (!(input >> key)) continue;
+
+        event.type = EVENT_KEY;
+        keyCode(key, event.keycode, event.charactor);
+      }
+      else {
+        if (command == "began")      event.type = EVENT_TOUCH_BEGAN;
+        else if (command == "moved") event.type = EVENT_TOUCH_MOVED;
+        else if (command == "ended") event.type = EVENT_TOUCH_ENDED;
+        else continue;
+
+        if (!(input >> event.touch_id >> event.touch_pos.x >> event.touch_pos.y)) continue;
+      }
+
+      events_.push_back(event);
+    }
+
+    // TIPS:同じtickの中では記述順を保つ
+    std::stable_sort(std::begin(events_), std::end(events_),
+                     [](const Event& lhs, const Event& rhs) {
+                       return lhs.tick < rhs.tick;
+                     });
+  }
+
+  // 指定したtick数だけ進める
+  // profiling:メッセージごと、クラスごとの処理時間を計測する
+  Report run(const u_int ticks, const bool profiling = false) {
+    game_.profiling(profiling);
+
+    ci::Timer timer(true);
+    for (u_int i = 0; i < ticks; ++i) {
+      dispatchEvents();
+      game_.step();
+      tick_ += 1;
+    }
+
+    Report report = {
+      ticks,
+      ticks * game_.tickTime(),
+      timer.getSeconds(),
+      game_.profile()
+    };
+    return report;
+  }
+
+  // 記録した入力を最後まで再生する
+  // TIPS:記録した時と同じ種で作っておくこと
+  Report replay(InputReplayer& replayer, const bool profiling = false) {
+    game_.profiling(profiling);
+
+    u_int ticks = 0;
+    ci::Timer timer(true);
+    while (replayer.frame(game_)) {
+      ticks += game_.tickNum();
+    }
+    tick_ += ticks;
+
+    Report report = {
+      ticks,
+      ticks * game_.tickTime(),
+      timer.getSeconds(),
+      game_.profile()
+    };
+    return report;
+  }
+
+  // 今の状態を保存してticksだけ進め、復元してからもう一度進めて結果を比べる
+  // TIPS:スクリプトの入力は与えない
+  SnapshotReport verifySnapshot(const u_int ticks) {
+    SnapshotReport report = {};
+    report.ticks = ticks;
+
+    BinaryWriter snapshot;
+    ci::Timer timer(true);
+    game_.save(snapshot);
+    report.save_time = timer.getSeconds();
+    report.size = snapshot.size();
+
+    for (u_int i = 0; i < ticks; ++i) {
+      game_.step();
+    }
+    report.hash = game_.stateHash();
+
+    BinaryReader reader(snapshot.data());
+    timer.start();
+    bool loaded = game_.load(reader);
+    report.load_time = timer.getSeconds();
+    report.round_trip = loaded && (game_.stateHash() == snapshot.hash());
+
+    for (u_int i = 0; i < ticks; ++i) {
+      game_.step();
+    }
+    report.restored_hash = game_.stateHash();
+    tick_ += ticks;
+
+    return report;
+  }
+
+  Game& game() { return game_; }
+  u_int tick() const { return tick_; }
+
+
+  static void print(std::ostream& output, const Report& report) {
+    output << "ticks:" << report.ticks
+           << " sim:" << report.sim_time << "s"
+           << " wall:" << report.wall_time << "s"
+           << " speed:" << report.sim_time / std::max(report.wall_time, 1e-9) << "x"
+           << std::endl;
+
+    if (!report.profile.messages.empty()) {
+      output << "[message]" << std::endl;
+      for (const auto& timing : sortedByTime(report.profile.messages)) {
+        output << "  " << timing.first << " " << timing.second.count
+               << " " << timing.second.time * 1000.0 << "ms" << std::endl;
+      }
+    }
+    if (!report.profile.systems.empty()) {
+      output << "[system]" << std::endl;
+      for (const auto& timing : sortedByTime(report.profile.systems)) {
+        output << "  " << timing.first << " " << timing.second.count
+               << " " << timing.second.time * 1000.0 << "ms" << std::endl;
+      }
+    }
+  }
+
+  static void print(std::ostream& output, const SnapshotReport& report) {
+    output << "snapshot size:" << report.size << "bytes"
+           << " save:" << report.save_time * 1000000.0 << "us"
+           << " load:" << report.load_time * 1000000.0 << "us"
+           << std::endl;
+    output << "round trip:" << (report.round_trip ? "OK" : "NG")
+           << " after " << report.ticks << " ticks:" << std::hex
+           << report.hash << "/" << report.restored_hash << std::dec
+           << " " << ((report.hash == report.restored_hash) ? "OK" : "NG")
+           << std::endl;
+  }
+
+
+private:
+  void dispatchEvents() {
+    while ((event_index_ < events_.size()) && (events_[event_index_].tick <= tick_)) {
+      const auto& event = events_[event_index_];
+      event_index_ += 1;
+
+      if (event.type == EVENT_KEY) {
+        game_.keyDown(event.keycode, event.charactor);
+        game_.keyUp(event.keycode, event.charactor);
+        continue;
+      }
+
+      auto it = touch_pos_.find(event.touch_id);
+      ci::Vec2f prev_pos = (it != std::end(touch_pos_)) ? it->second : event.touch_pos;
+      touch_pos_[event.touch_id] = event.touch_pos;
+
+      std::vector<Touch> touches = {
+        { true,
+          false,
+          tick_ * game_.tickTime(),
+          event.touch_id,
+          event.touch_pos, prev_pos }
+      };
+
+      switch (event.type) {
+      case EVENT_TOUCH_BEGAN:
+        game_.touchesBegan(touches);
+        break;
+
+      case EVENT_TOUCH_MOVED:
+        game_.touchesMoved(touches);
+        break;
+
+      case EVENT_TOUCH_ENDED:
+        game_.touchesEnded(touches);
+        touch_pos_.erase(event.touch_id);
+        break;
+      }
+    }
+  }
+
+  static void keyCode(const std::string& key, int& keycode, int& charactor) {
+    charactor = 0;
+    if (key == "UP")         keycode = ci::app::KeyEvent::KEY_UP;
+    else if (key == "DOWN")  keycode = ci::app::KeyEvent::KEY_DOWN;
+    else if (key == "LEFT")  keycode = ci::app::KeyEvent::KEY_LEFT;
+    else if (key == "RIGHT") keycode = ci::app::KeyEvent::KEY_RIGHT;
+    else {
+      // TIPS:文字キーのkeycodeは小文字のASCIIコード
+      charactor = key[0];
+      keycode   = std::tolower(key[0]);
+    }
+  }
+
+  // 処理時間の長い順に並べる
+  template <typename T>
+  static std::vector<std::pair<T, Message::Timing> > sortedByTime(const std::map<T, Message::Timing>& timings) {
+    std::vector<std::pair<T, Message::Timing> > sorted(std::begin(timings), std::end(timings));
+    std::sort(std::begin(sorted), std::end(sorted),
+              [](const std::pair<T, Message::Timing>& lhs, const std::pair<T, Message::Timing>& rhs) {
+                return lhs.second.time > rhs.second.time;
+              });
+    return sorted;
+  }
+
+};
+
+}
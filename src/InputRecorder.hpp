@@ -0,0 +1,131 @@
+﻿#pragma once
+
+//
+// 入力の記録
+// Gameへの入力(touch、key、pause、画面の大きさ)とフレームごとの経過時間を乱数の種と一緒に記録する
+// 同じ種で作ったGameにInputReplayerで流し込むと同じ状態が再現される
+//
+
+#include <string>
+#include <vector>
+#include "BinaryStream.hpp"
+#include "Touch.hpp"
+
+
+namespace ngs {
+
+class InputRecorder {
+public:
+  // ファイルの識別子と版
+  enum {
+    FILE_ID      = 0x5253474e,    // 'NGSR'
+    // TIPS:乱数の実装が変わると同じ種でも再現できないので、版を上げる
+    FILE_VERSION = 3
+  };
+
+  // 記録の種類
+  enum Type {
+    FRAME,
+
+    TOUCH_BEGAN,
+    TOUCH_MOVED,
+    TOUCH_ENDED,
+
+    KEY_DOWN,
+    KEY_UP,
+
+    PAUSE,
+
+    // touch位置からの判定に影響する
+    RESIZE
+  };
+
+
+private:
+  BinaryWriter writer_;
+  bool recording_;
+  u_int frame_num_;
+
+
+  // TIPS:コピー不可
+  InputRecorder(const InputRecorder&) = delete;
+  InputRecorder& operator=(const InputRecorder&) = delete;
+
+
+public:
+  InputRecorder() :
+    recording_(false),
+    frame_num_(0)
+  { }
+
+
+  // seed:記録するGameの乱数の種
+  void start(const u_int seed) {
+    writer_.clear();
+    writer_.put(u_int(FILE_ID));
+    writer_.put(u_int(FILE_VERSION));
+    writer_.put(seed);
+
+    recording_ = true;
+    frame_num_ = 0;
+  }
+
+  void stop() { recording_ = false; }
+
+  bool isRecording() const { return recording_; }
+  u_int frameNum() const { return frame_num_; }
+
+  bool write(const std::string& path) const { return writer_.write(path); }
+
+
+  void frame(const double delta_time, const u_int speed) {
+    if (!recording_) return;
+
+    writer_.put(u_char(FRAME));
+    writer_.put(delta_time);
+    writer_.put(speed);
+    frame_num_ += 1;
+  }
+
+  void touches(const Type type, const std::vector<Touch>& touches) {
+    if (!recording_) return;
+
+    writer_.put(u_char(type));
+    writer_.put(u_short(touches.size()));
+    for (const auto& touch : touches) {
+      writer_.put(touch.prior);
+      writer_.put(touch.timestamp);
+      writer_.put(touch.id);
+      writer_.put(touch.pos.x);
+      writer_.put(touch.pos.y);
+      writer_.put(touch.prev_pos.x);
+      writer_.put(touch.prev_pos.y);
+    }
+  }
+
+  void key(const Type type, const int keycode, const int charactor) {
+    if (!recording_) return;
+
+    writer_.put(u_char(type));
+    writer_.put(keycode);
+    writer_.put(charactor);
+  }
+
+  void pause(const bool pause) {
+    if (!recording_) return;
+
+    writer_.put(u_char(PAUSE));
+    writer_.put(pause);
+  }
+
+  void resize(const ci::Vec2i& size) {
+    if (!recording_) return;
+
+    writer_.put(u_char(RESIZE));
+    writer_.put(size.x);
+    writer_.put(size.y);
+  }
+
+};
+
+}
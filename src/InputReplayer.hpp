@@ -0,0 +1,158 @@
+﻿#pragma once
+
+//
+// 記録した入力の再生
+// 1フレーム分ずつ、記録した順番でGameへ入力を流し込む
+//
+
+#include <string>
+#include <vector>
+#include "BinaryStream.hpp"
+#include "InputRecorder.hpp"
+#include "Touch.hpp"
+#include "Game.hpp"
+
+
+namespace ngs {
+
+class InputReplayer {
+  BinaryReader reader_;
+
+  u_int seed_;
+  u_int frame_num_;
+  bool valid_;
+
+
+  // TIPS:コピー不可
+  InputReplayer(const InputReplayer&) = delete;
+  InputReplayer& operator=(const InputReplayer&) = delete;
+
+
+public:
+  InputReplayer() :
+    seed_(0),
+    frame_num_(0),
+    valid_(false)
+  { }
+
+
+  bool read(const std::string& path) {
+    valid_ = false;
+    if (!reader_.read(path)) return false;
+
+    u_int id;
+    u_int version;
+    if (!reader_.get(id) || !reader_.get(version) || !reader_.get(seed_)) return false;
+    if ((id != InputRecorder::FILE_ID) || (version != InputRecorder::FILE_VERSION)) return false;
+
+    frame_num_ = 0;
+    valid_     = true;
+    return true;
+  }
+
+  // 記録したGameの乱数の種(同じ種でGameを作ってから再生する)
+  u_int seed() const { return seed_; }
+  u_int frameNum() const { return frame_num_; }
+
+  bool isFinished() const { return !valid_ || reader_.eof(); }
+
+
+  // 次のフレームの更新までを再生
+  // 記録が終わっていたらfalse
+  bool frame(Game& game) {
+    while (!isFinished()) {
+      u_char type;
+      if (!reader_.get(type)) break;
+
+      switch (type) {
+      case InputRecorder::FRAME:
+        {
+          double delta_time;
+          u_int speed;
+          if (!reader_.get(delta_time) || !reader_.get(speed)) break;
+
+          game.update(delta_time, speed);
+          frame_num_ += 1;
+        }
+        return true;
+
+      case InputRecorder::TOUCH_BEGAN:
+      case InputRecorder::TOUCH_MOVED:
+      case InputRecorder::TOUCH_ENDED:
+        {
+          std::vector<Touch> touches;
+          if (!readTouches(touches)) break;
+
+          if (type == InputRecorder::TOUCH_BEGAN)      game.touchesBegan(touches);
+          else if (type == InputRecorder::TOUCH_MOVED) game.touchesMoved(touches);
+          else                                         game.touchesEnded(touches);
+        }
+        break;
+
+      case InputRecorder::KEY_DOWN:
+      case InputRecorder::KEY_UP:
+        {
+          int keycode;
+          int charactor;
+          if (!reader_.get(keycode) || !reader_.get(charactor)) break;
+
+          if (type == InputRecorder::KEY_DOWN) game.keyDown(keycode, charactor);
+          else                                 game.keyUp(keycode, charactor);
+        }
+        break;
+
+      case InputRecorder::PAUSE:
+        {
+          bool pause;
+          if (!reader_.get(pause)) break;
+
+          game.pause(pause);
+        }
+        break;
+
+      case InputRecorder::RESIZE:
+        {
+          ci::Vec2i size;
+          if (!reader_.get(size.x) || !reader_.get(size.y)) break;
+
+          game.resize(size);
+        }
+        break;
+
+      default:
+        // 壊れた記録
+        valid_ = false;
+        break;
+      }
+
+      if (!reader_.good()) valid_ = false;
+    }
+
+    return false;
+  }
+
+
+private:
+  bool readTouches(std::vector<Touch>& touches) {
+    u_short num;
+    if (!reader_.get(num)) return false;
+
+    for (u_short i = 0; i < num; ++i) {
+      Touch touch = {};
+      if (!reader_.get(touch.prior)
+          || !reader_.get(touch.timestamp)
+          || !reader_.get(touch.id)
+          || !reader_.get(touch.pos.x)
+          || !reader_.get(touch.pos.y)
+          || !reader_.get(touch.prev_pos.x)
+          || !reader_.get(touch.prev_pos.y)) {
+        return false;
+      }
+      touches.push_back(touch);
+    }
+    return true;
+  }
+
+};
+
+}
@@ -5,6 +5,8 @@
 // 配列から色々生成する
 //
 
+#include <string>
+#include <vector>
 #include "cinder/Vector.h"
 
 
@@ -50,6 +52,20 @@ ci::ColorAT<T> getColorA(const ci::JsonTree& json) {
   return std::move(ci::ColorAT<T>(json[0].getValue<T>(), json[1].getValue<T>(), json[2].getValue<T>(), json[3].getValue<T>()));
 }
 
+
+// 変わった項目(paths)にkeyかその中身、またはkeyを含む節があるか
+// TIPS:pathとkeyは"camera.easeCubeStop"の形式。空のpathは全体
+inline bool isChanged(const std::vector<std::string>& paths, const std::string& key) {
+  for (const auto& path : paths) {
+    const auto& shorter = (path.size() < key.size()) ? path : key;
+    const auto& longer  = (path.size() < key.size()) ? key : path;
+    if (shorter.empty()) return true;
+    if ((longer.compare(0, shorter.size(), shorter) == 0)
+        && ((longer.size() == shorter.size()) || (longer[shorter.size()] == '.'))) return true;
+  }
+  return false;
+}
+
 }
 
 }
@@ -4,6 +4,9 @@
 // 一定時間ごとにtrueを返すカウンタ
 //
 
+#include "BinaryStream.hpp"
+
+
 namespace ngs {
 
 template <typename T>
@@ -57,7 +60,17 @@ public:
 
   
   T lapseRate() const { return lap_time_ / goal_time_; }
+  T goalTime() const { return goal_time_; }
   bool isActive() const { return !paused_; }
+
+
+  template <typename Self, typename Stream>
+  static void transfer(Self& self, Stream& stream) {
+    stream & self.lap_time_ & self.goal_time_ & self.paused_;
+  }
+
+  void save(BinaryWriter& writer) const { transfer(*this, writer); }
+  void load(BinaryReader& reader) { transfer(*this, reader); }
   
 };
 
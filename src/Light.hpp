@@ -5,7 +5,7 @@
 //
 
 #include "GameEnvironment.hpp"
-#include "cinder/gl/Light.h"
+#include "RenderQueue.hpp"
 #include "Message.hpp"
 #include "Entity.hpp"
 
@@ -18,9 +18,11 @@ class Light : public Entity {
 
   bool active_;
 
-  ci::gl::Light light_;
+  RenderQueue::Light light_;
 
   ci::Vec3f pos_;
+  // 直前のtickの位置(描画補間用)
+  ci::Vec3f prev_pos_;
   ci::Vec3f offset_;
   ci::Vec3f target_pos_;
 
@@ -29,40 +31,69 @@ public:
   explicit Light(Message& message, ci::JsonTree& params) :
     message_(message),
     params_(params),
-    light_(ci::gl::Light::POINT, 0),
     active_(true)
   {}
 
   void setup(boost::shared_ptr<Light> obj_sp) {
+    readParams();
+
     pos_    = Json::getVec3<float>(params_["light.pos"]);
     offset_ = pos_;
-    light_.setPosition(pos_);
+    prev_pos_ = pos_;
+    // TIPS:最初のSTAGE_POSより前のupdateで不定値を使わない
+    target_pos_ = pos_;
+    light_.pos = pos_;
+
+    connect(obj_sp);
+  }
+
+  // スナップショットから復元
+  void restore(boost::shared_ptr<Light> obj_sp, BinaryReader& reader) {
+    readParams();
+    transfer(*this, reader);
+    light_.pos = pos_;
+
+    connect(obj_sp);
+  }
 
-    light_.setAttenuation(params_["light.ConstantAttenuation"].getValue<float>(),
-                          params_["light.LinearAttenuation"].getValue<float>(),
-                          params_["light.QuadraticAttenuation"].getValue<float>());
 
-    light_.setDiffuse(Json::getColor<float>(params_["light.Diffuse"]));
-    light_.setAmbient(Json::getColor<float>(params_["light.Ambient"]));
-    light_.setSpecular(Json::getColor<float>(params_["light.Specular"]));
+private:
+  void readParams() {
+    light_.constant_attenuation  = params_["light.ConstantAttenuation"].getValue<float>();
+    light_.linear_attenuation    = params_["light.LinearAttenuation"].getValue<float>();
+    light_.quadratic_attenuation = params_["light.QuadraticAttenuation"].getValue<float>();
+
+    light_.diffuse  = Json::getColor<float>(params_["light.Diffuse"]);
+    light_.ambient  = Json::getColor<float>(params_["light.Ambient"]);
+    light_.specular = Json::getColor<float>(params_["light.Specular"]);
+  }
 
+  void connect(boost::shared_ptr<Light> obj_sp) {
     message_.connect(Msg::UPDATE, obj_sp, &Light::update);
     message_.connect(Msg::STAGE_POS, obj_sp, &Light::stagePos);
-    message_.connect(Msg::LIGHT_ENABLE, obj_sp, &Light::enable);
-    message_.connect(Msg::LIGHT_DISABLE, obj_sp, &Light::disable);
 
     message_.connect(Msg::RESET_STAGE, obj_sp, &Light::inactive);
+    message_.connect(Msg::PARAMS_CHANGED, obj_sp, &Light::paramsChanged);
   }
 
 
-private:
   bool isActive() const override { return active_; }
+  int type() const override { return ENTITY_LIGHT; }
+
+
+  template <typename Self, typename Stream>
+  static void transfer(Self& self, Stream& stream) {
+    stream & self.pos_ & self.prev_pos_ & self.offset_ & self.target_pos_;
+  }
+
+  void save(BinaryWriter& writer) const override { transfer(*this, writer); }
 
 
   void update(const Message::Connection& connection, Param& param) {
+    prev_pos_ = pos_;
     pos_.x = pos_.x + (target_pos_.x - pos_.x) * 0.1f;
     pos_.z = pos_.z + (target_pos_.z - pos_.z) * 0.1f;
-    light_.setPosition(pos_);
+    light_.pos = pos_;
   }
 
   void stagePos(const Message::Connection& connection, Param& param) {
@@ -70,12 +101,25 @@ private:
   }
 
   
-  void enable(const Message::Connection& connection, Param& param) {
-    light_.enable();
+  void draw(RenderQueue::List& list) const override {
+    auto light = light_;
+    light.pos = prev_pos_.lerp(list.interpolation(), pos_);
+    list.light(light);
   }
 
-  void disable(const Message::Connection& connection, Param& param) {
-    light_.disable();
+  // 書き換えた設定値を読み直す
+  // TIPS:位置はStageからの距離を変え、今の位置から追いかける
+  void paramsChanged(const Message::Connection& connection, Param& param) {
+    const auto& paths = boost::any_cast<const std::vector<std::string>& >(param["paths"]);
+    if (!Json::isChanged(paths, "light")) return;
+
+    readParams();
+
+    auto offset = Json::getVec3<float>(params_["light.pos"]);
+    target_pos_ += offset - offset_;
+    // TIPS:高さは追いかけない
+    pos_.y += offset.y - offset_.y;
+    offset_ = offset;
   }
 
   void inactive(const Message::Connection& connection, Param& param) {
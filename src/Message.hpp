@@ -8,9 +8,12 @@
 #include <boost/signals2.hpp>
 #include <boost/signals2/deconstruct.hpp>
 #include <boost/shared_ptr.hpp>
+#include <functional>
 #include <map>
 #include <memory>
 #include <string>
+#include <typeinfo>
+#include "cinder/Timer.h"
 
 
 namespace ngs {
@@ -31,21 +34,36 @@ public:
   using SignalType = boost::signals2::signal<void(Param&)>;
 
 
+  // 処理時間の計測結果
+  // TIPS:signal中のsignalも含めた時間
+  struct Timing {
+    u_int  count;
+    double time;
+  };
+
+  struct Profile {
+    // メッセージごと
+    std::map<int, Timing> messages;
+    // 受け取ったクラスごと
+    std::map<std::string, Timing> systems;
+  };
+
+
   // boost::shared_ptr、std::shared_ptr、pointer、lambda式と、
   // 型に合わせて登録関数を定義
   template <typename T, typename F>
   Connection connect(const int msg, boost::shared_ptr<T> object, F callback) {
-    return siglans_[msg].connect_extended(SignalType::extended_slot_type(callback, object.get(), _1, _2).track(object));
+    return siglans_[msg].connect_extended(SignalType::extended_slot_type(slot(object.get(), callback), _1, _2).track(object));
   }
 
   template <typename T, typename F>
   Connection connect(const int msg, std::shared_ptr<T> object, F callback) {
-    return siglans_[msg].connect_extended(SignalType::extended_slot_type(callback, object.get(), _1, _2).track_foreign(object));
+    return siglans_[msg].connect_extended(SignalType::extended_slot_type(slot(object.get(), callback), _1, _2).track_foreign(object));
   }
 
   template<typename T, typename F>
   Connection connect(const int msg, T* object, F callback) {
-    return siglans_[msg].connect_extended(boost::bind(callback, object, _1, _2));
+    return siglans_[msg].connect_extended(slot(object, callback));
   }
   
   template<typename F>
@@ -55,7 +73,14 @@ public:
 
 
   void signal(const int msg, Param& params) {
+    if (!profiling_) {
+      siglans_[msg](params);
+      return;
+    }
+
+    ci::Timer timer(true);
     siglans_[msg](params);
+    record(profile_.messages[msg], timer.getSeconds());
   }
 
   void signal(const int msg, Param&& params) {
@@ -96,6 +121,15 @@ public:
 
   };
 
+
+  // 処理時間の計測
+  // TIPS:計測しない時は分岐１回分のコストだけ
+  void profiling(const bool profiling) { profiling_ = profiling; }
+  bool isProfiling() const { return profiling_; }
+
+  const Profile& profile() const { return profile_; }
+  void clearProfile() { profile_ = Profile(); }
+
   
 private:
   // TIPS:コピー不可
@@ -103,6 +137,31 @@ private:
   Message& operator=(const Message&) = delete;
 
   std::map<int, SignalType> siglans_;
+
+  bool profiling_ = false;
+  Profile profile_;
+
+
+  static void record(Timing& timing, const double time) {
+    timing.count += 1;
+    timing.time  += time;
+  }
+
+  // メンバ関数呼び出しを、受け取ったクラスごとに計測できる形にする
+  template <typename T, typename F>
+  std::function<void (const Connection&, Param&)> slot(T* object, F callback) {
+    const char* name = typeid(T).name();
+    return [this, object, callback, name](const Connection& connection, Param& params) {
+      if (!profiling_) {
+        (object->*callback)(connection, params);
+        return;
+      }
+
+      ci::Timer timer(true);
+      (object->*callback)(connection, params);
+      record(profile_.systems[name], timer.getSeconds());
+    };
+  }
   
 };
 
@@ -0,0 +1,190 @@
+﻿#pragma once
+
+//
+// Cubeの重なり判定の計測(headless用)
+// 大量のCubeを格子の上でランダムに転がし、
+// OccupancyGridと以前のCubeInfoの線形探索で1回の移動判定にかかる時間を比べる
+//
+// TIPS:複数のスレッドで同時に動かし、最後に同じマスを確保したCubeがいないか確かめる
+//
+
+#include <algorithm>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "cinder/Timer.h"
+#include "OccupancyGrid.hpp"
+#include "Random.hpp"
+
+
+namespace ngs {
+
+class OccupancyBench {
+  // 格子の大きさ(Cubeが動ける余地を残す)
+  enum {
+    WIDTH = 128,
+    ROWS  = 256
+  };
+
+  struct Cube {
+    u_int id;
+    ci::Vec3i pos;
+  };
+
+
+public:
+  struct Report {
+    u_int cubes;
+    u_int ticks;
+    u_int threads;
+
+    unsigned long long moves;
+    unsigned long long succeeded;
+    double grid_time;
+
+    // 線形探索は時間がかかるので1tickだけ
+    unsigned long long linear_moves;
+    double linear_time;
+
+    // 最後に自分の居場所を確保できているCubeの数(cubesと同じなら重なりなし)
+    u_int occupied;
+
+    bool isValid() const { return occupied == cubes; }
+  };
+
+
+  static Report run(const u_int cube_num, const u_int ticks, const u_int seed, const u_int threads) {
+    Report report = {};
+    report.cubes   = std::min(cube_num, u_int(WIDTH * ROWS / 2));
+    report.ticks   = ticks;
+    report.threads = std::max(threads, 1u);
+
+    OccupancyGrid grid(WIDTH, ROWS);
+    auto cubes = arrange(grid, report.cubes, seed);
+
+    {
+      // スレッドごとに受け持つCubeを分ける
+      std::vector<unsigned long long> succeeded(report.threads, 0);
+      std::vector<std::thread> workers;
+
+      ci::Timer timer(true);
+      for (u_int i = 0; i < report.threads; ++i) {
+        workers.emplace_back([&, i]() {
+            Random rand(seed, RANDOM_DEFAULT, i + 1);
+            for (u_int tick = 0; tick < ticks; ++tick) {
+              for (size_t c = i; c < cubes.size(); c += report.threads) {
+                auto& cube = cubes[c];
+                auto to = cube.pos + direction(rand.nextInt(4));
+                if (grid.move(cube.id, cube.pos, to)) {
+                  cube.pos = to;
+                  succeeded[i] += 1;
+                }
+              }
+            }
+          });
+      }
+      for (auto& worker : workers) {
+        worker.join();
+      }
+      report.grid_time = timer.getSeconds();
+
+      report.moves = (unsigned long long)cubes.size() * ticks;
+      for (auto num : succeeded) {
+        report.succeeded += num;
+      }
+    }
+
+    // TIPS:1つのマスには1つのidしか入らないので、全員が自分の居場所を確保できていれば重なりはない
+    for (const auto& cube : cubes) {
+      if (grid.occupant(cube.pos) == cube.id) report.occupied += 1;
+    }
+
+    {
+      // 以前の方法:全Cubeを調べてから書き戻す
+      Random rand(seed, RANDOM_DEFAULT, 0);
+
+      ci::Timer timer(true);
+      for (auto& cube : cubes) {
+        auto to = cube.pos + direction(rand.nextInt(4));
+        if ((to.x < 0) || (to.x >= WIDTH)) continue;
+
+        bool found = false;
+        for (const auto& other : cubes) {
+          if (other.id == cube.id) continue;
+          if ((other.pos.x == to.x) && (other.pos.z == to.z)) {
+            found = true;
+            break;
+          }
+        }
+        if (found) continue;
+
+        for (auto& other : cubes) {
+          if (other.id != cube.id) continue;
+          other.pos = to;
+          break;
+        }
+      }
+      report.linear_time  = timer.getSeconds();
+      report.linear_moves = cubes.size();
+    }
+
+    return report;
+  }
+
+  static void print(std::ostream& output, const Report& report) {
+    output << "cubes:" << report.cubes
+           << " ticks:" << report.ticks
+           << " threads:" << report.threads
+           << std::endl;
+
+    output << "grid moves:" << report.moves
+           << " succeeded:" << report.succeeded
+           << " time:" << report.grid_time * 1000.0 << "ms"
+           << " (" << nanoPerMove(report.grid_time, report.moves) << "ns/move)"
+           << std::endl;
+
+    output << "linear moves:" << report.linear_moves
+           << " time:" << report.linear_time * 1000.0 << "ms"
+           << " (" << nanoPerMove(report.linear_time, report.linear_moves) << "ns/move)"
+           << std::endl;
+
+    output << "overlap:" << (report.isValid() ? "OK" : "NG")
+           << " occupied:" << report.occupied
+           << std::endl;
+  }
+
+
+private:
+  // 重ならないように置く
+  static std::vector<Cube> arrange(OccupancyGrid& grid, const u_int cube_num, const u_int seed) {
+    Random rand(seed, RANDOM_STAGE_ENTRY, 0);
+
+    std::vector<Cube> cubes;
+    cubes.reserve(cube_num);
+    while (cubes.size() < cube_num) {
+      Cube cube = {
+        u_int(cubes.size() + 1),
+        ci::Vec3i(rand.nextInt(WIDTH), 0, rand.nextInt(ROWS))
+      };
+      if (grid.place(cube.id, cube.pos)) cubes.push_back(cube);
+    }
+    return cubes;
+  }
+
+  static ci::Vec3i direction(const int index) {
+    const ci::Vec3i table[] = {
+      ci::Vec3i( 0, 0,  1),
+      ci::Vec3i( 0, 0, -1),
+      ci::Vec3i( 1, 0,  0),
+      ci::Vec3i(-1, 0,  0),
+    };
+    return table[index];
+  }
+
+  static double nanoPerMove(const double time, const unsigned long long moves) {
+    return moves ? (time * 1000000000.0 / double(moves)) : 0.0;
+  }
+
+};
+
+}
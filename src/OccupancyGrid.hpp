@@ -0,0 +1,110 @@
+﻿#pragma once
+
+//
+// Cubeの居場所をブロック単位(x, z)で管理する
+// 移動先に他のCubeがいるかをO(1)で調べ、移動と同時に確保する
+//
+// zはStageと同じくリング状に使い回す(rowsはStageの表示範囲より長くしておくこと)
+// TIPS:各マスは比較交換で書き換えるので、複数のスレッドから同時に移動しても
+//      同じマスを2つのCubeが確保することはない
+//
+
+#include <atomic>
+#include <memory>
+#include "cinder/Vector.h"
+
+
+namespace ngs {
+
+class OccupancyGrid {
+  // 上位32bitにz、下位32bitにid(0は空き)
+  typedef unsigned long long Cell;
+
+  int width_;
+  int rows_;
+  std::unique_ptr<std::atomic<Cell>[]> cells_;
+
+
+  // TIPS:コピー不可
+  OccupancyGrid(const OccupancyGrid&) = delete;
+  OccupancyGrid& operator=(const OccupancyGrid&) = delete;
+
+
+public:
+  // rows:2のべき乗に切り上げる
+  OccupancyGrid(const int width, const int rows) :
+    width_(width),
+    rows_(1)
+  {
+    while (rows_ < rows) rows_ <<= 1;
+
+    cells_ = std::unique_ptr<std::atomic<Cell>[]>(new std::atomic<Cell>[width_ * rows_]);
+    clear();
+  }
+
+
+  void clear() {
+    for (int i = 0; i < (width_ * rows_); ++i) {
+      cells_[i].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  // そのマスにいるCubeのid(いなければ0)
+  u_int occupant(const ci::Vec3i& pos) const {
+    const auto* cell = find(pos);
+    if (!cell) return 0;
+
+    Cell value = cell->load(std::memory_order_acquire);
+    return (value && (zOf(value) == pos.z)) ? idOf(value) : 0;
+  }
+
+  // 空いていれば確保(すでに自分が確保していてもtrue)
+  bool place(const u_int id, const ci::Vec3i& pos) {
+    auto* cell = find(pos);
+    if (!cell) return false;
+
+    Cell desired  = pack(pos.z, id);
+    Cell expected = 0;
+    if (cell->compare_exchange_strong(expected, desired, std::memory_order_acq_rel)) return true;
+    return expected == desired;
+  }
+
+  // 移動先を確保してから移動元を空ける
+  // 移動先に他のCubeがいたら何もせずにfalse
+  bool move(const u_int id, const ci::Vec3i& from, const ci::Vec3i& to) {
+    if (!place(id, to)) return false;
+
+    remove(id, from);
+    return true;
+  }
+
+  // 自分が確保していれば空ける
+  void remove(const u_int id, const ci::Vec3i& pos) {
+    auto* cell = find(pos);
+    if (!cell) return;
+
+    Cell expected = pack(pos.z, id);
+    cell->compare_exchange_strong(expected, 0, std::memory_order_acq_rel);
+  }
+
+  int width() const { return width_; }
+  int rows() const { return rows_; }
+
+
+private:
+  static Cell pack(const int z, const u_int id) {
+    return (Cell(u_int(z)) << 32) | id;
+  }
+
+  static int zOf(const Cell value) { return int(u_int(value >> 32)); }
+  static u_int idOf(const Cell value) { return u_int(value); }
+
+  std::atomic<Cell>* find(const ci::Vec3i& pos) const {
+    if ((pos.x < 0) || (pos.x >= width_)) return nullptr;
+
+    return &cells_[(pos.z & (rows_ - 1)) * width_ + pos.x];
+  }
+
+};
+
+}
@@ -0,0 +1,314 @@
+﻿#pragma once
+
+//
+// 設定値(params.json)の起動用キャッシュ
+// 読み込んで確かめた設定値を、元のファイルのハッシュ値と一緒にバイナリで保存しておく
+// 次の起動で元のファイルが変わっていなければ、JSONの解析をせずにキャッシュから作る
+//
+// TIPS:ステージの形(stage.data)も設定値に含まれるので一緒に保存される
+//      キャッシュが古い・壊れている時はJSONから読む
+//
+
+#include <fstream>
+#include <iterator>
+#include <string>
+#include "cinder/Json.h"
+#include "BinaryStream.hpp"
+
+
+namespace ngs {
+
+class ParamsCache {
+  enum {
+    CACHE_ID      = 0x5053474e,     // 'NGSP'
+    CACHE_VERSION = 1
+  };
+
+  // 節の種類
+  enum {
+    TYPE_OBJECT,
+    TYPE_ARRAY,
+    TYPE_BOOL,
+    TYPE_INT,
+    TYPE_UINT,
+    TYPE_DOUBLE,
+    TYPE_STRING,
+    TYPE_NULL
+  };
+
+
+public:
+  enum Result {
+    // キャッシュから読めた
+    CACHE_HIT,
+    // JSONから読み、キャッシュを作り直した
+    CACHE_REBUILT,
+    // JSONから読んだが、設定値が足りないのでキャッシュを作らなかった
+    CACHE_INVALID,
+    // 元のファイルが読めない
+    SOURCE_ERROR
+  };
+
+
+  // source_pathの設定値をparamsへ読み込む
+  static Result load(ci::JsonTree& params, const std::string& source_path, const std::string& cache_path) {
+    std::string text;
+    if (!readText(source_path, text)) return SOURCE_ERROR;
+
+    u_int hash = hashText(text);
+    if (readCache(params, cache_path, hash, u_int(text.size()))) return CACHE_HIT;
+
+    try {
+      params = ci::JsonTree(text);
+    }
+    catch (const std::exception& exception) {
+      DOUT << "Can't parse params:" << exception.what() << std::endl;
+      return SOURCE_ERROR;
+    }
+    if (!validate(params)) return CACHE_INVALID;
+
+    writeCache(params, cache_path, hash, u_int(text.size()));
+    return CACHE_REBUILT;
+  }
+
+  static const char* resultName(const Result result) {
+    switch (result) {
+    case CACHE_HIT:     return "cache";
+    case CACHE_REBUILT: return "json(cache rebuilt)";
+    case CACHE_INVALID: return "json(invalid)";
+    case SOURCE_ERROR:  return "error";
+    }
+    return "";
+  }
+
+
+  // 起動に必要な値がそろっているか
+  static bool validate(const ci::JsonTree& params) {
+    const char* keys[] = {
+      "app.width",
+      "app.height",
+      "app.tickRate",
+      "app.maxTicksPerFrame",
+      "cube.size",
+      "stage.width",
+      "stage.occupancyRows",
+      "stage.start",
+      "stage.goal",
+      "stage.finalGoal",
+      "stage.data",
+    };
+    for (const auto* key : keys) {
+      if (!params.hasChild(key)) {
+        DOUT << "params:" << key << " not found." << std::endl;
+        return false;
+      }
+    }
+
+    const auto& stages = params["stage.data"];
+    if (stages.getNumChildren() == 0) {
+      DOUT << "params:stage.data is empty." << std::endl;
+      return false;
+    }
+    for (const auto& stage : stages) {
+      if (!stage.hasChild("body") || !stage.hasChild("collapseSpeed") || !stage.hasChild("buildSpeed")) {
+        DOUT << "params:stage.data lacks body, collapseSpeed or buildSpeed." << std::endl;
+        return false;
+      }
+    }
+    return true;
+  }
+
+
+private:
+  static bool readText(const std::string& path, std::string& text) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+
+    text.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+  }
+
+  // FNV-1a
+  static u_int hashText(const std::string& text) {
+    u_int value = 2166136261u;
+    for (auto byte : text) {
+      value = (value ^ u_char(byte)) * 16777619u;
+    }
+    return value;
+  }
+
+
+  static bool readCache(ci::JsonTree& params, const std::string& path,
+                        const u_int hash, const u_int size) {
+    BinaryReader reader;
+    if (!reader.read(path)) return false;
+
+    u_int id;
+    u_int version;
+    u_int source_hash;
+    u_int source_size;
+    if (!reader.get(id) || !reader.get(version)
+        || !reader.get(source_hash) || !reader.get(source_size)) return false;
+    if ((id != CACHE_ID) || (version != CACHE_VERSION)) return false;
+    if ((source_hash != hash) || (source_size != size)) return false;
+
+    ci::JsonTree tree;
+    if (!readNode(reader, tree, "") || !reader.eof()) return false;
+
+    params = tree;
+    return true;
+  }
+
+  static void writeCache(const ci::JsonTree& params, const std::string& path,
+                         const u_int hash, const u_int size) {
+    BinaryWriter writer;
+    writer.put(u_int(CACHE_ID));
+    writer.put(u_int(CACHE_VERSION));
+    writer.put(hash);
+    writer.put(size);
+    writeNode(writer, params);
+
+    // TIPS:書けなくても次回JSONから読むだけ
+    if (!writer.write(path)) {
+      DOUT << "Can't write params cache:" << path << std::endl;
+    }
+  }
+
+
+  static void writeNode(BinaryWriter& writer, const ci::JsonTree& node) {
+    switch (node.getNodeType()) {
+    case ci::JsonTree::NODE_OBJECT:
+    case ci::JsonTree::NODE_ARRAY:
+      {
+        bool object = node.getNodeType() == ci::JsonTree::NODE_OBJECT;
+        writer.put(u_char(object ? TYPE_OBJECT : TYPE_ARRAY));
+        writer.put(u_int(node.getNumChildren()));
+        for (const auto& child : node) {
+          if (object) writer.put(child.getKey());
+          writeNode(writer, child);
+        }
+      }
+      break;
+
+    case ci::JsonTree::NODE_VALUE:
+      switch (node.getValueType()) {
+      case ci::JsonTree::VALUE_BOOL:
+        writer.put(u_char(TYPE_BOOL));
+        writer.put(u_char(node.getValue<bool>()));
+        break;
+
+      case ci::JsonTree::VALUE_INT:
+        writer.put(u_char(TYPE_INT));
+        writer.put(node.getValue<int>());
+        break;
+
+      case ci::JsonTree::VALUE_UINT:
+        writer.put(u_char(TYPE_UINT));
+        writer.put(node.getValue<u_int>());
+        break;
+
+      case ci::JsonTree::VALUE_DOUBLE:
+        writer.put(u_char(TYPE_DOUBLE));
+        writer.put(node.getValue<double>());
+        break;
+
+      default:
+        writer.put(u_char(TYPE_STRING));
+        writer.put(node.getValue<std::string>());
+        break;
+      }
+      break;
+
+    default:
+      writer.put(u_char(TYPE_NULL));
+      break;
+    }
+  }
+
+  static bool readNode(BinaryReader& reader, ci::JsonTree& node, const std::string& key) {
+    u_char type;
+    if (!reader.get(type)) return false;
+
+    switch (type) {
+    case TYPE_OBJECT:
+    case TYPE_ARRAY:
+      {
+        node = (type == TYPE_OBJECT) ? ci::JsonTree::makeObject(key)
+                                     : ci::JsonTree::makeArray(key);
+        u_int num;
+        if (!reader.get(num)) return false;
+        for (u_int i = 0; i < num; ++i) {
+          std::string child_key;
+          if ((type == TYPE_OBJECT) && !reader.get(child_key)) return false;
+
+          ci::JsonTree child;
+          if (!readNode(reader, child, child_key)) return false;
+          node.pushBack(child);
+        }
+      }
+      return true;
+
+    case TYPE_BOOL:
+      {
+        u_char value;
+        if (!reader.get(value)) return false;
+        node = ci::JsonTree(key, bool(value != 0));
+      }
+      return true;
+
+    case TYPE_INT:
+      {
+        int value;
+        if (!reader.get(value)) return false;
+        node = ci::JsonTree(key, value);
+      }
+      return true;
+
+    case TYPE_UINT:
+      {
+        u_int value;
+        if (!reader.get(value)) return false;
+        node = ci::JsonTree(key, value);
+      }
+      return true;
+
+    case TYPE_DOUBLE:
+      {
+        double value;
+        if (!reader.get(value)) return false;
+        node = ci::JsonTree(key, value);
+      }
+      return true;
+
+    case TYPE_STRING:
+      {
+        std::string value;
+        if (!reader.get(value)) return false;
+        node = ci::JsonTree(key, value);
+      }
+      return true;
+
+    case TYPE_NULL:
+      node = nullNode(key);
+      return true;
+    }
+    return false;
+  }
+
+  // keyを持ったnull
+  // TIPS:JsonTreeにはkeyとnullを指定して作る方法が無いので、1要素のobjectを読ませて取り出す
+  static ci::JsonTree nullNode(const std::string& key) {
+    std::string text = "{\"";
+    for (auto c : key) {
+      if ((c == '"') || (c == '\\')) text += '\\';
+      text += c;
+    }
+    text += "\":null}";
+
+    ci::JsonTree object(text);
+    return object.getChild(0);
+  }
+
+};
+
+}
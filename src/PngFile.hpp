@@ -0,0 +1,199 @@
+﻿#pragma once
+
+//
+// PNGの読み書き
+// 外部ライブラリを使わずに書き出せるよう、無圧縮のdeflateで保存する
+// 読み込みは、ここで書き出した形式(RGBA8、無圧縮、filterなし)だけ対応
+//
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+
+namespace ngs {
+
+namespace Png {
+
+struct Image {
+  int width;
+  int height;
+  // RGBA8、上の行から
+  std::vector<u_char> pixels;
+};
+
+
+inline u_int crc32(const u_char* data, const size_t size, u_int crc = 0) {
+  static u_int table[256];
+  static bool initialized = false;
+  if (!initialized) {
+    for (u_int n = 0; n < 256; ++n) {
+      u_int c = n;
+      for (int k = 0; k < 8; ++k) {
+        c = (c & 1) ? (0xedb88320u ^ (c >> 1)) : (c >> 1);
+      }
+      table[n] = c;
+    }
+    initialized = true;
+  }
+
+  crc = ~crc;
+  for (size_t i = 0; i < size; ++i) {
+    crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+inline void putU32(std::vector<u_char>& out, const u_int value) {
+  out.push_back(u_char(value >> 24));
+  out.push_back(u_char(value >> 16));
+  out.push_back(u_char(value >> 8));
+  out.push_back(u_char(value));
+}
+
+inline u_int getU32(const u_char* p) {
+  return (u_int(p[0]) << 24) | (u_int(p[1]) << 16) | (u_int(p[2]) << 8) | u_int(p[3]);
+}
+
+inline void putChunk(std::vector<u_char>& out, const char* type, const std::vector<u_char>& data) {
+  putU32(out, u_int(data.size()));
+
+  size_t start = out.size();
+  out.insert(std::end(out), type, type + 4);
+  out.insert(std::end(out), std::begin(data), std::end(data));
+
+  putU32(out, crc32(&out[start], out.size() - start));
+}
+
+
+inline bool write(const std::string& path, const Image& image) {
+  // 各行の先頭にfilter(0:なし)を付ける
+  size_t row_size = image.width * 4;
+  std::vector<u_char> raw;
+  raw.reserve((row_size + 1) * image.height);
+  for (int y = 0; y < image.height; ++y) {
+    raw.push_back(0);
+    const auto* row = &image.pixels[y * row_size];
+    raw.insert(std::end(raw), row, row + row_size);
+  }
+
+  // zlib(無圧縮ブロック)
+  std::vector<u_char> zlib = { 0x78, 0x01 };
+  size_t offset = 0;
+  do {
+    size_t size = std::min(raw.size() - offset, size_t(0xffff));
+    bool final_block = (offset + size) == raw.size();
+    zlib.push_back(final_block ? 1 : 0);
+    zlib.push_back(u_char(size));
+    zlib.push_back(u_char(size >> 8));
+    zlib.push_back(u_char(~size));
+    zlib.push_back(u_char(~size >> 8));
+    zlib.insert(std::end(zlib), std::begin(raw) + offset, std::begin(raw) + offset + size);
+    offset += size;
+  } while (offset < raw.size());
+
+  u_int a = 1;
+  u_int b = 0;
+  for (auto value : raw) {
+    a = (a + value) % 65521;
+    b = (b + a) % 65521;
+  }
+  putU32(zlib, (b << 16) | a);
+
+  std::vector<u_char> header;
+  putU32(header, image.width);
+  putU32(header, image.height);
+  header.push_back(8);            // bit depth
+  header.push_back(6);            // RGBA
+  header.push_back(0);
+  header.push_back(0);
+  header.push_back(0);
+
+  std::vector<u_char> out = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+  putChunk(out, "IHDR", header);
+  putChunk(out, "IDAT", zlib);
+  putChunk(out, "IEND", std::vector<u_char>());
+
+  std::ofstream file(path, std::ios::binary);
+  if (!file) return false;
+  file.write(reinterpret_cast<const char*>(&out[0]), out.size());
+  return bool(file);
+}
+
+inline bool read(const std::string& path, Image& image) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) return false;
+  std::vector<u_char> data((std::istreambuf_iterator<char>(file)),
+                           std::istreambuf_iterator<char>());
+  if (data.size() < 8) return false;
+
+  std::vector<u_char> zlib;
+  size_t offset = 8;
+  while ((offset + 12) <= data.size()) {
+    u_int size = getU32(&data[offset]);
+    std::string type(data.begin() + offset + 4, data.begin() + offset + 8);
+    if ((offset + 12 + size) > data.size()) return false;
+    const auto* body = &data[offset + 8];
+
+    if (type == "IHDR") {
+      image.width  = getU32(body);
+      image.height = getU32(body + 4);
+      if ((body[8] != 8) || (body[9] != 6)) return false;
+    }
+    else if (type == "IDAT") {
+      zlib.insert(std::end(zlib), body, body + size);
+    }
+    offset += 12 + size;
+  }
+
+  // 無圧縮ブロックだけを展開
+  std::vector<u_char> raw;
+  offset = 2;
+  bool final_block = false;
+  while (!final_block && ((offset + 5) <= zlib.size())) {
+    final_block = zlib[offset] & 1;
+    if (zlib[offset] & 6) return false;
+    size_t size = zlib[offset + 1] | (zlib[offset + 2] << 8);
+    offset += 5;
+    if ((offset + size) > zlib.size()) return false;
+    raw.insert(std::end(raw), zlib.begin() + offset, zlib.begin() + offset + size);
+    offset += size;
+  }
+
+  size_t row_size = image.width * 4;
+  if (raw.size() != (row_size + 1) * image.height) return false;
+
+  image.pixels.resize(row_size * image.height);
+  for (int y = 0; y < image.height; ++y) {
+    const auto* row = &raw[y * (row_size + 1)];
+    if (row[0] != 0) return false;
+    std::copy(row + 1, row + 1 + row_size, &image.pixels[y * row_size]);
+  }
+  return true;
+}
+
+
+// 差がthresholdを超えた画素数を返す(大きさが違う場合は全画素)
+inline size_t compare(const Image& lhs, const Image& rhs, const int threshold) {
+  if ((lhs.width != rhs.width) || (lhs.height != rhs.height)) {
+    return std::max(lhs.width * lhs.height, rhs.width * rhs.height);
+  }
+
+  size_t count = 0;
+  for (size_t i = 0; i < lhs.pixels.size(); i += 4) {
+    for (size_t c = 0; c < 4; ++c) {
+      if (std::abs(int(lhs.pixels[i + c]) - int(rhs.pixels[i + c])) > threshold) {
+        count += 1;
+        break;
+      }
+    }
+  }
+  return count;
+}
+
+}
+
+}
@@ -0,0 +1,39 @@
+﻿#pragma once
+
+//
+// 描画補間用の姿勢
+// 直前のtickと現在のtickの姿勢を補間して描画する
+//
+
+#include "cinder/Vector.h"
+#include "cinder/Quaternion.h"
+#include "cinder/Matrix.h"
+
+
+namespace ngs {
+
+struct Pose {
+  // 中心位置
+  ci::Vec3f pos;
+  ci::Quatf rot;
+
+
+  // rate:0.0 -> from, 1.0 -> to
+  static Pose interpolate(const Pose& from, const Pose& to, const float rate) {
+    Pose pose = {
+      from.pos.lerp(rate, to.pos),
+      from.rot.slerp(rate, to.rot)
+    };
+    return pose;
+  }
+
+  // 単位立方体の変換行列
+  ci::Matrix44f transform(const float size) const {
+    ci::Matrix44f matrix = ci::Matrix44f::createTranslation(pos);
+    matrix *= rot.toMatrix44();
+    matrix *= ci::Matrix44f::createScale(ci::Vec3f(size, size, size));
+    return matrix;
+  }
+};
+
+}
@@ -0,0 +1,171 @@
+﻿#pragma once
+
+//
+// 乱数(Philox4x32-10 カウンタ方式)
+// n番目の値を(種, 系統, 番号, n)だけから計算するので、
+//   ・系統(Stage、敵…)や番号(Entityのid)ごとに独立した乱数列になり、
+//     他の系統で乱数を使う順番や回数が変わっても影響を受けない
+//   ・状態はカウンタだけなので、保存・復元が簡単
+//   ・まとめて生成する時(fill)は各値が独立に計算でき、ベクトル化できる
+//
+
+#include <cstddef>
+#include "BinaryStream.hpp"
+
+
+namespace ngs {
+
+// 乱数列の系統
+// TIPS:保存したデータの互換性のため、途中に追加しない
+enum RandomStream {
+  RANDOM_DEFAULT,
+
+  // Stageの崩壊時の落下速度
+  RANDOM_STAGE_COLLAPSE,
+  // Stage生成時の登場位置
+  RANDOM_STAGE_ENTRY,
+  // 敵の移動(Entityのidごと)
+  RANDOM_ENEMY,
+  // 自動操作(操作する人ごと)
+  RANDOM_BOT,
+};
+
+
+class Random {
+  u_int key_[2];
+  // 系統と番号(カウンタの上位)
+  u_int stream_[2];
+  // 何番目の値か
+  unsigned long long counter_;
+
+  // 最後に計算したblock(4つの値)
+  // TIPS:1つずつ取り出す時に、同じblockを何度も計算しないよう取っておく
+  //      カウンタから作り直せるので保存しない
+  u_int cache_[4];
+  unsigned long long cache_block_;
+
+
+public:
+  explicit Random(const u_int seed = 0, const u_int stream = RANDOM_DEFAULT, const u_int index = 0) {
+    this->seed(seed, stream, index);
+  }
+
+
+  void seed(const u_int seed, const u_int stream = RANDOM_DEFAULT, const u_int index = 0) {
+    key_[0]    = seed;
+    key_[1]    = 0x6e67734b;
+    stream_[0] = index;
+    stream_[1] = stream;
+    counter_   = 0;
+    cache_block_ = NO_BLOCK();
+  }
+
+  u_int nextUint() {
+    unsigned long long block = counter_ >> 2;
+    if (block != cache_block_) {
+      generate(block, cache_);
+      cache_block_ = block;
+    }
+    u_int value = cache_[counter_ & 3];
+    counter_ += 1;
+    return value;
+  }
+
+  // [0, 1)
+  float nextFloat() {
+    return toFloat(nextUint());
+  }
+
+  // [0, value)
+  int nextInt(const int value) {
+    return int((static_cast<unsigned long long>(nextUint()) * u_int(value)) >> 32);
+  }
+
+  // [0, 1)の値をまとめて生成
+  // nextFloatをnum回呼んだのと同じ値になる
+  void fill(float* values, const size_t num) {
+    size_t i = 0;
+    // 4つ単位の区切りまでは1つずつ
+    while ((i < num) && (counter_ & 3)) {
+      values[i++] = nextFloat();
+    }
+
+    // TIPS:各blockは独立に計算できるので、コンパイラがベクトル化できる
+    size_t block_num = (num - i) / 4;
+    unsigned long long first = counter_ >> 2;
+    float* out = values + i;
+    for (size_t b = 0; b < block_num; ++b) {
+      u_int block[4];
+      generate(first + b, block);
+      out[b * 4 + 0] = toFloat(block[0]);
+      out[b * 4 + 1] = toFloat(block[1]);
+      out[b * 4 + 2] = toFloat(block[2]);
+      out[b * 4 + 3] = toFloat(block[3]);
+    }
+    counter_ += block_num * 4;
+    i += block_num * 4;
+
+    while (i < num) {
+      values[i++] = nextFloat();
+    }
+  }
+
+
+  template <typename Self, typename Stream>
+  static void transfer(Self& self, Stream& stream) {
+    stream & self.key_ & self.stream_ & self.counter_;
+  }
+
+  void save(BinaryWriter& writer) const { transfer(*this, writer); }
+  void load(BinaryReader& reader) {
+    transfer(*this, reader);
+    cache_block_ = NO_BLOCK();
+  }
+
+
+private:
+  // blockの番号はカウンタの上位62bitなので、この値にはならない
+  static unsigned long long NO_BLOCK() { return ~0ull; }
+
+  static float toFloat(const u_int value) {
+    return (value >> 8) * (1.0f / 16777216.0f);
+  }
+
+  static void mulhilo(const u_int a, const u_int b, u_int& hi, u_int& lo) {
+    unsigned long long product = static_cast<unsigned long long>(a) * b;
+    hi = u_int(product >> 32);
+    lo = u_int(product);
+  }
+
+  // カウンタ(block番号, 番号, 系統)から4つの値を作る
+  void generate(const unsigned long long block, u_int out[4]) const {
+    u_int c0 = u_int(block);
+    u_int c1 = u_int(block >> 32);
+    u_int c2 = stream_[0];
+    u_int c3 = stream_[1];
+    u_int k0 = key_[0];
+    u_int k1 = key_[1];
+
+    for (int round = 0; round < 10; ++round) {
+      u_int hi0, lo0, hi1, lo1;
+      mulhilo(0xD2511F53u, c0, hi0, lo0);
+      mulhilo(0xCD9E8D57u, c2, hi1, lo1);
+
+      c0 = hi1 ^ c1 ^ k0;
+      c1 = lo1;
+      c2 = hi0 ^ c3 ^ k1;
+      c3 = lo0;
+
+      k0 += 0x9E3779B9u;
+      k1 += 0xBB67AE85u;
+    }
+
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+  }
+
+};
+
+}
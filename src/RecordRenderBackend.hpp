@@ -0,0 +1,128 @@
+﻿#pragma once
+
+//
+// 描画コマンドを記録するだけのBackend
+// GPUの無い環境での検証や計測に使う
+//
+
+#include <vector>
+#include "RenderBackend.hpp"
+
+
+namespace ngs {
+
+class RecordRenderBackend : public RenderBackend {
+public:
+  enum Type {
+    BEGIN,
+    STATE,
+    DRAW_CUBES,
+    DRAW_MESH,
+    END
+  };
+
+  struct Record {
+    int type;
+    // STATEは描画状態、DRAW_CUBESとDRAW_MESHはmaterial
+    int value;
+    // DRAW_CUBESは記録したコマンドの範囲、DRAW_MESHは記録した頂点の範囲
+    size_t first;
+    size_t num;
+  };
+
+
+private:
+  std::vector<Record> records_;
+  std::vector<RenderQueue::Command> commands_;
+  CubeMesh mesh_;
+
+  ci::CameraPersp camera_;
+
+
+public:
+  RecordRenderBackend() = default;
+
+
+  void begin(const RenderQueue& queue) override {
+    RenderBackend::begin(queue);
+
+    records_.clear();
+    commands_.clear();
+    mesh_.clear();
+    camera_ = queue.camera();
+
+    Record record = { BEGIN, 0, 0, 0 };
+    records_.push_back(record);
+  }
+
+  void state(const int state) override {
+    RenderBackend::state(state);
+
+    Record record = { STATE, state, 0, 0 };
+    records_.push_back(record);
+  }
+
+  void drawCubes(const int material,
+                 const RenderQueue::Command* commands, const size_t num) override {
+    RenderBackend::drawCubes(material, commands, num);
+
+    Record record = { DRAW_CUBES, material, commands_.size(), num };
+    records_.push_back(record);
+    commands_.insert(std::end(commands_), commands, commands + num);
+  }
+
+  void drawMesh(const int material, const CubeMesh& mesh) override {
+    RenderBackend::drawMesh(material, mesh);
+
+    Record record = { DRAW_MESH, material, mesh_.vertexNum(), mesh.vertexNum() };
+    records_.push_back(record);
+    mesh_.vertices.insert(std::end(mesh_.vertices), std::begin(mesh.vertices), std::end(mesh.vertices));
+    mesh_.normals.insert(std::end(mesh_.normals), std::begin(mesh.normals), std::end(mesh.normals));
+    mesh_.colors.insert(std::end(mesh_.colors), std::begin(mesh.colors), std::end(mesh.colors));
+  }
+
+  void end() override {
+    Record record = { END, 0, 0, 0 };
+    records_.push_back(record);
+
+    RenderBackend::end();
+  }
+
+
+  const std::vector<Record>& records() const { return records_; }
+  const std::vector<RenderQueue::Command>& commands() const { return commands_; }
+  // DRAW_MESHで記録した頂点
+  const CubeMesh& mesh() const { return mesh_; }
+  const ci::CameraPersp& camera() const { return camera_; }
+
+  // 記録内容のhash値(FNV-1a)
+  // 描画結果の差分チェックに使う
+  u_int hash() const {
+    u_int value = 2166136261u;
+    auto mix = [&value](const void* data, const size_t size) {
+      const auto* p = static_cast<const u_char*>(data);
+      for (size_t i = 0; i < size; ++i) {
+        value = (value ^ p[i]) * 16777619u;
+      }
+    };
+
+    for (const auto& record : records_) {
+      mix(&record.type, sizeof(record.type));
+      mix(&record.value, sizeof(record.value));
+      mix(&record.num, sizeof(record.num));
+    }
+    for (const auto& command : commands_) {
+      mix(&command.key, sizeof(command.key));
+      mix(&command.transform, sizeof(command.transform));
+      mix(&command.color, sizeof(command.color));
+    }
+    if (!mesh_.empty()) {
+      mix(&mesh_.vertices[0], sizeof(ci::Vec3f) * mesh_.vertexNum());
+      mix(&mesh_.colors[0], sizeof(ci::ColorA) * mesh_.vertexNum());
+    }
+    return value;
+  }
+
+};
+
+}
@@ -0,0 +1,110 @@
+﻿#pragma once
+
+//
+// 描画の実装部
+// RenderQueueから並べ替え済みのコマンドを受け取る
+//
+
+#include "cinder/Timer.h"
+#include "RenderQueue.hpp"
+
+
+namespace ngs {
+
+class RenderBackend {
+public:
+  // 1フレームの描画統計
+  struct Stats {
+    u_int  draw_calls;
+    u_int  state_changes;
+    u_int  cubes;
+    u_int  mesh_vertices;
+    double submit_time;
+  };
+
+
+protected:
+  Stats stats_;
+  ci::Timer timer_;
+
+
+public:
+  RenderBackend() :
+    stats_()
+  { }
+
+  virtual ~RenderBackend() = default;
+
+
+  // 描画開始(カメラと光源の設定)
+  virtual void begin(const RenderQueue& queue) {
+    stats_ = Stats();
+    timer_.start();
+  }
+
+  // 描画状態の切り替え
+  virtual void state(const int state) {
+    stats_.state_changes += 1;
+  }
+
+  // 同じ描画状態とmaterialの立方体をまとめて描画
+  virtual void drawCubes(const int material,
+                         const RenderQueue::Command* commands, const size_t num) {
+    stats_.draw_calls += 1;
+    stats_.cubes      += u_int(num);
+  }
+
+  // 結合済みのメッシュを描画
+  virtual void drawMesh(const int material, const CubeMesh& mesh) {
+    stats_.draw_calls    += 1;
+    stats_.mesh_vertices += u_int(mesh.vertexNum());
+  }
+
+  virtual void end() {
+    timer_.stop();
+    stats_.submit_time = timer_.getSeconds();
+  }
+
+
+  const Stats& stats() const { return stats_; }
+
+
+  // 並べ替えてから描画
+  void render(RenderQueue& queue) {
+    queue.sort();
+
+    begin(queue);
+
+    const auto& commands = queue.commands();
+    int current_state = -1;
+    auto it = std::begin(commands);
+    while (it != std::end(commands)) {
+      // 同じキーが続く範囲をまとめて描画
+      const u_int key = it->key;
+      auto last = std::find_if(it, std::end(commands),
+                               [key](const RenderQueue::Command& command) {
+                                 return command.key != key;
+                               });
+
+      if (it->state() != current_state) {
+        current_state = it->state();
+        state(current_state);
+      }
+      if (it->type() == RenderQueue::TYPE_MESH) {
+        for (; it != last; ++it) {
+          drawMesh(it->material(), *it->mesh);
+        }
+      }
+      else {
+        drawCubes(it->material(), &(*it), size_t(std::distance(it, last)));
+      }
+
+      it = last;
+    }
+
+    end();
+  }
+
+};
+
+}
@@ -0,0 +1,289 @@
+﻿#pragma once
+
+//
+// 描画コマンドの収集
+// Entityは描画内容をListに登録するだけで、描画そのものはRenderBackendが行う
+// 複数のListをまとめ、描画状態とmaterialで並べ替えてからRenderBackendへ流し込む
+//
+
+#include <algorithm>
+#include <vector>
+#include "cinder/Camera.h"
+#include "cinder/Matrix.h"
+#include "cinder/Frustum.h"
+#include "cinder/Sphere.h"
+#include "CubeMesh.hpp"
+
+
+namespace ngs {
+
+class RenderQueue {
+public:
+  // 描画状態(値の小さい順に描画)
+  enum State {
+    // 光源あり、深度テストあり、裏面カリング
+    STATE_LIT,
+
+    STATE_NUM
+  };
+
+  enum Material {
+    // glColorMaterialで色を決める
+    MATERIAL_COLOR,
+
+    MATERIAL_NUM
+  };
+
+  enum Type {
+    // 単位立方体を変換して描画
+    TYPE_CUBE,
+    // 結合済みのメッシュをそのまま描画
+    TYPE_MESH
+  };
+
+  struct Command {
+    // 並べ替えのキー(上位から描画状態、material、種類)
+    u_int key;
+
+    // TYPE_CUBE:単位立方体の変換行列と色
+    ci::Matrix44f transform;
+    ci::ColorA color;
+
+    // TYPE_MESH:描画するメッシュ
+    const CubeMesh* mesh;
+
+    int state() const { return key >> 16; }
+    int material() const { return (key & 0xffff) >> 1; }
+    int type() const { return key & 1; }
+  };
+
+  // 視錐台カリングの結果
+  struct Stats {
+    u_int visible;
+    u_int culled;
+  };
+
+  // 点光源
+  struct Light {
+    ci::Vec3f pos;
+
+    float constant_attenuation;
+    float linear_attenuation;
+    float quadratic_attenuation;
+
+    ci::Color diffuse;
+    ci::Color ambient;
+    ci::Color specular;
+  };
+
+
+  static u_int makeKey(const int state, const int material, const int type) {
+    return (u_int(state) << 16) | (u_int(material) << 1) | u_int(type);
+  }
+
+
+  // 描画内容の登録先
+  // TIPS:スレッドごとに別のListへ登録すればロック不要
+  class List {
+    const ci::Frustumf* frustum_;
+    float interpolation_;
+
+    std::vector<Command> commands_;
+    Stats stats_;
+
+    bool  has_light_;
+    Light light_;
+
+
+  public:
+    List() :
+      frustum_(nullptr),
+      interpolation_(1.0f),
+      stats_(),
+      has_light_(false)
+    { }
+
+
+    void clear(const ci::Frustumf& frustum, const float interpolation) {
+      frustum_ = &frustum;
+      interpolation_ = interpolation;
+      commands_.clear();
+      stats_ = Stats();
+      has_light_ = false;
+    }
+
+    const ci::Frustumf& frustum() const { return *frustum_; }
+
+    // 直前のtickから現在のtickまでの補間率
+    float interpolation() const { return interpolation_; }
+
+    // 視錐台に入っているか判定して、その結果を数える
+    bool isVisible(const ci::Sphere& sphere) {
+      if (frustum_->intersects(sphere)) {
+        stats_.visible += 1;
+        return true;
+      }
+
+      stats_.culled += 1;
+      return false;
+    }
+
+    bool isVisible(const ci::AxisAlignedBox3f& bounds) {
+      if (frustum_->intersects(bounds)) {
+        stats_.visible += 1;
+        return true;
+      }
+
+      stats_.culled += 1;
+      return false;
+    }
+
+    // まとめて判定した結果を数える
+    void visible(const u_int num) { stats_.visible += num; }
+    void culled(const u_int num) { stats_.culled += num; }
+
+    const Stats& stats() const { return stats_; }
+
+    void light(const Light& light) {
+      light_     = light;
+      has_light_ = true;
+    }
+    bool hasLight() const { return has_light_; }
+    const Light& light() const { return light_; }
+
+
+    // 単位立方体を変換して描画
+    void add(const State state, const Material material,
+             const ci::Matrix44f& transform, const ci::Color& color) {
+      Command command = {
+        makeKey(state, material, TYPE_CUBE),
+        transform,
+        ci::ColorA(color),
+        nullptr
+      };
+      commands_.push_back(command);
+    }
+
+    // 回転しない立方体
+    void add(const State state, const Material material,
+             const ci::Vec3f& center, const float size, const ci::Color& color) {
+      ci::Matrix44f transform = ci::Matrix44f::createTranslation(center)
+                              * ci::Matrix44f::createScale(ci::Vec3f(size, size, size));
+      add(state, material, transform, color);
+    }
+
+    // TIPS:meshはrender終了まで保持しておくこと
+    void add(const State state, const Material material, const CubeMesh& mesh) {
+      Command command = {
+        makeKey(state, material, TYPE_MESH),
+        ci::Matrix44f(),
+        ci::ColorA(),
+        &mesh
+      };
+      commands_.push_back(command);
+    }
+
+    const std::vector<Command>& commands() const { return commands_; }
+    
+  };
+
+
+private:
+  std::vector<Command> commands_;
+
+  std::vector<List> lists_;
+  size_t list_num_;
+
+  ci::CameraPersp camera_;
+  ci::Frustumf frustum_;
+  float interpolation_;
+
+  Stats stats_;
+
+  bool  has_light_;
+  Light light_;
+
+
+  // TIPS:コピー不可
+  RenderQueue(const RenderQueue&) = delete;
+  RenderQueue& operator=(const RenderQueue&) = delete;
+
+
+public:
+  RenderQueue() :
+    list_num_(0),
+    interpolation_(1.0f),
+    stats_(),
+    has_light_(false)
+  { }
+
+
+  // フレームの開始
+  // interpolation:直前のtickから現在のtickまでの補間率
+  void begin(const ci::CameraPersp& camera, const float interpolation = 1.0f) {
+    camera_  = camera;
+    frustum_ = ci::Frustumf(camera_);
+    interpolation_ = interpolation;
+
+    commands_.clear();
+    list_num_  = 0;
+    stats_     = Stats();
+    has_light_ = false;
+  }
+
+  // 登録先をnum個用意する(前のフレームのものを使い回す)
+  List* lists(const size_t num) {
+    if (lists_.size() < num) lists_.resize(num);
+    for (size_t i = 0; i < num; ++i) {
+      lists_[i].clear(frustum_, interpolation_);
+    }
+    list_num_ = num;
+
+    return lists_.empty() ? nullptr : &lists_[0];
+  }
+
+  // Listの内容を順番に結合
+  void merge() {
+    size_t num = 0;
+    for (size_t i = 0; i < list_num_; ++i) {
+      num += lists_[i].commands().size();
+    }
+    commands_.reserve(num);
+
+    for (size_t i = 0; i < list_num_; ++i) {
+      const auto& list = lists_[i];
+      commands_.insert(std::end(commands_), std::begin(list.commands()), std::end(list.commands()));
+
+      stats_.visible += list.stats().visible;
+      stats_.culled  += list.stats().culled;
+
+      if (list.hasLight()) {
+        light_     = list.light();
+        has_light_ = true;
+      }
+    }
+  }
+
+
+  const ci::CameraPersp& camera() const { return camera_; }
+  const ci::Frustumf& frustum() const { return frustum_; }
+
+  const Stats& stats() const { return stats_; }
+
+  bool hasLight() const { return has_light_; }
+  const Light& light() const { return light_; }
+
+  const std::vector<Command>& commands() const { return commands_; }
+
+  
+  void sort() {
+    // TIPS:同じキーの中では登録順を保つ
+    std::stable_sort(std::begin(commands_), std::end(commands_),
+                     [](const Command& lhs, const Command& rhs) {
+                       return lhs.key < rhs.key;
+                     });
+  }
+
+};
+
+}
@@ -0,0 +1,476 @@
+﻿#pragma once
+
+//
+// 入力だけを送り合う2人プレイ(ロールバック方式)
+// 相手の入力は届くまで「入力なし」と予測して進め、予測と違う入力が届いたら
+// その時点のスナップショットまで巻き戻して、今のtickまで計算し直す
+//
+// LoopbackTransportで1つのプロセスの中の2つのGameをつなぎ、
+// 遅延と欠落を人工的に与えて検証する
+//
+// TIPS:送るのは1tickごとの方向キーの入力(4bit)だけ
+//
+
+#include <algorithm>
+#include <cassert>
+#include <deque>
+#include <limits>
+#include <ostream>
+#include <vector>
+#include "cinder/app/KeyEvent.h"
+#include "cinder/Json.h"
+#include "cinder/Timer.h"
+#include "Touch.hpp"
+#include "Game.hpp"
+#include "Random.hpp"
+#include "BinaryStream.hpp"
+
+
+namespace ngs {
+
+// 1tick分の入力
+enum {
+  INPUT_UP    = 1 << 0,
+  INPUT_DOWN  = 1 << 1,
+  INPUT_LEFT  = 1 << 2,
+  INPUT_RIGHT = 1 << 3
+};
+
+
+// メモリ上で相手へ届ける通信路
+// 設定した遅延(とばらつき)の後に届き、一定の割合で失われる
+class LoopbackTransport {
+public:
+  struct Packet {
+    u_char from;
+    // 受け取り済みの相手の入力の数(次に欲しいtick)
+    u_int ack;
+    // inputsの先頭のtick
+    u_int first_tick;
+    std::vector<u_char> inputs;
+  };
+
+
+private:
+  struct Delivery {
+    double time;
+    u_int  order;
+    u_char to;
+    Packet packet;
+  };
+
+  std::deque<Delivery> queue_;
+
+  double latency_;
+  double jitter_;
+  double loss_rate_;
+
+  Random rand_;
+
+  double time_;
+  u_int  order_;
+
+  u_int sent_;
+  u_int lost_;
+
+
+  // TIPS:コピー不可
+  LoopbackTransport(const LoopbackTransport&) = delete;
+  LoopbackTransport& operator=(const LoopbackTransport&) = delete;
+
+
+public:
+  LoopbackTransport(const double latency, const double jitter, const double loss_rate,
+                    const u_int seed) :
+    latency_(latency),
+    jitter_(jitter),
+    loss_rate_(loss_rate),
+    rand_(seed),
+    time_(0.0),
+    order_(0),
+    sent_(0),
+    lost_(0)
+  { }
+
+
+  void advance(const double delta_time) { time_ += delta_time; }
+
+  void send(const u_char to, const Packet& packet) {
+    sent_ += 1;
+    if (rand_.nextFloat() < loss_rate_) {
+      lost_ += 1;
+      return;
+    }
+
+    // TIPS:ばらつきで追い越しが起きる
+    double delay = latency_ + jitter_ * (rand_.nextFloat() * 2.0f - 1.0f);
+    Delivery delivery = { time_ + std::max(delay, 0.0), order_++, to, packet };
+    auto it = std::upper_bound(std::begin(queue_), std::end(queue_), delivery,
+                               [](const Delivery& lhs, const Delivery& rhs) {
+                                 return (lhs.time != rhs.time) ? (lhs.time < rhs.time)
+                                                               : (lhs.order < rhs.order);
+                               });
+    queue_.insert(it, std::move(delivery));
+  }
+
+  // 届いたものを1つ取り出す
+  bool receive(const u_char to, Packet& packet) {
+    for (auto it = std::begin(queue_); it != std::end(queue_); ++it) {
+      if (it->time > time_) break;
+      if (it->to != to) continue;
+
+      packet = std::move(it->packet);
+      queue_.erase(it);
+      return true;
+    }
+    return false;
+  }
+
+  // 以降は失われないようにする(最後に状態を揃える時用)
+  void lossless() { loss_rate_ = 0.0; }
+
+  u_int sentNum() const { return sent_; }
+  u_int lostNum() const { return lost_; }
+
+};
+
+
+// 2人のうち1人分のGame
+class RollbackPeer {
+public:
+  // 実行結果
+  struct Stats {
+    u_int  ticks;
+    // 相手の入力が遅れすぎて進めなかった回数
+    u_int  stalls;
+    u_int  rollbacks;
+    u_int  rollback_frames;
+    u_int  max_rollback;
+    double rollback_time;
+    double save_time;
+  };
+
+
+private:
+  enum { PLAYER_NUM = 2 };
+
+  Game game_;
+  u_char player_;
+
+  // 巻き戻せる最大tick数
+  u_int max_frames_;
+
+  // 次に進めるtick
+  u_int tick_;
+
+  std::vector<u_char> local_inputs_;
+  // 届いた相手の入力(tickの順に隙間なく)
+  std::vector<u_char> remote_inputs_;
+  // 進めた時に相手の入力として使った値
+  std::vector<u_char> used_inputs_;
+
+  // 相手が受け取り済みの自分の入力の数
+  u_int remote_ack_;
+
+  // 巻き戻す先のtick
+  u_int rollback_tick_;
+
+  // 各tickを進める前の状態
+  std::vector<BinaryWriter> snapshots_;
+
+  Stats stats_;
+
+
+  // TIPS:コピー不可
+  RollbackPeer(const RollbackPeer&) = delete;
+  RollbackPeer& operator=(const RollbackPeer&) = delete;
+
+
+public:
+  RollbackPeer(ci::JsonTree& params, const u_int seed, const u_char player) :
+    game_(params, seed, PLAYER_NUM),
+    player_(player),
+    max_frames_(params.getValueForKey<u_int>("rollback.maxFrames")),
+    tick_(0),
+    remote_ack_(0),
+    rollback_tick_(NO_ROLLBACK()),
+    snapshots_(max_frames_ + 1),
+    stats_()
+  {
+    game_.resize(ci::Vec2i(params.getValueForKey<int>("app.width"),
+                           params.getValueForKey<int>("app.height")));
+  }
+
+
+  // 届いた入力を取り込み、予測と違っていたら巻き戻して計算し直す
+  void receive(LoopbackTransport& transport) {
+    LoopbackTransport::Packet packet;
+    while (transport.receive(player_, packet)) {
+      remote_ack_ = std::max(remote_ack_, packet.ack);
+
+      // 隙間なく続く分だけ受け取る
+      // TIPS:送り手は受け取り済みの位置から送り直すので、欠落しても後の便で埋まる
+      u_int confirmed = u_int(remote_inputs_.size());
+      if (packet.first_tick > confirmed) continue;
+
+      for (u_int i = confirmed - packet.first_tick; i < packet.inputs.size(); ++i) {
+        u_int tick = packet.first_tick + i;
+        u_char input = packet.inputs[i];
+        remote_inputs_.push_back(input);
+
+        if ((tick < tick_) && (used_inputs_[tick] != input)) {
+          rollback_tick_ = std::min(rollback_tick_, tick);
+        }
+      }
+    }
+
+    if (rollback_tick_ != NO_ROLLBACK()) rollback();
+  }
+
+  // 相手の入力が巻き戻せる範囲を超えて遅れていたら進めない
+  bool canAdvance() const {
+    return tick_ < (u_int(remote_inputs_.size()) + max_frames_);
+  }
+
+  // 自分の入力を加えて1tick進める
+  void advance(const u_char input) {
+    local_inputs_.push_back(input);
+    step(tick_);
+    tick_ += 1;
+    stats_.ticks += 1;
+  }
+
+  void stall() { stats_.stalls += 1; }
+
+  // 相手が受け取っていない自分の入力をまとめて送る
+  void send(LoopbackTransport& transport) {
+    LoopbackTransport::Packet packet = {
+      player_,
+      u_int(remote_inputs_.size()),
+      remote_ack_,
+      std::vector<u_char>(std::begin(local_inputs_) + remote_ack_, std::end(local_inputs_))
+    };
+    transport.send(player_ ^ 1, packet);
+  }
+
+
+  // 相手の入力を全て受け取っているか
+  bool isConfirmed() const { return remote_inputs_.size() >= tick_; }
+
+  u_int tick() const { return tick_; }
+  u_int stateHash() const { return game_.stateHash(); }
+
+  // 今の状態を保存して復元し直しても、同じhash値になるか
+  // TIPS:巻き戻したPeerとそうでないPeerを比べるので、保存内容は状態だけで決まらないといけない
+  bool verifyRoundTrip() {
+    BinaryWriter writer;
+    game_.save(writer);
+    BinaryReader reader(writer.data());
+    return game_.load(reader) && (game_.stateHash() == writer.hash());
+  }
+  const Stats& stats() const { return stats_; }
+
+  Game& game() { return game_; }
+
+
+private:
+  static u_int NO_ROLLBACK() { return std::numeric_limits<u_int>::max(); }
+
+  void rollback() {
+    u_int from = rollback_tick_;
+    rollback_tick_ = NO_ROLLBACK();
+    assert((tick_ - from) <= max_frames_);
+
+    ci::Timer timer(true);
+    BinaryReader reader(snapshots_[from % snapshots_.size()].data());
+    game_.load(reader);
+    for (u_int tick = from; tick < tick_; ++tick) {
+      step(tick);
+    }
+    timer.stop();
+
+    u_int frames = tick_ - from;
+    stats_.rollbacks       += 1;
+    stats_.rollback_frames += frames;
+    stats_.max_rollback     = std::max(stats_.max_rollback, frames);
+    stats_.rollback_time   += timer.getSeconds();
+  }
+
+  // 指定tickの入力を与えて進める
+  void step(const u_int tick) {
+    ci::Timer timer(true);
+    auto& snapshot = snapshots_[tick % snapshots_.size()];
+    snapshot.clear();
+    game_.save(snapshot);
+    stats_.save_time += timer.getSeconds();
+
+    // 届いていない相手の入力は「入力なし」と予測
+    // TIPS:キー入力は押した瞬間だけなので、直前の入力を繰り返すより外れにくい
+    u_char remote = (tick < remote_inputs_.size()) ? remote_inputs_[tick] : 0;
+    if (tick < used_inputs_.size()) used_inputs_[tick] = remote;
+    else                            used_inputs_.push_back(remote);
+
+    // TIPS:どちらのGameでも同じ順番(player 0から)で与える
+    u_char inputs[PLAYER_NUM];
+    inputs[player_]     = local_inputs_[tick];
+    inputs[player_ ^ 1] = remote;
+    for (int player = 0; player < PLAYER_NUM; ++player) {
+      applyInput(player, inputs[player]);
+    }
+
+    game_.step();
+  }
+
+  void applyInput(const int player, const u_char input) {
+    static const struct {
+      u_char bit;
+      int keycode;
+    } keys[] = {
+      { INPUT_UP,    ci::app::KeyEvent::KEY_UP },
+      { INPUT_DOWN,  ci::app::KeyEvent::KEY_DOWN },
+      { INPUT_LEFT,  ci::app::KeyEvent::KEY_LEFT },
+      { INPUT_RIGHT, ci::app::KeyEvent::KEY_RIGHT },
+    };
+
+    for (const auto& key : keys) {
+      if (input & key.bit) game_.keyDown(key.keycode, 0, player);
+    }
+  }
+
+};
+
+
+// 2つのPeerを通信路でつないで、自動入力で進める
+class RollbackSession {
+public:
+  struct Report {
+    u_int  ticks;
+    double wall_time;
+
+    u_int sent;
+    u_int lost;
+
+    RollbackPeer::Stats peers[2];
+
+    // 最後に両者の状態が一致したか
+    bool   synced;
+    u_int  hash[2];
+    // 両者とも、復元し直しても状態のhash値が変わらなかったか
+    bool   round_trip;
+
+    bool isValid() const { return synced && round_trip; }
+  };
+
+
+private:
+  LoopbackTransport transport_;
+  RollbackPeer peer0_;
+  RollbackPeer peer1_;
+
+  // 自動入力
+  float input_rate_;
+  Random input_rand_[2];
+
+
+  // TIPS:コピー不可
+  RollbackSession(const RollbackSession&) = delete;
+  RollbackSession& operator=(const RollbackSession&) = delete;
+
+
+public:
+  // TIPS:両者は同じ乱数の種でGameを作る
+  RollbackSession(ci::JsonTree& params, const u_int seed) :
+    transport_(params.getValueForKey<double>("rollback.latency"),
+               params.getValueForKey<double>("rollback.jitter"),
+               params.getValueForKey<double>("rollback.lossRate"),
+               seed),
+    peer0_(params, seed, 0),
+    peer1_(params, seed, 1),
+    input_rate_(params.getValueForKey<float>("rollback.inputRate"))
+  {
+    input_rand_[0].seed(seed, RANDOM_DEFAULT, 1);
+    input_rand_[1].seed(seed, RANDOM_DEFAULT, 2);
+  }
+
+
+  // 両者がticksまで進むまで実行し、最後に入力を全て届けて状態を比べる
+  Report run(const u_int ticks) {
+    ci::Timer timer(true);
+    RollbackPeer* peers[] = { &peer0_, &peer1_ };
+
+    const double tick_time = peer0_.game().tickTime();
+    while ((peer0_.tick() < ticks) || (peer1_.tick() < ticks)) {
+      for (int i = 0; i < 2; ++i) {
+        auto& peer = *peers[i];
+        peer.receive(transport_);
+        if (peer.tick() < ticks) {
+          if (peer.canAdvance()) peer.advance(input(i));
+          else                   peer.stall();
+        }
+        peer.send(transport_);
+      }
+      transport_.advance(tick_time);
+    }
+
+    // 残りの入力を届けて、予測で進めた分を確定させる
+    transport_.lossless();
+    while (!peer0_.isConfirmed() || !peer1_.isConfirmed()) {
+      for (auto* peer : peers) {
+        peer->receive(transport_);
+        peer->send(transport_);
+      }
+      transport_.advance(tick_time);
+    }
+
+    Report report = {};
+    report.ticks     = ticks;
+    report.wall_time = timer.getSeconds();
+    report.sent      = transport_.sentNum();
+    report.lost      = transport_.lostNum();
+    report.peers[0]  = peer0_.stats();
+    report.peers[1]  = peer1_.stats();
+    report.hash[0]   = peer0_.stateHash();
+    report.hash[1]   = peer1_.stateHash();
+    report.synced    = report.hash[0] == report.hash[1];
+    report.round_trip = peer0_.verifyRoundTrip() && peer1_.verifyRoundTrip();
+    return report;
+  }
+
+
+  static void print(std::ostream& output, const Report& report) {
+    output << "ticks:" << report.ticks
+           << " wall:" << report.wall_time << "s"
+           << " packets:" << report.sent << " lost:" << report.lost
+           << std::endl;
+
+    for (int i = 0; i < 2; ++i) {
+      const auto& stats = report.peers[i];
+      output << "peer" << i
+             << " stalls:" << stats.stalls
+             << " rollbacks:" << stats.rollbacks
+             << " frames:" << stats.rollback_frames
+             << " max:" << stats.max_rollback
+             << " save:" << stats.save_time * 1000.0 << "ms"
+             << " rollback:" << stats.rollback_time * 1000.0 << "ms"
+             << " (" << stats.rollback_frames / std::max(stats.rollback_time, 1e-9) << " frames/s)"
+             << std::endl;
+    }
+
+    output << "sync:" << (report.synced ? "OK" : "NG") << std::hex
+           << " " << report.hash[0] << "/" << report.hash[1] << std::dec
+           << " round trip:" << (report.round_trip ? "OK" : "NG")
+           << std::endl;
+  }
+
+
+private:
+  u_char input(const int player) {
+    auto& rand = input_rand_[player];
+    if (rand.nextFloat() >= input_rate_) return 0;
+
+    return u_char(1 << rand.nextInt(4));
+  }
+
+};
+
+}
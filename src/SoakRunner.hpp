@@ -0,0 +1,209 @@
+﻿#pragma once
+
+//
+// 自動操作による長時間実行(soak)
+// 腕前の違うCubeBotごとに1つのGameを用意して交互に進め、
+// 一定tickごとに1tickの処理時間の分布・メモリ使用量・クリア率を出力する
+//
+
+#include <algorithm>
+#include <memory>
+#include <ostream>
+#include <vector>
+#include "cinder/Json.h"
+#include "cinder/Timer.h"
+#include "Game.hpp"
+#include "CubeBot.hpp"
+
+#if defined (_MSC_VER)
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#elif defined (__APPLE__)
+#include <mach/mach.h>
+#elif defined (__linux__)
+#include <fstream>
+#include <unistd.h>
+#endif
+
+
+namespace ngs {
+
+class SoakRunner {
+public:
+  // 1tickの処理時間の分布
+  // TIPS:[2^i, 2^(i+1))μsごとに数える
+  struct Histogram {
+    enum { BUCKET_NUM = 24 };
+
+    u_int  counts[BUCKET_NUM];
+    u_int  num;
+    double total;
+    double max;
+
+    void clear() {
+      std::fill(counts, counts + BUCKET_NUM, 0u);
+      num   = 0;
+      total = 0.0;
+      max   = 0.0;
+    }
+
+    void add(const double seconds) {
+      double us = seconds * 1000000.0;
+      int bucket = 0;
+      while ((bucket < (BUCKET_NUM - 1)) && (us >= double(2 << bucket))) {
+        bucket += 1;
+      }
+      counts[bucket] += 1;
+      num   += 1;
+      total += seconds;
+      max    = std::max(max, seconds);
+    }
+
+    // rate(0〜1)の位置が入っている区間の上限(μs)
+    double percentile(const double rate) const {
+      u_int target = u_int(num * rate);
+      u_int sum = 0;
+      for (int i = 0; i < BUCKET_NUM; ++i) {
+        sum += counts[i];
+        if (sum > target) return double(2 << i);
+      }
+      return double(2 << (BUCKET_NUM - 1));
+    }
+  };
+
+
+private:
+  struct Session {
+    ci::JsonTree params;
+    std::unique_ptr<Game> game;
+    std::unique_ptr<CubeBot> bot;
+    size_t level;
+
+    Histogram frame_time;
+  };
+
+  std::vector<std::unique_ptr<Session> > sessions_;
+
+  // 出力の間隔
+  u_int log_ticks_;
+  u_int tick_;
+
+  size_t start_memory_;
+  ci::Timer timer_;
+
+
+  // TIPS:コピー不可
+  SoakRunner(const SoakRunner&) = delete;
+  SoakRunner& operator=(const SoakRunner&) = delete;
+
+
+public:
+  // levels:腕前(bot.skillsの番号)ごとにGameを作る
+  SoakRunner(const ci::JsonTree& params, const std::vector<size_t>& levels, const u_int seed) :
+    log_ticks_(1),
+    tick_(0)
+  {
+    for (size_t i = 0; i < levels.size(); ++i) {
+      std::unique_ptr<Session> session(new Session);
+      // TIPS:設定を共有しない
+      session->params = params;
+      session->level  = levels[i];
+
+      u_int game_seed = seed + u_int(i);
+      session->game = std::unique_ptr<Game>(new Game(session->params, game_seed));
+      session->game->resize(ci::Vec2i(params.getValueForKey<int>("app.width"),
+                                      params.getValueForKey<int>("app.height")));
+      session->bot = std::unique_ptr<CubeBot>(new CubeBot(session->params,
+                                                          CubeBot::readSkill(params, levels[i]),
+                                                          0, game_seed));
+      session->frame_time.clear();
+
+      sessions_.push_back(std::move(session));
+    }
+
+    log_ticks_ = std::max(u_int(params.getValueForKey<double>("bot.logInterval")
+                                * params.getValueForKey<double>("app.tickRate")), 1u);
+    start_memory_ = residentSize();
+  }
+
+
+  // ticksだけ進める(0なら止めるまで続ける)
+  void run(const u_int ticks, std::ostream& output) {
+    timer_.start();
+    while ((ticks == 0) || (tick_ < ticks)) {
+      for (auto& session : sessions_) {
+        ci::Timer timer(true);
+        session->bot->update(*session->game);
+        session->game->step();
+        session->frame_time.add(timer.getSeconds());
+      }
+      tick_ += 1;
+
+      if ((tick_ % log_ticks_) == 0) log(output);
+    }
+    if ((tick_ % log_ticks_) != 0) log(output);
+  }
+
+
+  // プロセスが使っている物理メモリ(bytes、取得できなければ0)
+  static size_t residentSize() {
+#if defined (_MSC_VER)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+    return counters.WorkingSetSize;
+#elif defined (__APPLE__)
+    mach_task_basic_info info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO,
+                  reinterpret_cast<task_info_t>(&info), &count) != KERN_SUCCESS) return 0;
+    return info.resident_size;
+#elif defined (__linux__)
+    std::ifstream input("/proc/self/statm");
+    size_t pages, resident;
+    if (!(input >> pages >> resident)) return 0;
+    return resident * size_t(sysconf(_SC_PAGESIZE));
+#else
+    return 0;
+#endif
+  }
+
+
+private:
+  // 経過と各Gameの状況を出力し、処理時間の分布は区切り直す
+  void log(std::ostream& output) {
+    size_t memory = residentSize();
+    long long growth = (long long)memory - (long long)start_memory_;
+
+    output << "[soak] ticks:" << tick_
+           << " wall:" << timer_.getSeconds() << "s"
+           << " memory:" << memory / 1024 << "KB"
+           << " (" << ((growth >= 0) ? "+" : "") << growth / 1024 << "KB)"
+           << std::endl;
+
+    for (size_t i = 0; i < sessions_.size(); ++i) {
+      auto& session = *sessions_[i];
+      const auto& frame   = session.frame_time;
+      const auto& results = session.game->results();
+
+      u_int tries = results.clears + results.misses;
+      output << "  bot" << i
+             << " skill:" << session.level
+             << " frame avg:" << (frame.num ? (frame.total / frame.num * 1000000.0) : 0.0) << "us"
+             << " p50:<" << frame.percentile(0.5) << "us"
+             << " p99:<" << frame.percentile(0.99) << "us"
+             << " max:" << frame.max * 1000000.0 << "us"
+             << " moves:" << session.bot->moves()
+             << " clears:" << results.clears
+             << " misses:" << results.misses
+             << " all clears:" << results.all_clears
+             << " clear rate:" << (tries ? (double(results.clears) / tries) : 0.0)
+             << std::endl;
+
+      session.frame_time.clear();
+    }
+  }
+
+};
+
+}
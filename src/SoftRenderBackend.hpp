@@ -0,0 +1,394 @@
+﻿#pragma once
+
+//
+// CPUによる描画
+// GPUの無い環境での描画結果の比較と性能計測に使う
+//  ・頂点ごとに点光源の計算(固定機能パイプライン相当)
+//  ・画面をタイルに分割して、タイルごとに並列でラスタライズ
+//  ・エッジ関数は4画素ずつまとめて評価
+// TIPS:near面の手前にはみ出した三角形はクリップせずに捨てている
+//
+
+#include <limits>
+#include "cinder/Timer.h"
+#include "CubeGeometry.hpp"
+#include "RenderBackend.hpp"
+#include "ThreadPool.hpp"
+#include "PngFile.hpp"
+
+#if defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define NGS_SOFTRENDER_SSE2
+#include <emmintrin.h>
+#endif
+
+
+namespace ngs {
+
+class SoftRenderBackend : public RenderBackend {
+  enum {
+    TILE_SIZE = 64
+  };
+
+  // 画面座標に変換済みの頂点(yは上向き)
+  struct Vertex {
+    float x, y, z;
+    float r, g, b;
+  };
+
+  struct Triangle {
+    Vertex v[3];
+  };
+
+  int width_;
+  int height_;
+  ci::Color clear_color_;
+
+  ThreadPool& thread_pool_;
+
+  ci::Matrix44f view_projection_;
+
+  bool has_light_;
+  RenderQueue::Light light_;
+  // glLightModelのambient初期値
+  ci::Color global_ambient_;
+
+  // 単位立方体
+  ci::Vec3f cube_vertices_[CubeGeometry::VERTEX_NUM];
+  ci::Vec3f cube_normals_[CubeGeometry::VERTEX_NUM];
+
+  std::vector<Triangle> triangles_;
+
+  int tile_x_;
+  int tile_y_;
+  std::vector<std::vector<u_int> > tile_triangles_;
+
+  std::vector<u_char> color_buffer_;
+  std::vector<float> depth_buffer_;
+
+  double raster_time_;
+
+
+public:
+  SoftRenderBackend(const int width, const int height, ThreadPool& thread_pool,
+                    const ci::Color& clear_color = ci::Color(0.2f, 0.2f, 0.2f)) :
+    width_(width),
+    height_(height),
+    clear_color_(clear_color),
+    thread_pool_(thread_pool),
+    has_light_(false),
+    global_ambient_(0.2f, 0.2f, 0.2f),
+    tile_x_((width + TILE_SIZE - 1) / TILE_SIZE),
+    tile_y_((height + TILE_SIZE - 1) / TILE_SIZE),
+    tile_triangles_(tile_x_ * tile_y_),
+    color_buffer_(width * height * 4),
+    depth_buffer_(width * height),
+    raster_time_(0.0)
+  {
+    for (int face = 0; face < CubeGeometry::FACE_NUM; ++face) {
+      int offset = face * CubeGeometry::FACE_VERTEX_NUM;
+      CubeGeometry::faceVertices(face, &cube_vertices_[offset]);
+      for (int i = 0; i < CubeGeometry::FACE_VERTEX_NUM; ++i) {
+        cube_normals_[offset + i] = CubeGeometry::faceNormal(face);
+      }
+    }
+  }
+
+
+  void begin(const RenderQueue& queue) override {
+    RenderBackend::begin(queue);
+
+    // 出力画像の縦横比に合わせる
+    ci::CameraPersp camera = queue.camera();
+    camera.setAspectRatio(float(width_) / float(height_));
+    view_projection_ = camera.getProjectionMatrix() * camera.getModelViewMatrix();
+
+    has_light_ = queue.hasLight();
+    if (has_light_) light_ = queue.light();
+
+    triangles_.clear();
+  }
+
+  void drawCubes(const int material,
+                 const RenderQueue::Command* commands, const size_t num) override {
+    RenderBackend::drawCubes(material, commands, num);
+
+    for (size_t n = 0; n < num; ++n) {
+      const auto& command = commands[n];
+      ci::Color color(command.color.r, command.color.g, command.color.b);
+      for (int i = 0; i < CubeGeometry::VERTEX_NUM; i += 3) {
+        ci::Vec3f pos[3];
+        ci::Vec3f normal[3];
+        ci::Color colors[3];
+        for (int k = 0; k < 3; ++k) {
+          pos[k]    = command.transform.transformPoint(cube_vertices_[i + k]);
+          normal[k] = command.transform.transformVec(cube_normals_[i + k]).normalized();
+          colors[k] = color;
+        }
+        addTriangle(pos, normal, colors);
+      }
+    }
+  }
+
+  void drawMesh(const int material, const CubeMesh& mesh) override {
+    RenderBackend::drawMesh(material, mesh);
+
+    for (size_t i = 0; (i + 2) < mesh.vertexNum(); i += 3) {
+      ci::Color colors[3];
+      for (int k = 0; k < 3; ++k) {
+        const auto& c = mesh.colors[i + k];
+        colors[k] = ci::Color(c.r, c.g, c.b);
+      }
+      addTriangle(&mesh.vertices[i], &mesh.normals[i], colors);
+    }
+  }
+
+  void end() override {
+    ci::Timer timer(true);
+    rasterize();
+    raster_time_ = timer.getSeconds();
+
+    RenderBackend::end();
+  }
+
+
+  int width() const { return width_; }
+  int height() const { return height_; }
+
+  // ラスタライズに掛かった時間(秒)
+  double rasterTime() const { return raster_time_; }
+
+  Png::Image image() const {
+    Png::Image image = { width_, height_, color_buffer_ };
+    return image;
+  }
+
+  bool writePng(const std::string& path) const {
+    return Png::write(path, image());
+  }
+
+
+private:
+  // 固定機能パイプライン相当の頂点ごとの光源計算
+  // TIPS:material(ambient & diffuse)は頂点色、specularは0
+  ci::Color lighting(const ci::Vec3f& pos, const ci::Vec3f& normal, const ci::Color& color) const {
+    if (!has_light_) return color;
+
+    ci::Vec3f to_light = light_.pos - pos;
+    float distance = to_light.length();
+    float attenuation = light_.constant_attenuation
+                      + light_.linear_attenuation * distance
+                      + light_.quadratic_attenuation * distance * distance;
+    attenuation = (attenuation > 0.0f) ? 1.0f / attenuation : 1.0f;
+
+    float diffuse = (distance > 0.0f) ? std::max(normal.dot(to_light / distance), 0.0f) : 0.0f;
+
+    ci::Color result = global_ambient_ * color
+                     + (light_.ambient * color + light_.diffuse * color * diffuse) * attenuation;
+    return ci::Color(std::min(result.r, 1.0f), std::min(result.g, 1.0f), std::min(result.b, 1.0f));
+  }
+
+  void addTriangle(const ci::Vec3f* pos, const ci::Vec3f* normal, const ci::Color* color) {
+    Triangle triangle;
+    for (int k = 0; k < 3; ++k) {
+      auto clip = view_projection_ * ci::Vec4f(pos[k].x, pos[k].y, pos[k].z, 1.0f);
+      // near面の手前
+      if (clip.w <= std::numeric_limits<float>::epsilon()) return;
+
+      auto& v = triangle.v[k];
+      v.x = (clip.x / clip.w * 0.5f + 0.5f) * width_;
+      v.y = (clip.y / clip.w * 0.5f + 0.5f) * height_;
+      v.z = clip.z / clip.w;
+
+      auto c = lighting(pos[k], normal[k], color[k]);
+      v.r = c.r;
+      v.g = c.g;
+      v.b = c.b;
+    }
+
+    // 裏面カリング(反時計回りが表)
+    const auto& a = triangle.v[0];
+    const auto& b = triangle.v[1];
+    const auto& c = triangle.v[2];
+    float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+    if (area <= 0.0f) return;
+
+    triangles_.push_back(triangle);
+  }
+
+
+  void rasterize() {
+    // 三角形をタイルに振り分ける
+    for (auto& tile : tile_triangles_) {
+      tile.clear();
+    }
+    for (u_int i = 0; i < triangles_.size(); ++i) {
+      int min_x, min_y, max_x, max_y;
+      if (!bounds(triangles_[i], min_x, min_y, max_x, max_y)) continue;
+
+      for (int ty = min_y / TILE_SIZE; ty <= max_y / TILE_SIZE; ++ty) {
+        for (int tx = min_x / TILE_SIZE; tx <= max_x / TILE_SIZE; ++tx) {
+          tile_triangles_[ty * tile_x_ + tx].push_back(i);
+        }
+      }
+    }
+
+    thread_pool_.parallelFor(tile_triangles_.size(),
+                             [this](size_t index, size_t thread) {
+                               rasterizeTile(int(index));
+                             });
+  }
+
+  // 三角形が覆う画素の範囲
+  bool bounds(const Triangle& triangle, int& min_x, int& min_y, int& max_x, int& max_y) const {
+    float x0 = std::min(std::min(triangle.v[0].x, triangle.v[1].x), triangle.v[2].x);
+    float y0 = std::min(std::min(triangle.v[0].y, triangle.v[1].y), triangle.v[2].y);
+    float x1 = std::max(std::max(triangle.v[0].x, triangle.v[1].x), triangle.v[2].x);
+    float y1 = std::max(std::max(triangle.v[0].y, triangle.v[1].y), triangle.v[2].y);
+
+    min_x = std::max(int(std::floor(x0)), 0);
+    min_y = std::max(int(std::floor(y0)), 0);
+    max_x = std::min(int(std::ceil(x1)), width_ - 1);
+    max_y = std::min(int(std::ceil(y1)), height_ - 1);
+
+    return (min_x <= max_x) && (min_y <= max_y);
+  }
+
+  void rasterizeTile(const int index) {
+    int tile_min_x = (index % tile_x_) * TILE_SIZE;
+    int tile_min_y = (index / tile_x_) * TILE_SIZE;
+    int tile_max_x = std::min(tile_min_x + TILE_SIZE, width_) - 1;
+    int tile_max_y = std::min(tile_min_y + TILE_SIZE, height_) - 1;
+
+    // タイル内の消去
+    u_char clear[] = {
+      u_char(clear_color_.r * 255.0f + 0.5f),
+      u_char(clear_color_.g * 255.0f + 0.5f),
+      u_char(clear_color_.b * 255.0f + 0.5f),
+      255
+    };
+    for (int y = tile_min_y; y <= tile_max_y; ++y) {
+      for (int x = tile_min_x; x <= tile_max_x; ++x) {
+        std::copy(clear, clear + 4, &color_buffer_[pixelIndex(x, y) * 4]);
+        depth_buffer_[pixelIndex(x, y)] = 1.0f;
+      }
+    }
+
+    for (auto i : tile_triangles_[index]) {
+      const auto& triangle = triangles_[i];
+
+      int min_x, min_y, max_x, max_y;
+      bounds(triangle, min_x, min_y, max_x, max_y);
+      min_x = std::max(min_x, tile_min_x);
+      min_y = std::max(min_y, tile_min_y);
+      max_x = std::min(max_x, tile_max_x);
+      max_y = std::min(max_y, tile_max_y);
+
+      rasterizeTriangle(triangle, min_x, min_y, max_x, max_y);
+    }
+  }
+
+  void rasterizeTriangle(const Triangle& triangle,
+                         const int min_x, const int min_y, const int max_x, const int max_y) {
+    const auto& a = triangle.v[0];
+    const auto& b = triangle.v[1];
+    const auto& c = triangle.v[2];
+
+    // エッジ関数 E(x, y) = A * x + B * y + C
+    // 三角形の内側で全て正になる
+    float ea[] = { b.y - c.y, c.y - a.y, a.y - b.y };
+    float eb[] = { c.x - b.x, a.x - c.x, b.x - a.x };
+    float ec[] = {
+      b.x * c.y - b.y * c.x,
+      c.x * a.y - c.y * a.x,
+      a.x * b.y - a.y * b.x
+    };
+    float area = ec[0] + ec[1] + ec[2];
+    if (area <= 0.0f) return;
+    float inv_area = 1.0f / area;
+
+    for (int y = min_y; y <= max_y; ++y) {
+      float py = y + 0.5f;
+      for (int x = min_x; x <= max_x; x += 4) {
+        float px = x + 0.5f;
+
+        // 4画素分の重心座標と深度
+        float w[3][4];
+        float depth[4];
+        int   mask = edge4(ea, eb, ec, px, py, inv_area, a.z, b.z, c.z, w, depth);
+
+        for (int i = 0; i < 4; ++i) {
+          if (!(mask & (1 << i))) continue;
+          if ((x + i) > max_x) break;
+
+          size_t pixel = pixelIndex(x + i, y);
+          if (depth[i] >= depth_buffer_[pixel]) continue;
+          depth_buffer_[pixel] = depth[i];
+
+          auto* dst = &color_buffer_[pixel * 4];
+          dst[0] = toU8(a.r * w[0][i] + b.r * w[1][i] + c.r * w[2][i]);
+          dst[1] = toU8(a.g * w[0][i] + b.g * w[1][i] + c.g * w[2][i]);
+          dst[2] = toU8(a.b * w[0][i] + b.b * w[1][i] + c.b * w[2][i]);
+          dst[3] = 255;
+        }
+      }
+    }
+  }
+
+  // 横に並んだ4画素のエッジ関数を評価して、内側の画素をbitで返す
+  static int edge4(const float* ea, const float* eb, const float* ec,
+                   const float px, const float py, const float inv_area,
+                   const float z0, const float z1, const float z2,
+                   float w[3][4], float* depth) {
+#if defined (NGS_SOFTRENDER_SSE2)
+    __m128 x    = _mm_add_ps(_mm_set1_ps(px), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f));
+    __m128 y    = _mm_set1_ps(py);
+    __m128 zero = _mm_setzero_ps();
+    __m128 inv  = _mm_set1_ps(inv_area);
+
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    __m128 weight[3];
+    for (int e = 0; e < 3; ++e) {
+      __m128 value = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(ea[e]), x),
+                                           _mm_mul_ps(_mm_set1_ps(eb[e]), y)),
+                                _mm_set1_ps(ec[e]));
+      inside    = _mm_and_ps(inside, _mm_cmpge_ps(value, zero));
+      weight[e] = _mm_mul_ps(value, inv);
+      _mm_storeu_ps(w[e], weight[e]);
+    }
+
+    __m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(weight[0], _mm_set1_ps(z0)),
+                                     _mm_mul_ps(weight[1], _mm_set1_ps(z1))),
+                          _mm_mul_ps(weight[2], _mm_set1_ps(z2)));
+    _mm_storeu_ps(depth, z);
+
+    return _mm_movemask_ps(inside);
+#else
+    int mask = 0;
+    for (int i = 0; i < 4; ++i) {
+      float x = px + i;
+      bool inside = true;
+      for (int e = 0; e < 3; ++e) {
+        float value = ea[e] * x + eb[e] * py + ec[e];
+        inside = inside && (value >= 0.0f);
+        w[e][i] = value * inv_area;
+      }
+      depth[i] = w[0][i] * z0 + w[1][i] * z1 + w[2][i] * z2;
+      if (inside) mask |= 1 << i;
+    }
+    return mask;
+#endif
+  }
+
+
+  // 出力画像は上の行から
+  size_t pixelIndex(const int x, const int y) const {
+    return size_t(height_ - 1 - y) * width_ + x;
+  }
+
+  static u_char toU8(const float value) {
+    return u_char(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+  }
+
+};
+
+}
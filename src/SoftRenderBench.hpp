@@ -0,0 +1,135 @@
+﻿#pragma once
+
+//
+// CPUによる描画の確認と計測(headless用)
+// ticks進めたGameの同じ状態をSoftRenderBackendでframes回描画し、1フレームごとのラスタライズ時間を出す
+// 最後のフレームをPNGに書き出し、基準画像(golden)があれば比べる
+//
+// TIPS:タイルは1つのスレッドだけが塗るので、スレッド数によらず同じ画像になる
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "cinder/Json.h"
+#include "Game.hpp"
+#include "SoftRenderBackend.hpp"
+#include "PngFile.hpp"
+
+
+namespace ngs {
+
+class SoftRenderBench {
+public:
+  struct Report {
+    int width;
+    int height;
+    u_int ticks;
+    u_int threads;
+
+    // 1フレームごとの時間(秒)
+    std::vector<double> raster_times;
+    std::vector<double> submit_times;
+
+    u_int draw_calls;
+    u_int cubes;
+    u_int mesh_vertices;
+
+    std::string output_path;
+    bool written;
+
+    // 基準画像との比較(golden_pathが空なら比べない)
+    std::string golden_path;
+    bool golden_read;
+    // 差がthresholdを超えた画素数
+    size_t diff_pixels;
+
+    bool isValid() const {
+      if (!written) return false;
+      if (golden_path.empty()) return true;
+      return golden_read && (diff_pixels == 0);
+    }
+  };
+
+
+  // threshold:基準画像と比べる時、各成分でこれを超えた差があれば違う画素とする
+  static Report run(ci::JsonTree& params, ThreadPool& thread_pool,
+                    const u_int ticks, const u_int frames, const u_int seed,
+                    const std::string& output_path, const std::string& golden_path,
+                    const int threshold) {
+    Report report = {};
+    report.width   = params.getValueForKey<int>("app.width");
+    report.height  = params.getValueForKey<int>("app.height");
+    report.ticks   = ticks;
+    report.threads = u_int(thread_pool.threadNum());
+    report.output_path = output_path;
+    report.golden_path = golden_path;
+
+    Game game(params, seed);
+    game.resize(ci::Vec2i(report.width, report.height));
+    for (u_int i = 0; i < ticks; ++i) {
+      game.step();
+    }
+
+    SoftRenderBackend backend(report.width, report.height, thread_pool);
+    for (u_int i = 0; i < std::max(frames, 1u); ++i) {
+      game.render(backend);
+      report.raster_times.push_back(backend.rasterTime());
+      report.submit_times.push_back(backend.stats().submit_time);
+    }
+    report.draw_calls    = backend.stats().draw_calls;
+    report.cubes         = backend.stats().cubes;
+    report.mesh_vertices = backend.stats().mesh_vertices;
+
+    auto image = backend.image();
+    report.written = Png::write(output_path, image);
+
+    if (!golden_path.empty()) {
+      Png::Image golden;
+      report.golden_read = Png::read(golden_path, golden);
+      if (report.golden_read) report.diff_pixels = Png::compare(image, golden, threshold);
+    }
+    return report;
+  }
+
+  static void print(std::ostream& output, const Report& report) {
+    output << "soft render " << report.width << "x" << report.height
+           << " ticks:" << report.ticks
+           << " threads:" << report.threads
+           << " draw calls:" << report.draw_calls
+           << " cubes:" << report.cubes
+           << " mesh vertices:" << report.mesh_vertices
+           << std::endl;
+
+    double total = 0.0;
+    double max_time = 0.0;
+    for (size_t i = 0; i < report.raster_times.size(); ++i) {
+      output << "frame:" << i
+             << " raster:" << report.raster_times[i] * 1000.0 << "ms"
+             << " submit:" << report.submit_times[i] * 1000.0 << "ms"
+             << std::endl;
+      total += report.raster_times[i];
+      max_time = std::max(max_time, report.raster_times[i]);
+    }
+    if (!report.raster_times.empty()) {
+      output << "raster average:" << total / report.raster_times.size() * 1000.0 << "ms"
+             << " max:" << max_time * 1000.0 << "ms"
+             << std::endl;
+    }
+
+    output << "output:" << report.output_path << (report.written ? "" : " (can't write)") << std::endl;
+    if (!report.golden_path.empty()) {
+      output << "golden:" << report.golden_path;
+      if (report.golden_read) {
+        output << " diff pixels:" << report.diff_pixels;
+      }
+      else {
+        output << " (can't read)";
+      }
+      output << " " << (report.isValid() ? "OK" : "NG") << std::endl;
+    }
+  }
+
+};
+
+}
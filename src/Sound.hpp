@@ -1,214 +1,533 @@
 ﻿#pragma once
 
 //
-// BGM処理
-// TODO:fade in/out
-// TODO:同じ音を複数同時再生
-// TODO:Pan
+// 音の再生
+// 音源は生成時にまとめて読み込まず、読み込み用のスレッドで1つずつ読み込む
+//   ・事前読み込みの指定(preload)がある音源は、生成時に読み込みを始める
+//   ・それ以外は最初に鳴らす時、またはSOUND_PRELOADで読み込みを始める
+// 読み込み中の音を鳴らす指示は溜めておき、読み込めたら鳴らす(待たない)
+// categoryごとに同時に鳴らせる声の数を決めておき、足りなければpriorityとの兼ね合いで古い声を奪う
+//
+// 音源は生成時に番号(Handle)を割り振る。名前から番号を調べるのは最初の1回だけにして、
+// play(handle, gain)で鳴らす。どのスレッドから呼んでもよく、指示はupdateでまとめて鳴らす
+//
+// 指示を受け取って鳴らすのはメインスレッドだけ
+//   ・他のスレッドのplayは待ち行列(CommandQueue)へ積むだけ
+//   ・update、SOUND_PLAY/SOUND_STOPはメインスレッドから呼ぶ。声と読み込み待ちの指示はここでしか触らない
+//
+// TIPS:実際に鳴らすのはSoundBackend(差し替えれば音の出ない環境でも動く)
 //
 
-#include "cinder/audio/Context.h"
-#include "cinder/audio/SamplePlayerNode.h"
-#include "cinder/audio/NodeEffects.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "cinder/Json.h"
 #include "Message.hpp"
+#include "CommandQueue.hpp"
+#include "SoundBackend.hpp"
+#include "VoicePool.hpp"
 
 
 namespace ngs {
 
 class Sound {
+public:
+  typedef u_int Handle;
+  // 見つからなかった
+  static const Handle INVALID_HANDLE = ~0u;
+
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
   Message& message_;
   Message::ConnectionHolder connection_holder_;
-  
-  const ci::JsonTree& params_;
 
-  
+  std::unique_ptr<SoundBackend> backend_;
+
+
+  enum {
+    STATE_NONE,
+    STATE_LOADING,
+    STATE_READY,
+    STATE_ERROR
+  };
+
   // 各音源情報
   struct Object {
     std::string type;
     std::string category;
+    std::string path;
     bool loop;
     float gain;
+    // 声が足りない時、これ以下の声を奪う
+    int priority;
+    // voices_の位置
+    size_t voice_index;
+
+    int state;
+    boost::any source;
   };
 
-  std::map<std::string, Object> objects_;
+  // TIPS:Handleは並びの位置
+  std::vector<Object> objects_;
+  std::map<std::string, Handle> handles_;
 
-  // 効果音用の定義
-  struct BufferNode {
-    ~BufferNode() {
-      node->stop();
-    }
-    
-    ci::audio::BufferPlayerNodeRef node;
-    ci::audio::GainNodeRef gain;
+  // categoryごとの声(並びの位置がSoundBackendに渡すpoolの番号)
+  // TIPS:声の再生ノードはtypeで作り分けるので、1つのcategoryの音源は全て同じtypeにする
+  struct Voices {
+    std::string category;
+    std::string type;
+    VoicePool pool;
   };
 
-  std::map<std::string, ci::audio::SourceFileRef> source_;
-  std::map<std::string, BufferNode> buffer_node_;
+  std::vector<Voices> voices_;
 
-  
-  // ストリーミング再生用の定義
-  struct FileNode {
-    ~FileNode() {
-      node->stop();
-    }
-    
-    ci::audio::FilePlayerNodeRef node;
-    ci::audio::GainNodeRef gain;
+
+  // 読み込み用のスレッドとのやり取り
+  struct Request {
+    Handle handle;
+    std::string type;
+    std::string path;
+  };
+
+  struct Result {
+    Handle handle;
+    boost::any source;
+    double load_time;
+  };
+
+  std::mutex mutex_;
+  std::condition_variable wakeup_;
+  std::deque<Request> requests_;
+  std::deque<Result> results_;
+  bool quit_;
+
+  std::thread thread_;
+
+
+  // 他のスレッドからの鳴らす指示
+  struct Command {
+    Handle handle;
+    float gain;
+  };
+
+  CommandQueue<Command> commands_;
+  // 待ち行列がいっぱいで捨てた指示
+  std::atomic<u_int> command_drops_;
+  u_int command_num_;
+
+
+  // 読み込み中の音を鳴らす指示
+  // TIPS:メインスレッドだけが触るのでロックしない
+  struct Pending {
+    Handle handle;
+    float gain;
+    Clock::time_point time;
   };
 
-  std::map<std::string, ci::audio::BufferRef> buffer_;
-  std::map<std::string, FileNode> file_node_;
+  std::vector<Pending> pending_;
+  // 効果音はこれ以上遅れたら鳴らさない(秒)
+  double max_delay_;
+
+  // 計測用
+  u_int  loaded_num_;
+  double load_time_;
+  u_int  dropped_num_;
+  // 読み込めなかったので鳴らせなかった指示
+  u_int  failed_num_;
+
+
+  // TIPS:コピー不可
+  Sound(const Sound&) = delete;
+  Sound& operator=(const Sound&) = delete;
+
 
-  // 停止用
-  std::map<std::string, ci::audio::SamplePlayerNodeRef> category_node_;
-  
-  
 public:
-  Sound(Message& message,
-        const ci::JsonTree& params) :
+  struct Stats {
+    u_int  entries;
+    u_int  loaded;
+    u_int  loading;
+    u_int  pending;
+    u_int  dropped;
+    u_int  failed;
+    // 読み込みにかかった時間の合計(秒)
+    double load_time;
+
+    // 全categoryの声の合計
+    VoicePool::Stats voices;
+
+    // playで受け取った指示と、待ち行列がいっぱいで捨てた指示
+    u_int  commands;
+    u_int  command_drops;
+  };
+
+
+  Sound(Message& message, const ci::JsonTree& params, std::unique_ptr<SoundBackend> backend) :
     message_(message),
-    params_(params)
+    backend_(std::move(backend)),
+    quit_(false),
+    commands_(params.getValueForKey<size_t>("soundLoader.queueSize")),
+    command_num_(0),
+    max_delay_(params.getValueForKey<double>("soundLoader.maxDelay")),
+    loaded_num_(0),
+    load_time_(0.0),
+    dropped_num_(0),
+    failed_num_(0)
   {
-    auto* ctx = ci::audio::Context::master();
-    ctx->enable();
-
-    // TIPS:文字列による処理の分岐をstd::mapとラムダ式で実装
-    std::map<std::string,
-             std::function<void (ci::audio::Context*, const ci::JsonTree&)> > creator = {
-      { "file", 
-        [this](ci::audio::Context* ctx, const ci::JsonTree& param) {
-          source_.insert({ param["name"].getValue<std::string>(),
-                ci::audio::load(ci::app::loadAsset(param["path"].getValue<std::string>())) });
-
-          const auto& category = param["category"].getValue<std::string>();
-          if (file_node_.find(category) == file_node_.end()) {
-            FileNode node = {
-              ctx->makeNode(new ci::audio::FilePlayerNode()),
-              ctx->makeNode(new ci::audio::GainNode(1.0f)),
-            };
-            file_node_.insert({ category, node });
-
-            category_node_.insert({ category, node.node });
-          }
-        }
-      },
-
-      { "buffer",
-        [this](ci::audio::Context* ctx, const ci::JsonTree& param) {
-          auto source = ci::audio::load(ci::app::loadAsset(param["path"].getValue<std::string>()));
-          buffer_.insert({ param["name"].getValue<std::string>(),
-                source->loadBuffer() });
-
-          const auto& category = param["category"].getValue<std::string>();
-          if (buffer_node_.find(category) == buffer_node_.end()) {
-            BufferNode node = {
-              ctx->makeNode(new ci::audio::BufferPlayerNode()),
-              ctx->makeNode(new ci::audio::GainNode(1.0f))
-            };
-            buffer_node_.insert({ category, node });
-
-            category_node_.insert({ category, node.node });
-          }
-        }
-      }
-    };
+    command_drops_ = 0;
+    // TIPS:1回のupdateで受け取る指示の数だけ確保しておき、鳴らす時には確保しない
+    pending_.reserve(params.getValueForKey<size_t>("soundLoader.queueSize"));
 
-    const auto& sound = params_["sound"];
-    for (const auto& it : sound) {
+    std::vector<Handle> preloads;
+    for (const auto& it : params["sound"]) {
       Object object = {
         it["type"].getValue<std::string>(),
         it["category"].getValue<std::string>(),
+        it["path"].getValue<std::string>(),
         it["loop"].getValue<bool>(),
-        it["gain"].getValue<float>()
+        it["gain"].getValue<float>(),
+        it.hasChild("priority") ? it["priority"].getValue<int>() : 0,
+        0,
+        STATE_NONE,
+        boost::any()
       };
 
-      const auto& name = it["name"].getValue<std::string>();
-      objects_.insert({ name, object });
+      // TIPS:声はここで全て用意して、鳴らす時には作らない
+      object.voice_index = findVoices(object.category);
+      if (object.voice_index == voices_.size()) {
+        size_t num = voiceNum(params["soundLoader"], object.category);
+        Voices voices = { object.category, object.type, VoicePool(num) };
+        voices_.push_back(std::move(voices));
+        backend_->setupVoices(object.type, object.voice_index, num);
+      }
+      else if (voices_[object.voice_index].type != object.type) {
+        // 違うtypeの声では鳴らせないので登録しない
+        DOUT << "Sound type mismatch:" << it["name"].getValue<std::string>()
+             << " " << object.category << " is " << voices_[object.voice_index].type << std::endl;
+        continue;
+      }
+
+      Handle handle = Handle(objects_.size());
+      objects_.push_back(std::move(object));
+      handles_.insert({ it["name"].getValue<std::string>(), handle });
 
-      creator[object.type](ctx, it);
+      if (it.hasChild("preload") && it["preload"].getValue<bool>()) {
+        preloads.push_back(handle);
+      }
+    }
+
+    thread_ = std::thread([this]() { loadThread(); });
+    for (auto handle : preloads) {
+      request(handle, false);
     }
-    
-    connection_holder_ += message.connect(Msg::SOUND_PLAY, this, &Sound::play);
+
+    connection_holder_ += message.connect(Msg::SOUND_PLAY, this, &Sound::playMessage);
     connection_holder_ += message.connect(Msg::SOUND_STOP, this, &Sound::stop);
+    connection_holder_ += message.connect(Msg::SOUND_PRELOAD, this, &Sound::preloadMessage);
   }
-  
+
+  ~Sound() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      quit_ = true;
+    }
+    wakeup_.notify_all();
+    thread_.join();
+  }
+
+
+  // 名前から番号を調べる(見つからなければINVALID_HANDLE)
+  Handle handle(const std::string& name) const {
+    auto it = handles_.find(name);
+    if (it == std::end(handles_)) return INVALID_HANDLE;
+    return it->second;
+  }
+
+  // 鳴らす指示を待ち行列に積むだけ(どのスレッドから呼んでもよい)
+  // TIPS:確保もロックもしない。いっぱいなら捨てる
+  void play(const Handle handle, const float gain = 1.0f) {
+    Command command = { handle, gain };
+    if (!commands_.push(command)) command_drops_ += 1;
+  }
+
+
+  // 読み込めた音源を受け取り、待っていた音を鳴らす
+  // TIPS:毎フレーム、メインスレッドから呼ぶ
+  void update() {
+    releaseVoices();
+
+    std::deque<Result> results;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      results.swap(results_);
+    }
+    for (auto& result : results) {
+      auto& object = objects_[result.handle];
+      object.state  = result.source.empty() ? STATE_ERROR : STATE_READY;
+      object.source = std::move(result.source);
+
+      loaded_num_ += 1;
+      load_time_  += result.load_time;
+    }
+
+    if (!pending_.empty()) startPending();
+
+    Command command;
+    while (commands_.pop(command)) {
+      command_num_ += 1;
+      start(command.handle, command.gain);
+    }
+  }
+
+  // 読み込みを始めておく
+  void preload(const std::string& name) {
+    Handle handle = this->handle(name);
+    if (handle == INVALID_HANDLE) return;
+
+    request(handle, false);
+  }
+
+  bool isReady(const std::string& name) const {
+    Handle handle = this->handle(name);
+    return (handle != INVALID_HANDLE) && (objects_[handle].state == STATE_READY);
+  }
+
+
+  Stats stats() const {
+    Stats stats = {
+      u_int(objects_.size()),
+      loaded_num_,
+      0,
+      u_int(pending_.size()),
+      dropped_num_,
+      failed_num_,
+      load_time_,
+      {},
+      command_num_,
+      command_drops_
+    };
+    for (const auto& object : objects_) {
+      if (object.state == STATE_LOADING) stats.loading += 1;
+    }
+    for (const auto& voices : voices_) {
+      auto pool = voices.pool.stats();
+      stats.voices.voices  += pool.voices;
+      stats.voices.active  += pool.active;
+      stats.voices.peak    += pool.peak;
+      stats.voices.steals  += pool.steals;
+      stats.voices.rejects += pool.rejects;
+    }
+    return stats;
+  }
+
+  const SoundBackend& backend() const { return *backend_; }
+
 
 private:
-  void play(const Message::Connection& connection, Param& params) {
-    auto* ctx = ci::audio::Context::master();
-
-    // TIPS:文字列による分岐をstd::mapとラムダ式で実装
-    // TODO:ラムダ式で事前に生成できないか??
-    std::map<std::string,
-             std::function<ci::audio::NodeRef (const std::string&, const Object&, const float)> > assign = {
-      { "file",
-        [this](const std::string& name, const Object& object, const float gain) {
-          auto& source = source_.at(name);
-          auto& node = file_node_.at(object.category);
-
-          if (node.node->isConnectedToOutput(node.gain)) {
-            node.node->stop();
-          }
-          
-          node.node->setSourceFile(source);
-          node.node->setLoopEnabled(object.loop);
-          node.gain->setValue(object.gain * gain);
-
-          node.node->enable();
-          
-          node.node >> node.gain;
-          
-          return node.gain;
-        }
-      },
+  // urgent:鳴らすのを待っているので、先に読み込む
+  void request(const Handle handle, const bool urgent) {
+    auto& object = objects_[handle];
+    if (object.state == STATE_LOADING) {
+      // 事前読み込みで積んだまま待っているなら先頭へ移す
+      if (urgent) hurryRequest(handle);
+      return;
+    }
+    if (object.state != STATE_NONE) return;
+    object.state = STATE_LOADING;
+
+    Request request = { handle, object.type, object.path };
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (urgent) {
+        requests_.push_front(std::move(request));
+      }
+      else {
+        requests_.push_back(std::move(request));
+      }
+    }
+    wakeup_.notify_one();
+  }
+
+  // TIPS:読み込み用のスレッドが取り出し済みなら何もしない
+  void hurryRequest(const Handle handle) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = std::find_if(std::begin(requests_), std::end(requests_),
+                           [handle](const Request& request) { return request.handle == handle; });
+    if ((it == std::end(requests_)) || (it == std::begin(requests_))) return;
+
+    Request request = std::move(*it);
+    requests_.erase(it);
+    requests_.push_front(std::move(request));
+  }
+
+  void loadThread() {
+    while (true) {
+      Request request;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        wakeup_.wait(lock, [this]() { return quit_ || !requests_.empty(); });
+        if (quit_) return;
 
-      { "buffer",
-        [this](const std::string& name, const Object& object, const float gain) {
-          auto& buffer = buffer_.at(name);
-          auto& node = buffer_node_.at(object.category);
+        request = std::move(requests_.front());
+        requests_.pop_front();
+      }
+
+      auto start  = Clock::now();
+      auto source = backend_->load(request.type, request.path);
+      Result result = {
+        request.handle,
+        std::move(source),
+        std::chrono::duration<double>(Clock::now() - start).count()
+      };
 
-          if (node.node->isConnectedToOutput(node.gain)) {
-            node.node->stop();
-          }
-          
-          node.node->setBuffer(buffer);
-          node.node->setLoopEnabled(object.loop);
-          node.gain->setValue(object.gain * gain);
+      std::lock_guard<std::mutex> lock(mutex_);
+      results_.push_back(std::move(result));
+    }
+  }
 
-          node.node->enable();
 
-          node.node >> node.gain;
+  size_t findVoices(const std::string& category) const {
+    for (size_t i = 0; i < voices_.size(); ++i) {
+      if (voices_[i].category == category) return i;
+    }
+    return voices_.size();
+  }
 
-          return node.gain;
+  // categoryに設定が無ければdefaultVoices
+  static size_t voiceNum(const ci::JsonTree& params, const std::string& category) {
+    size_t num = params.getValueForKey<size_t>("defaultVoices");
+    if (params.hasChild("voices") && params["voices"].hasChild(category)) {
+      num = params["voices"][category].getValue<size_t>();
+    }
+    return std::max(num, size_t(1));
+  }
+
+  // 鳴り終わった声を空ける
+  void releaseVoices() {
+    for (size_t index = 0; index < voices_.size(); ++index) {
+      auto& pool = voices_[index].pool;
+      for (size_t i = 0; i < pool.size(); ++i) {
+        if (pool.isActive(i) && !backend_->isPlaying(index, i)) {
+          pool.release(i);
         }
       }
-    };
+    }
+  }
+
+  // 読み込めた音を、指示された順に鳴らす
+  void startPending() {
+    auto now = Clock::now();
+    size_t num = 0;
+    for (size_t i = 0; i < pending_.size(); ++i) {
+      const auto& pending = pending_[i];
+      const auto& object  = objects_[pending.handle];
+      if (object.state == STATE_LOADING) {
+        double delay = std::chrono::duration<double>(now - pending.time).count();
+        if (object.loop || (delay < max_delay_)) {
+          pending_[num] = pending;
+          num += 1;
+          continue;
+        }
+        dropped_num_ += 1;
+        continue;
+      }
+      if (object.state == STATE_READY) {
+        startVoice(object, pending.gain);
+        continue;
+      }
+      DOUT << "Sound not loaded:" << object.path << std::endl;
+      failed_num_ += 1;
+    }
+    pending_.resize(num);
+  }
+
+  // 読み込んでいなければ読み込みを急がせ、読み込めたら鳴らす
+  void start(const Handle handle, const float gain) {
+    if (handle >= objects_.size()) return;
+
+    auto& object = objects_[handle];
+    switch (object.state) {
+    case STATE_READY:
+      startVoice(object, gain);
+      return;
+
+    case STATE_ERROR:
+      return;
+    }
+
+    request(handle, true);
+    Pending pending = { handle, gain, Clock::now() };
+    pending_.push_back(std::move(pending));
+  }
+
+  void startVoice(const Object& object, const float gain) {
+    int voice = voices_[object.voice_index].pool.allocate(object.priority);
+    if (voice < 0) return;
+
+    backend_->play(object.voice_index, voice, object.source, object.loop, object.gain * gain);
+  }
+
+  void stopVoices(const size_t index) {
+    auto& pool = voices_[index].pool;
+    for (size_t i = 0; i < pool.size(); ++i) {
+      if (!pool.isActive(i)) continue;
+
+      backend_->stop(index, i);
+      pool.release(i);
+    }
+  }
 
+
+  // TIPS:メインスレッドから呼ばれるので、待ち行列を通さずに鳴らす
+  void playMessage(const Message::Connection& connection, Param& params) {
     const auto& name = boost::any_cast<const std::string& >(params["name"]);
-    const auto& object = objects_[name];
+    Handle handle = this->handle(name);
+    if (handle == INVALID_HANDLE) {
+      DOUT << "Sound not found:" << name << std::endl;
+      return;
+    }
+
     float gain = (params.find("gain") != params.end()) ? boost::any_cast<float>(params["gain"])
                                                        : 1.0f;
-    auto node = assign[object.type](name, object, gain);
-    node >> ctx->getOutput();
+    start(handle, gain);
   }
 
   void stop(const Message::Connection& connection, Param& params) {
     if (params.find("category") != params.end()) {
       const auto& category = boost::any_cast<const std::string& >(params["category"]);
-      if (category_node_.find(category) != category_node_.end()) {
-        auto node = category_node_.at(category);
-        node->stop();
-      }
+      cancelPending(category);
+      size_t index = findVoices(category);
+      if (index < voices_.size()) stopVoices(index);
     }
     else {
       // category指定が無い場合はすべて止める
-      // FIXME:std::mapのイテレート
-      for (auto& it : category_node_) {
-        it.second->stop();
+      pending_.clear();
+      for (size_t i = 0; i < voices_.size(); ++i) {
+        stopVoices(i);
       }
     }
   }
 
+  void preloadMessage(const Message::Connection& connection, Param& params) {
+    preload(boost::any_cast<const std::string& >(params["name"]));
+  }
+
+  void cancelPending(const std::string& category) {
+    auto it = std::remove_if(std::begin(pending_), std::end(pending_),
+                             [this, &category](const Pending& pending) {
+                               return objects_[pending.handle].category == category;
+                             });
+    pending_.erase(it, std::end(pending_));
+  }
+
 };
 
 }
@@ -0,0 +1,163 @@
+﻿#pragma once
+
+//
+// 音の再生の実装部
+// このクラス自体は何も鳴らさない(音の出ない環境や検証用)
+// 読み込みと再生の回数だけを数える
+// 声(再生ノード)はcategoryごとにsetupVoicesで用意し、categoryの番号(pool)と声の番号で鳴らす
+// TIPS:鳴らす時に名前で探さないよう、poolはSound側で決めた番号をそのまま使う
+//
+// TIPS:loadは読み込み用のスレッドから呼ばれる。それ以外はメインスレッドから
+//
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/any.hpp>
+
+
+namespace ngs {
+
+class SoundBackend {
+public:
+  struct Stats {
+    u_int loads;
+    u_int plays;
+    u_int stops;
+    // mixを呼んだ回数と、かかった時間の合計(秒)
+    u_int  mixes;
+    double mix_time;
+  };
+
+
+protected:
+  typedef std::chrono::steady_clock Clock;
+
+  // 読み込みにかかる時間(秒)。検証用に重さを真似る
+  double load_time_;
+
+  std::atomic<u_int> loads_;
+  u_int plays_;
+  u_int stops_;
+
+
+private:
+  // 鳴っている声を真似る
+  struct Voice {
+    bool  playing;
+    bool  loop;
+    float gain;
+    Clock::time_point end;
+  };
+
+  // poolの番号で引く
+  std::vector<std::vector<Voice> > voices_;
+  // 1つの音が鳴っている時間(秒)
+  double voice_time_;
+
+  // mix用(鳴らす時に確保しないよう、最初に用意しておく)
+  std::vector<float> samples_;
+  std::vector<float> mix_buffer_;
+
+  u_int  mixes_;
+  double mix_time_;
+
+
+public:
+  explicit SoundBackend(const double load_time = 0.0, const double voice_time = 0.0) :
+    load_time_(load_time),
+    plays_(0),
+    stops_(0),
+    voice_time_(voice_time),
+    mixes_(0),
+    mix_time_(0.0)
+  {
+    loads_ = 0;
+  }
+
+  virtual ~SoundBackend() = default;
+
+
+  // 音源の読み込みとデコード(失敗したら空を返す)
+  // type:"file"はストリーミング再生、"buffer"はメモリに展開して再生
+  virtual boost::any load(const std::string& type, const std::string& path) {
+    if (load_time_ > 0.0) {
+      std::this_thread::sleep_for(std::chrono::duration<double>(load_time_));
+    }
+    loads_ += 1;
+    return boost::any(path);
+  }
+
+  // poolで同時に鳴らせる声をnum個用意する
+  virtual void setupVoices(const std::string& type, const size_t pool, const size_t num) {
+    if (voices_.size() <= pool) voices_.resize(pool + 1);
+
+    Voice voice = { false, false, 0.0f, Clock::time_point() };
+    voices_[pool].assign(num, voice);
+  }
+
+  // 指定の声で鳴らす(その声で鳴っている音は止める)
+  virtual void play(const size_t pool, const size_t voice,
+                    const boost::any& source, const bool loop, const float gain) {
+    plays_ += 1;
+
+    auto& v = voices_[pool][voice];
+    v.playing = true;
+    v.loop    = loop;
+    v.gain    = gain;
+    v.end     = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(voice_time_));
+  }
+
+  virtual void stop(const size_t pool, const size_t voice) {
+    stops_ += 1;
+    voices_[pool][voice].playing = false;
+  }
+
+  virtual bool isPlaying(const size_t pool, const size_t voice) const {
+    const auto& v = voices_[pool][voice];
+    return v.playing && (v.loop || (Clock::now() < v.end));
+  }
+
+
+  // 鳴っている声を1ブロック分混ぜる
+  // TIPS:音の出ない環境で、同時に鳴る声の数による重さを計るためのもの
+  void mix(const size_t frames) {
+    auto start = Clock::now();
+
+    if (samples_.empty()) {
+      // 適当な波形(毎回作らない)
+      samples_.resize(4096);
+      for (size_t i = 0; i < samples_.size(); ++i) {
+        samples_[i] = float((i * 2654435761u) % 2001) / 1000.0f - 1.0f;
+      }
+    }
+    mix_buffer_.assign(frames, 0.0f);
+
+    size_t offset = 0;
+    for (size_t pool = 0; pool < voices_.size(); ++pool) {
+      for (size_t i = 0; i < voices_[pool].size(); ++i) {
+        if (!isPlaying(pool, i)) continue;
+
+        const auto& v = voices_[pool][i];
+        offset += 997;
+        for (size_t f = 0; f < frames; ++f) {
+          mix_buffer_[f] += v.gain * samples_[(offset + f) % samples_.size()];
+        }
+      }
+    }
+
+    mixes_    += 1;
+    mix_time_ += std::chrono::duration<double>(Clock::now() - start).count();
+  }
+
+
+  Stats stats() const {
+    Stats stats = { loads_, plays_, stops_, mixes_, mix_time_ };
+    return stats;
+  }
+
+};
+
+}
@@ -0,0 +1,311 @@
+﻿#pragma once
+
+//
+// 音源の読み込みの計測(headless用)
+// 音の出ないSoundBackendで読み込みの重さだけを真似て、
+// 生成時に全て読み込む以前の方法と、読み込み用のスレッドで読む方法とで最初のフレームまでの時間を比べる
+//
+// TIPS:半分の音源に事前読み込みを指定し、残りの1つを鳴らして鳴るまでの時間も計る
+//
+// 続けて、短い効果音を毎フレーム鳴らし(崩落や転がる音を真似る)
+// 声の使われ方と、1ブロック混ぜるのにかかる時間を計る
+//
+// 最後に、別のスレッドから1秒間に1万回play(handle)を呼び、1回あたりの時間と届いた数を計る
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "cinder/Json.h"
+#include "cinder/Timer.h"
+#include "Message.hpp"
+#include "Sound.hpp"
+#include "SoundBackend.hpp"
+
+
+namespace ngs {
+
+class SoundBench {
+public:
+  struct Report {
+    u_int entries;
+    u_int preloads;
+    // 1つの音源の読み込みにかかる時間(真似る時間)
+    double load_time;
+
+    // 以前の方法:生成時に全て読み込む
+    double eager_time;
+    // 生成と最初のupdate
+    double first_frame_time;
+    // 事前読み込みが全て終わるまで
+    double preload_time;
+
+    // 読み込んでいない音を鳴らす指示から、鳴るまで
+    bool   played;
+    double play_latency;
+
+    // 声の割り当て
+    u_int  voice_frames;
+    u_int  voice_plays;
+    VoicePool::Stats voices;
+    // 1ブロック(mix_frames)混ぜるのにかかった時間の平均
+    u_int  mix_frames;
+    double mix_time;
+
+    // 別のスレッドからのplay
+    u_int  play_calls;
+    double play_call_time;
+    double play_call_max;
+    u_int  commands;
+    u_int  command_drops;
+  };
+
+
+  static Report run(const ci::JsonTree& params, const u_int entries) {
+    Report report = {};
+    report.entries   = std::max(entries, 2u);
+    report.preloads  = (report.entries + 1) / 2;
+    report.load_time = params.getValueForKey<double>("soundLoader.benchLoadTime");
+
+    auto bench_params = makeParams(params, report.entries);
+
+    {
+      SoundBackend backend(report.load_time);
+      ci::Timer timer(true);
+      for (u_int i = 0; i < report.entries; ++i) {
+        backend.load("buffer", name(i));
+      }
+      report.eager_time = timer.getSeconds();
+    }
+
+    Message message;
+    ci::Timer timer(true);
+    Sound sound(message, bench_params,
+                std::unique_ptr<SoundBackend>(new SoundBackend(report.load_time)));
+    sound.update();
+    report.first_frame_time = timer.getSeconds();
+
+    // 事前読み込みしていない音を鳴らす(読み込みを待たずに戻る)
+    ci::Timer play_timer(true);
+    Param play = {
+      { "name", name(1) },
+    };
+    message.signal(Msg::SOUND_PLAY, play);
+
+    // TIPS:読み込みが止まった時に抜けられるよう、全て読む時間の数倍で打ち切る
+    double timeout = std::max(report.load_time * report.entries * 4.0, 1.0);
+    while (timer.getSeconds() < timeout) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      sound.update();
+
+      if (!report.played && (sound.backend().stats().plays > 0)) {
+        report.played       = true;
+        report.play_latency = play_timer.getSeconds();
+      }
+
+      bool preloaded = true;
+      for (u_int i = 0; i < report.entries; i += 2) {
+        if (!sound.isReady(name(i))) {
+          preloaded = false;
+          break;
+        }
+      }
+      if (preloaded && (report.preload_time == 0.0)) {
+        report.preload_time = timer.getSeconds();
+      }
+      if (preloaded && report.played) break;
+    }
+
+    runVoices(params, report);
+    runCommands(params, report);
+    return report;
+  }
+
+  static void print(std::ostream& output, const Report& report) {
+    output << "sound entries:" << report.entries
+           << " preloads:" << report.preloads
+           << " load time:" << report.load_time * 1000.0 << "ms"
+           << std::endl;
+
+    output << "eager load:" << report.eager_time * 1000.0 << "ms"
+           << std::endl;
+
+    output << "first frame:" << report.first_frame_time * 1000.0 << "ms"
+           << " preloaded:" << report.preload_time * 1000.0 << "ms"
+           << std::endl;
+
+    output << "play latency:";
+    if (report.played) {
+      output << report.play_latency * 1000.0 << "ms";
+    }
+    else {
+      output << "NG";
+    }
+    output << std::endl;
+
+    output << "voice frames:" << report.voice_frames
+           << " plays:" << report.voice_plays
+           << " voices:" << report.voices.voices
+           << " peak:" << report.voices.peak
+           << " steals:" << report.voices.steals
+           << " rejects:" << report.voices.rejects
+           << std::endl;
+
+    output << "mix:" << report.mix_time * 1000.0 << "ms"
+           << " per " << report.mix_frames << " frames"
+           << std::endl;
+
+    output << "play calls:" << report.play_calls
+           << " avg:" << report.play_call_time * 1000000000.0 << "ns"
+           << " max:" << report.play_call_max * 1000000000.0 << "ns"
+           << " delivered:" << report.commands
+           << " drops:" << report.command_drops
+           << std::endl;
+  }
+
+
+private:
+  // 毎フレーム1つずつ効果音を鳴らす
+  static void runVoices(const ci::JsonTree& params, Report& report) {
+    const u_int voice_entries = 4;
+    report.voice_frames = 500;
+    report.mix_frames   = 512;
+
+    // TIPS:Soundに渡した後もmixを呼べるよう、ポインタを残しておく
+    auto* backend = new SoundBackend(0.0, params.getValueForKey<double>("soundLoader.benchVoiceTime"));
+    Message message;
+    Sound sound(message, makeVoiceParams(params, voice_entries),
+                std::unique_ptr<SoundBackend>(backend));
+
+    // 全て読み込まれるまで待つ
+    ci::Timer timer(true);
+    while (timer.getSeconds() < 1.0) {
+      sound.update();
+      if (sound.stats().loaded == voice_entries) break;
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    for (u_int i = 0; i < report.voice_frames; ++i) {
+      Param play = {
+        { "name", voiceName(i % voice_entries) },
+      };
+      message.signal(Msg::SOUND_PLAY, play);
+
+      sound.update();
+      backend->mix(report.mix_frames);
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    const auto& stats = backend->stats();
+    report.voice_plays = stats.plays;
+    report.voices      = sound.stats().voices;
+    report.mix_time    = stats.mix_time / std::max(stats.mixes, 1u);
+  }
+
+  // 1万回/秒の間隔で別のスレッドから鳴らし、メインスレッドは1msごとにupdateする
+  static void runCommands(const ci::JsonTree& params, Report& report) {
+    typedef std::chrono::steady_clock Clock;
+
+    const u_int voice_entries = 4;
+    report.play_calls = 10000;
+
+    Message message;
+    Sound sound(message, makeVoiceParams(params, voice_entries),
+                std::unique_ptr<SoundBackend>(new SoundBackend(0.0, params.getValueForKey<double>("soundLoader.benchVoiceTime"))));
+
+    // TIPS:名前から番号を調べるのは最初だけ
+    std::vector<Sound::Handle> handles;
+    for (u_int i = 0; i < voice_entries; ++i) {
+      handles.push_back(sound.handle(voiceName(i)));
+    }
+
+    std::atomic<bool> finished(false);
+    double total = 0.0;
+    double max   = 0.0;
+    std::thread producer([&]() {
+      auto start = Clock::now();
+      for (u_int i = 0; i < report.play_calls; ++i) {
+        auto due = start + std::chrono::microseconds(100 * i);
+        while (Clock::now() < due) std::this_thread::yield();
+
+        auto begin = Clock::now();
+        sound.play(handles[i % voice_entries], 1.0f);
+        double time = std::chrono::duration<double>(Clock::now() - begin).count();
+        total += time;
+        max = std::max(max, time);
+      }
+      finished = true;
+    });
+
+    while (!finished) {
+      sound.update();
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    producer.join();
+    sound.update();
+
+    auto stats = sound.stats();
+    report.play_call_time = total / report.play_calls;
+    report.play_call_max  = max;
+    report.commands       = stats.commands;
+    report.command_drops  = stats.command_drops;
+  }
+
+  static std::string voiceName(const u_int index) {
+    return "voice_" + std::to_string(index);
+  }
+
+  // 同じcategoryで優先度の違う効果音を並べる
+  static ci::JsonTree makeVoiceParams(const ci::JsonTree& params, const u_int entries) {
+    auto sound = ci::JsonTree::makeArray("sound");
+    for (u_int i = 0; i < entries; ++i) {
+      auto entry = ci::JsonTree::makeObject();
+      entry.addChild(ci::JsonTree("name", voiceName(i)));
+      entry.addChild(ci::JsonTree("type", std::string("buffer")));
+      entry.addChild(ci::JsonTree("category", std::string("se")));
+      entry.addChild(ci::JsonTree("path", voiceName(i) + ".ogg"));
+      entry.addChild(ci::JsonTree("gain", 1.0));
+      entry.addChild(ci::JsonTree("loop", false));
+      entry.addChild(ci::JsonTree("priority", int(i % 2)));
+      entry.addChild(ci::JsonTree("preload", true));
+      sound.pushBack(entry);
+    }
+
+    auto result = ci::JsonTree::makeObject();
+    result.addChild(params["soundLoader"]);
+    result.addChild(sound);
+    return result;
+  }
+
+  static std::string name(const u_int index) {
+    return "bench_" + std::to_string(index);
+  }
+
+  // 偶数番目だけ事前読み込みする音源をentries個並べる
+  static ci::JsonTree makeParams(const ci::JsonTree& params, const u_int entries) {
+    auto sound = ci::JsonTree::makeArray("sound");
+    for (u_int i = 0; i < entries; ++i) {
+      auto entry = ci::JsonTree::makeObject();
+      entry.addChild(ci::JsonTree("name", name(i)));
+      entry.addChild(ci::JsonTree("type", std::string("buffer")));
+      entry.addChild(ci::JsonTree("category", "se" + std::to_string(i % 4)));
+      entry.addChild(ci::JsonTree("path", name(i) + ".ogg"));
+      entry.addChild(ci::JsonTree("gain", 1.0));
+      entry.addChild(ci::JsonTree("loop", false));
+      entry.addChild(ci::JsonTree("preload", (i % 2) == 0));
+      sound.pushBack(entry);
+    }
+
+    auto result = ci::JsonTree::makeObject();
+    result.addChild(params["soundLoader"]);
+    result.addChild(sound);
+    return result;
+  }
+
+};
+
+}
@@ -6,13 +6,20 @@
 
 #include "GameEnvironment.hpp"
 #include <deque>
+#include <map>
 #include <vector>
 #include "Message.hpp"
 #include "Entity.hpp"
 #include "StageCube.hpp"
+#include "StageChunk.hpp"
+#include "RenderQueue.hpp"
+#include "cinder/Timer.h"
+#include "Random.hpp"
 #include "Task.hpp"
 #include "TimerTask.hpp"
 #include "LapTimer.hpp"
+#include "WorldState.hpp"
+#include "FlowField.hpp"
 
 
 namespace ngs {
@@ -23,8 +30,40 @@ class Stage : public Entity {
 
   bool active_;
 
+  // 待ち合わせの通知
+  enum {
+    // 1行生成した
+    EVENT_LINE_BUILT,
+    // 崩壊か生成が止まった
+    EVENT_TIMER_STOPPED
+  };
+
+  // 登録中の待ち合わせ(スナップショットから復元する時に登録し直す)
+  enum {
+    WAIT_TIMER_STOPPED = 1 << 0,
+    WAIT_LINE_BUILT    = 1 << 1
+  };
+
   Task tasks_;
-  TimerTask<double> timer_tasks_;
+  int waiting_;
+
+  // 時間経過で行う処理
+  // TIPS:関数オブジェクトではなくデータで積んでおくと、そのまま保存できる
+  enum {
+    TIMER_CREATE_PLAYER,
+    TIMER_CREATE_ENEMY,
+    // 追加演出の終わった行をStageへ追加
+    TIMER_ADD_LINE,
+    // 崩壊と生成が止まるのを待って次のstageへ
+    TIMER_NEXT_STAGE
+  };
+
+  struct TimerEvent {
+    int type;
+    ci::Vec3i pos;
+  };
+
+  TimerTask<double, TimerEvent> timer_tasks_;
 
   u_int current_stage_;
   u_int stage_num_;
@@ -40,16 +79,37 @@ class Stage : public Entity {
   size_t collapse_index_;
 
   LapTimer<double> build_timer_;
+
+  // TIPS:演出ごとに系統を分けて、互いの乱数の使い方に影響されないようにする
+  Random collapse_rand_;
+  Random entry_rand_;
+  // 1行分の乱数
+  std::vector<float> random_values_;
+
+  // 状態の公開先
+  WorldState* world_;
+  // 敵の道しるべ(行が変わったら知らせる)
+  FlowField* flow_;
   
   std::deque<std::vector<StageCube> > cubes_;
   std::deque<std::vector<StageCube> > active_cubes_;
 
+  // 追加演出中の行(TIMER_ADD_LINEで取り出す)
+  std::map<int, std::vector<StageCube> > entry_lines_;
+  int entry_line_num_;
+
   size_t start_block_length_;
   size_t goal_block_length_;
   size_t field_block_length_;
 
   size_t stage_block_length_;
 
+  // 描画は一定の行数ごとにまとめて判定
+  int chunk_length_;
+  std::deque<StageChunk> chunks_;
+  // falseなら視錐台で判定せずに全chunkを描画(計測用)
+  bool chunk_culling_;
+
   int start_line_;
   int finish_line_;
   int next_start_line_;
@@ -62,38 +122,169 @@ public:
     message_(message),
     params_(params),
     active_(true),
+    waiting_(0),
+    timer_tasks_(1.0 / params.getValueForKey<double>("app.tickRate")),
     current_stage_(0),
+    width_(0.0f),
     collapse_index_(0),
+    world_(nullptr),
+    flow_(nullptr),
+    entry_line_num_(0),
     start_line_(0),
     finish_line_(0),
     next_start_line_(0),
     started_(false)
   { }
 
-  void setup(boost::shared_ptr<Stage> obj_sp) {
+  // id:乱数列の番号(作り直すたびに変わる)
+  void setup(boost::shared_ptr<Stage> obj_sp, const u_int seed, const u_int id,
+             WorldState& world, FlowField& flow) {
+    collapse_rand_.seed(seed, RANDOM_STAGE_COLLAPSE, id);
+    entry_rand_.seed(seed, RANDOM_STAGE_ENTRY, id);
+    world_ = &world;
+    flow_  = &flow;
+    // 前のStageの行を残さない
+    flow_->clear();
+
+    readParams();
+    connect(obj_sp);
+  }
+
+  // スナップショットから復元
+  void restore(boost::shared_ptr<Stage> obj_sp, BinaryReader& reader,
+               WorldState& world, FlowField& flow) {
+    readParams();
+    world_ = &world;
+    flow_  = &flow;
+
+    transfer(*this, reader);
+    collapse_timer_.load(reader);
+    build_timer_.load(reader);
+    collapse_rand_.load(reader);
+    entry_rand_.load(reader);
+    timer_tasks_.load(reader);
+
+    loadLines(reader, cubes_);
+    loadLines(reader, active_cubes_);
+
+    u_int entry_num;
+    reader.get(entry_num);
+    for (u_int i = 0; (i < entry_num) && reader.good(); ++i) {
+      int key;
+      reader.get(key);
+      loadLine(reader, entry_lines_[key]);
+    }
+
+    // 待ち合わせを登録し直す
+    int waiting = waiting_;
+    waiting_ = 0;
+    if (waiting & WAIT_TIMER_STOPPED) waitTimerStopped();
+    if (waiting & WAIT_LINE_BUILT)    waitLineBuilt();
+
+    // 描画用のchunkは作り直す
+    chunks_.clear();
+    updateChunks();
+
+    for (size_t i = 0; i < active_cubes_.size(); ++i) {
+      publishLine(i);
+    }
+    publish();
+    connect(obj_sp);
+  }
+
+  
+private:
+  void readParams() {
     cube_size_ = params_.getValueForKey<float>("cube.size");
 
     stage_block_length_ = params_.getValueForKey<size_t>("stage.startLength");
+    chunk_length_       = params_.getValueForKey<int>("stage.chunkLength");
+    chunk_culling_      = params_.getValueForKey<bool>("stage.chunkCulling");
 
     stage_num_ = params_["stage.data"].getNumChildren();
-    
+  }
+
+  void connect(boost::shared_ptr<Stage> obj_sp) {
     message_.connect(Msg::UPDATE, obj_sp, &Stage::update);
-    message_.connect(Msg::DRAW, obj_sp, &Stage::draw);
 
     message_.connect(Msg::SETUP_STAGE, obj_sp, &Stage::setupStage);
     message_.connect(Msg::RESET_STAGE, obj_sp, &Stage::inactive);
     
     message_.connect(Msg::CUBE_STAGE_HEIGHT, obj_sp, &Stage::stageHight);
-    
-    message_.connect(Msg::GATHER_INFORMATION, obj_sp, &Stage::gatherInfo);
 
     message_.connect(Msg::PARADE_START, obj_sp, &Stage::start);
     message_.connect(Msg::PARADE_FINISH, obj_sp, &Stage::finish);
+
+    message_.connect(Msg::PARAMS_CHANGED, obj_sp, &Stage::paramsChanged);
   }
 
-  
-private:
+
   bool isActive() const override { return active_; }
+  int type() const override { return ENTITY_STAGE; }
+
+
+  template <typename Self, typename Stream>
+  static void transfer(Self& self, Stream& stream) {
+    stream & self.waiting_ & self.current_stage_
+           & self.width_ & self.collapse_speed_ & self.build_speed_ & self.collapse_index_
+           & self.entry_line_num_
+           & self.start_block_length_ & self.goal_block_length_ & self.field_block_length_
+           & self.start_line_ & self.finish_line_ & self.next_start_line_
+           & self.started_;
+  }
+
+  void save(BinaryWriter& writer) const override {
+    transfer(*this, writer);
+    collapse_timer_.save(writer);
+    build_timer_.save(writer);
+    collapse_rand_.save(writer);
+    entry_rand_.save(writer);
+    timer_tasks_.save(writer);
+
+    saveLines(writer, cubes_);
+    saveLines(writer, active_cubes_);
+
+    writer.put(u_int(entry_lines_.size()));
+    for (const auto& it : entry_lines_) {
+      writer.put(it.first);
+      saveLine(writer, it.second);
+    }
+  }
+
+  static void saveLine(BinaryWriter& writer, const std::vector<StageCube>& line) {
+    writer.put(u_int(line.size()));
+    for (const auto& cube : line) {
+      cube.save(writer);
+    }
+  }
+
+  static void loadLine(BinaryReader& reader, std::vector<StageCube>& line) {
+    u_int num = 0;
+    reader.get(num);
+    line.clear();
+    for (u_int i = 0; (i < num) && reader.good(); ++i) {
+      StageCube cube;
+      cube.load(reader);
+      line.push_back(cube);
+    }
+  }
+
+  static void saveLines(BinaryWriter& writer, const std::deque<std::vector<StageCube> >& lines) {
+    writer.put(u_int(lines.size()));
+    for (const auto& line : lines) {
+      saveLine(writer, line);
+    }
+  }
+
+  static void loadLines(BinaryReader& reader, std::deque<std::vector<StageCube> >& lines) {
+    u_int num = 0;
+    reader.get(num);
+    lines.clear();
+    for (u_int i = 0; (i < num) && reader.good(); ++i) {
+      lines.emplace_back();
+      loadLine(reader, lines.back());
+    }
+  }
 
 
   void setupStage(const Message::Connection& connection, Param& params) {
@@ -150,6 +341,7 @@ private:
       
       active_cubes_.push_back(cubes_.front());
       cubes_.pop_front();
+      publishLine(active_cubes_.size() - 1);
     }
 
     {
@@ -160,6 +352,8 @@ private:
       };
       message_.signal(Msg::POST_STAGE_INFO, params);
     }
+
+    updateChunks();
   }
 
   void inactive(const Message::Connection& connection, Param& params) {
@@ -167,6 +361,14 @@ private:
   }
 
   void update(const Message::Connection& connection, Param& params) {
+    updateStage(params);
+    publish();
+
+    // 描画は複数のスレッドから行われるので、ここで更新しておく
+    updateChunks();
+  }
+
+  void updateStage(Param& params) {
     {
       // 光源の更新
       float z = (collapse_index_ + collapse_timer_.lapseRate()) * cube_size_;
@@ -179,41 +381,53 @@ private:
     }
     
     auto delta_time = boost::any_cast<double>(params.at("deltaTime"));
-    timer_tasks_(delta_time);
-    tasks_();
+    timer_tasks_(delta_time, [this](const TimerEvent& event) { timerEvent(event); });
 
     if (!started_) return;
     
     if (collapse_timer_(delta_time)) {
       // 一定時間ごとにステージ端が崩壊
       const auto& cube_line = active_cubes_.front();
-      for (const auto& cube : cube_line) {
+      // 落下速度は1行分まとめて生成(Cubeの有無によらず1列に1つ)
+      random_values_.resize(cube_line.size());
+      collapse_rand_.fill(random_values_.data(), random_values_.size());
+      for (size_t x = 0; x < cube_line.size(); ++x) {
+        const auto& cube = cube_line[x];
         if (!cube.isActive()) continue;
         
         Param params = {
           { "entry_pos", cube.posBlock() },
           { "color", cube.color() },
-          { "speed", 1.0f + ci::randFloat() }
+          { "speed", 1.0f + random_values_[x] }
         };
         
         message_.signal(Msg::CREATE_FALLCUBE, params);
       };
       active_cubes_.pop_front();
+      flow_->removeLine(int(collapse_index_));
+      // 隣の行の面が見えるようになる
+      chunkDirty(collapse_index_);
+      chunkDirty(collapse_index_ + 1);
       
       collapse_index_ += 1;
-      if (collapse_index_ == finish_line_) {
+      if (int(collapse_index_) == finish_line_) {
         collapse_timer_.stop();
+        tasks_.notify(EVENT_TIMER_STOPPED);
       }
     }
 
     if (build_timer_(delta_time)) {
       // 一定時間ごとにステージを生成
       // Cubeの追加演出
-      for (const auto& cube : cubes_.front()) {
+      const auto& cube_line = cubes_.front();
+      random_values_.resize(cube_line.size());
+      entry_rand_.fill(random_values_.data(), random_values_.size());
+      for (size_t x = 0; x < cube_line.size(); ++x) {
+        const auto& cube = cube_line[x];
         if (!cube.isActive()) continue;
 
         auto pos_block = cube.posBlock();
-        float y = (5.0f + ci::randFloat() * 1.0f) * cube_size_;
+        float y = (5.0f + random_values_[x] * 1.0f) * cube_size_;
         Param params = {
           { "entry_pos", pos_block },
           { "offset_y", y },
@@ -234,13 +448,8 @@ private:
               params["color"] = Json::getColor<float>(params_["CubePlayer.color"]);
               message_.signal(Msg::CREATE_ENTRYCUBE, params);
 
-              timer_tasks_.add(build_speed_, [this, pos_block]() {
-                  Param params = {
-                    { "entry_pos", pos_block },
-                    { "paused", true },
-                  };
-                  message_.signal(Msg::CREATE_CUBEPLAYER, params);
-                });
+              TimerEvent event = { TIMER_CREATE_PLAYER, pos_block };
+              timer_tasks_.add(build_speed_, event);
             }
             break;
 
@@ -249,12 +458,8 @@ private:
               params["color"] = Json::getColor<float>(params_["CubeEnemy.color"]);
               message_.signal(Msg::CREATE_ENTRYCUBE, params);
 
-              timer_tasks_.add(build_speed_, [this, pos_block]() {
-                  Param params = {
-                    { "entry_pos", pos_block }
-                  };
-                  message_.signal(Msg::CREATE_CUBEENEMY, params);
-                });
+              TimerEvent event = { TIMER_CREATE_ENEMY, pos_block };
+              timer_tasks_.add(build_speed_, event);
             }
             break;
           }
@@ -262,25 +467,228 @@ private:
       }
 
       // ステージの追加は追加演出の後に行うので、タスクに積んでおく
-      auto cube_line = cubes_.front();
-      timer_tasks_.add(build_speed_, [this, cube_line]() {
-          active_cubes_.push_back(cube_line);
-        });
+      entry_lines_[entry_line_num_] = cubes_.front();
+      TimerEvent event = { TIMER_ADD_LINE, ci::Vec3i(entry_line_num_, 0, 0) };
+      timer_tasks_.add(build_speed_, event);
+      entry_line_num_ += 1;
 
       cubes_.pop_front();
+      tasks_.notify(EVENT_LINE_BUILT);
       if (cubes_.empty()) {
         build_timer_.stop();
+        tasks_.notify(EVENT_TIMER_STOPPED);
+      }
+    }
+  }
+
+  void timerEvent(const TimerEvent& event) {
+    switch (event.type) {
+    case TIMER_CREATE_PLAYER:
+      {
+        Param params = {
+          { "entry_pos", event.pos },
+          { "paused", true },
+        };
+        message_.signal(Msg::CREATE_CUBEPLAYER, params);
+      }
+      break;
+
+    case TIMER_CREATE_ENEMY:
+      {
+        Param params = {
+          { "entry_pos", event.pos }
+        };
+        message_.signal(Msg::CREATE_CUBEENEMY, params);
+      }
+      break;
+
+    case TIMER_ADD_LINE:
+      {
+        auto it = entry_lines_.find(event.pos.x);
+        assert(it != std::end(entry_lines_));
+        active_cubes_.push_back(std::move(it->second));
+        entry_lines_.erase(it);
+        publishLine(active_cubes_.size() - 1);
+
+        int z = int(collapse_index_ + active_cubes_.size()) - 1;
+        chunkDirty(z - 1);
+        chunkDirty(z);
       }
+      break;
+
+    case TIMER_NEXT_STAGE:
+      // stageの全消去とGoal地点の生成を待って、次のstageの生成準備
+      waitTimerStopped();
+      break;
     }
   }
 
-  void draw(const Message::Connection& connection, Param& params) {
-    for (const auto& cube_line : active_cubes_) {
-      for (const auto& cube : cube_line) {
-        cube.draw();
+  void draw(RenderQueue::List& list) const override {
+    // chunk単位で判定し、見えているchunkは結合済みのメッシュを描画
+    // TIPS:一部だけ見えている場合もメッシュ1回の描画の方が安い
+    const auto& frustum = list.frustum();
+    for (const auto& chunk : chunks_) {
+      if (chunk.cube_num == 0) continue;
+
+      if (!chunk_culling_ || frustum.intersects(chunk.bounds)) {
+        list.visible(chunk.cube_num);
+        list.add(RenderQueue::STATE_LIT, RenderQueue::MATERIAL_COLOR, chunk.mesh);
+      }
+      else {
+        list.culled(chunk.cube_num);
       }
     }
   }
+
+
+  // chunkに含まれる表示中の行の範囲 [first, last)
+  void chunkLines(const int index, int& first, int& last) const {
+    int active_first = int(collapse_index_);
+    int active_last  = active_first + int(active_cubes_.size());
+
+    first = std::max(index * chunk_length_, active_first);
+    last  = std::min((index + 1) * chunk_length_, active_last);
+  }
+
+  void chunkDirty(const int z) {
+    if (chunks_.empty()) return;
+
+    int index = z / chunk_length_ - chunks_.front().index;
+    if ((index >= 0) && (index < int(chunks_.size()))) {
+      chunks_[index].dirty = true;
+    }
+  }
+
+  // 表示中の行に合わせてchunkを追加・削除し、変化したものを再計算
+  void updateChunks() {
+    if (active_cubes_.empty()) {
+      chunks_.clear();
+      return;
+    }
+
+    int first = int(collapse_index_) / chunk_length_;
+    int last  = int(collapse_index_ + active_cubes_.size() - 1) / chunk_length_;
+    while (!chunks_.empty() && (chunks_.front().index < first)) {
+      chunks_.pop_front();
+    }
+
+    int next = chunks_.empty() ? first : chunks_.back().index + 1;
+    for (int index = next; index <= last; ++index) {
+      StageChunk chunk = {
+        index,
+        true,
+        0,
+        ci::AxisAlignedBox3f(ci::Vec3f::zero(), ci::Vec3f::zero()),
+        CubeMesh()
+      };
+      chunks_.push_back(chunk);
+    }
+
+    u_int rebuild_num = 0;
+    ci::Timer timer(true);
+    for (auto& chunk : chunks_) {
+      if (!chunk.dirty) continue;
+
+      rebuildChunk(chunk);
+      rebuild_num += 1;
+    }
+    timer.stop();
+
+    if (rebuild_num > 0) postChunkInfo(rebuild_num, timer.getSeconds());
+  }
+
+  void rebuildChunk(StageChunk& chunk) {
+    chunk.dirty    = false;
+    chunk.cube_num = 0;
+    chunk.mesh.clear();
+
+    ci::Vec3f min_pos;
+    ci::Vec3f max_pos;
+
+    int first, last;
+    chunkLines(chunk.index, first, last);
+    for (int z = first; z < last; ++z) {
+      for (const auto& cube : active_cubes_[z - collapse_index_]) {
+        if (!cube.isActive()) continue;
+
+        auto bounds = cube.bounds();
+        if (chunk.cube_num == 0) {
+          min_pos = bounds.getMin();
+          max_pos = bounds.getMax();
+        }
+        else {
+          for (int i = 0; i < 3; ++i) {
+            min_pos[i] = std::min(min_pos[i], bounds.getMin()[i]);
+            max_pos[i] = std::max(max_pos[i], bounds.getMax()[i]);
+          }
+        }
+        chunk.cube_num += 1;
+
+        addCubeFaces(cube, z, chunk.mesh);
+      }
+    }
+
+    chunk.bounds = ci::AxisAlignedBox3f(min_pos, max_pos);
+  }
+
+  // 同じ高さのCubeと接している側面は見えないので省く
+  void addCubeFaces(const StageCube& cube, const int z, CubeMesh& mesh) const {
+    const auto& pos = cube.posBlock();
+
+    struct Side {
+      int face;
+      int dx;
+      int dz;
+    };
+    static const Side sides[] = {
+      { CubeGeometry::FACE_RIGHT,  1,  0 },
+      { CubeGeometry::FACE_LEFT,  -1,  0 },
+      { CubeGeometry::FACE_FRONT,  0,  1 },
+      { CubeGeometry::FACE_BACK,   0, -1 },
+    };
+
+    auto center = cube.center();
+    ci::ColorA color(cube.color());
+    for (const auto& side : sides) {
+      const auto* neighbor = activeCube(pos.x + side.dx, z + side.dz);
+      if (neighbor && (neighbor->posBlock().y == pos.y)) continue;
+
+      mesh.addFace(side.face, center, cube.size(), color);
+    }
+    mesh.addFace(CubeGeometry::FACE_TOP, center, cube.size(), color);
+    mesh.addFace(CubeGeometry::FACE_BOTTOM, center, cube.size(), color);
+  }
+
+  const StageCube* activeCube(const int x, const int z) const {
+    int index = z - int(collapse_index_);
+    if ((index < 0) || (x < 0)) return nullptr;
+    if (!isValidCube(x, index)) return nullptr;
+
+    return &active_cubes_[index][x];
+  }
+
+  // 頂点の削減数とchunkの再構築時間を報告
+  void postChunkInfo(const u_int rebuild_num, const double rebuild_time) {
+    size_t vertex_num = 0;
+    size_t cube_num   = 0;
+    for (const auto& chunk : chunks_) {
+      vertex_num += chunk.mesh.vertexNum();
+      cube_num   += chunk.cube_num;
+    }
+
+    std::map<std::string, std::string> info = {
+      { "stage vertices", std::to_string(vertex_num) + "/" + std::to_string(cube_num * CubeGeometry::VERTEX_NUM) },
+      { "chunk rebuild", std::to_string(rebuild_num) },
+      { "chunk rebuild time(ms)", std::to_string(rebuild_time * 1000.0) },
+    };
+    for (const auto& it : info) {
+      Param params = {
+        { "name", it.first },
+        { "value", it.second },
+      };
+      message_.signal(Msg::DEBUG_INFO, params);
+    }
+  }
   
   void stageHight(const Message::Connection& connection, Param& params) {
     params["is_cube"] = false;
@@ -293,17 +701,26 @@ private:
     }
   }
 
-  bool isValidCube(const u_int x, const u_int z) {
+  bool isValidCube(const u_int x, const u_int z) const {
     return (z < active_cubes_.size())
       && (x < active_cubes_[z].size())
       && active_cubes_[z][x].isActive();
   }
 
   
-  void gatherInfo(const Message::Connection& connection, Param& params) {
-    params["stageWidth"]   = width_;
-    params["stageLength"]  = active_cubes_.size() * cube_size_;
-    params["stageBottomZ"] = float(collapse_index_ + collapse_timer_.lapseRate()) * cube_size_;
+  // active_cubes_[index]の行の高さを敵の道しるべへ
+  void publishLine(const size_t index) {
+    flow_->setLine(int(collapse_index_ + index), active_cubes_[index]);
+  }
+
+  // 今の状態をWorldStateへ(変化がなければ何も起きない)
+  void publish() {
+    WorldState::StageInfo info = {
+      width_,
+      float(active_cubes_.size() * cube_size_),
+      float(collapse_index_ + collapse_timer_.lapseRate()) * cube_size_
+    };
+    world_->updateStage(info);
   }
 
   
@@ -317,80 +734,124 @@ private:
     if (collapse_timer_.isActive()) collapse_timer_.setTimer(0.05);
     if (build_timer_.isActive()) build_timer_.setTimer(0.05);
 
-    timer_tasks_.add(2.5, [this]() {
-        // stageの全消去とGoal地点の生成を待って、次のstageの生成準備
-        if (collapse_timer_.isActive()) return;
-        if (build_timer_.isActive()) return;
-
-        size_t stage_num = params_["stage.data"].getNumChildren();
-        current_stage_ += 1;
-        if (current_stage_ == stage_num) {
-          // 全stageクリア
-          DOUT << "all stage clear!!" << std::endl;
-          message_.signal(Msg::ALL_STAGE_CLEAR, Param());
-          return;
-        }
+    TimerEvent event = { TIMER_NEXT_STAGE, ci::Vec3i::zero() };
+    timer_tasks_.add(2.5, event);
+  }
 
-        bool filal_stage = isFinalStage(current_stage_);
+  // 書き換えた設定値を読み直す
+  // TIPS:今のステージの速さだけを変える(形は次に作る時から)
+  void paramsChanged(const Message::Connection& connection, Param& params) {
+    const auto& paths = boost::any_cast<const std::vector<std::string>& >(params["paths"]);
+    if (!Json::isChanged(paths, "stage.data." + std::to_string(current_stage_))) return;
 
-        // 次のステージの一部分をさっさと生成
-        build_timer_.setTimer(build_speed_ / 3);
-        build_timer_.start();
-        
-        // 次のステージを生成
-        start_line_ = next_start_line_;
-
-        int offset_z = next_start_line_ + 1;
-        const auto& stage_data = params_["stage.data"][current_stage_];
-        field_block_length_ = makeStage(stage_data, offset_z);
-        offset_z += field_block_length_;
-        finish_line_ = offset_z - 1;
-
-        // 生成と崩壊速度の再指定
-        collapse_speed_ = stage_data.getValueForKey<double>("collapseSpeed");
-        build_speed_    = stage_data.getValueForKey<double>("buildSpeed");
-        
-        std::string key_id = std::string("stage") + (filal_stage ? ".finalGoal"
-                                                                 : ".goal");
-        goal_block_length_ = makeStage(params_[key_id], offset_z, filal_stage ? false : true);
-        offset_z += goal_block_length_;
-        next_start_line_ = offset_z - 1;
+    const auto& stage_data_list = params_["stage.data"];
+    if (current_stage_ >= stage_data_list.getNumChildren()) return;
 
-        finishEntry(stage_data, field_block_length_);
-        
-        {
-          Param params = {
-            { "start_line",  start_line_ },
-            { "finish_line", finish_line_ },
-            { "final_stage", filal_stage },
-          };
-          message_.signal(Msg::POST_STAGE_INFO, params);
-        }
+    const auto& stage_data = stage_data_list[current_stage_];
+    double collapse_speed = stage_data.getValueForKey<double>("collapseSpeed");
+    double build_speed    = stage_data.getValueForKey<double>("buildSpeed");
 
-        tasks_.add([this]() {
-            // stageが規定サイズ生成されたらstage開始!!
-            if (cubes_.size() ==
-                (goal_block_length_ * 2 + field_block_length_ - stage_block_length_)) {
-              collapse_timer_.setTimer(collapse_speed_);
-              collapse_timer_.start();
-              build_timer_.setTimer(build_speed_);
-              started_ = false;
-
-              // start lineの書き換え
-              // TODO:ゲートオープン的な演出
-              auto& cube_line = active_cubes_[goal_block_length_];
-              for (auto& cube : cube_line) {
-                const auto pos = cube.posBlock();
-                cube.posBlock(ci::Vec3i(pos.x, pos.y - 1, pos.z));
-              }
-              
-              return true;
-            }
-        
-            return false;
-          });
-        
-      });
+    // ゴール後やステージの準備中で急いでいる時は、そのまま
+    if (collapse_timer_.goalTime() == collapse_speed_) collapse_timer_.setTimer(collapse_speed);
+    if (build_timer_.goalTime() == build_speed_)       build_timer_.setTimer(build_speed);
+
+    collapse_speed_ = collapse_speed;
+    build_speed_    = build_speed;
+  }
+
+  void waitTimerStopped() {
+    waiting_ |= WAIT_TIMER_STOPPED;
+    tasks_.wait(EVENT_TIMER_STOPPED,
+                [this]() {
+                  return !collapse_timer_.isActive() && !build_timer_.isActive();
+                },
+                [this]() {
+                  waiting_ &= ~WAIT_TIMER_STOPPED;
+                  nextStage();
+                });
+  }
+
+  // stageが規定サイズ生成されたらstage開始!!
+  void waitLineBuilt() {
+    waiting_ |= WAIT_LINE_BUILT;
+    tasks_.wait(EVENT_LINE_BUILT,
+                [this]() {
+                  return cubes_.size() ==
+                    (goal_block_length_ * 2 + field_block_length_ - stage_block_length_);
+                },
+                [this]() {
+                  waiting_ &= ~WAIT_LINE_BUILT;
+                  openStage();
+                });
+  }
+
+  void nextStage() {
+    size_t stage_num = params_["stage.data"].getNumChildren();
+    current_stage_ += 1;
+    if (current_stage_ == stage_num) {
+      // 全stageクリア
+      DOUT << "all stage clear!!" << std::endl;
+      message_.signal(Msg::ALL_STAGE_CLEAR, Param());
+      return;
+    }
+
+    bool filal_stage = isFinalStage(current_stage_);
+
+    // 次のステージの一部分をさっさと生成
+    build_timer_.setTimer(build_speed_ / 3);
+    build_timer_.start();
+    
+    // 次のステージを生成
+    start_line_ = next_start_line_;
+
+    int offset_z = next_start_line_ + 1;
+    const auto& stage_data = params_["stage.data"][current_stage_];
+    field_block_length_ = makeStage(stage_data, offset_z);
+    offset_z += field_block_length_;
+    finish_line_ = offset_z - 1;
+
+    // 生成と崩壊速度の再指定
+    collapse_speed_ = stage_data.getValueForKey<double>("collapseSpeed");
+    build_speed_    = stage_data.getValueForKey<double>("buildSpeed");
+    
+    std::string key_id = std::string("stage") + (filal_stage ? ".finalGoal"
+                                                             : ".goal");
+    goal_block_length_ = makeStage(params_[key_id], offset_z, filal_stage ? false : true);
+    offset_z += goal_block_length_;
+    next_start_line_ = offset_z - 1;
+
+    finishEntry(stage_data, field_block_length_);
+    
+    {
+      Param params = {
+        { "start_line",  start_line_ },
+        { "finish_line", finish_line_ },
+        { "final_stage", filal_stage },
+      };
+      message_.signal(Msg::POST_STAGE_INFO, params);
+    }
+
+    waitLineBuilt();
+  }
+
+  void openStage() {
+    collapse_timer_.setTimer(collapse_speed_);
+    collapse_timer_.start();
+    build_timer_.setTimer(build_speed_);
+    started_ = false;
+
+    // start lineの書き換え
+    // TODO:ゲートオープン的な演出
+    auto& cube_line = active_cubes_[goal_block_length_];
+    for (auto& cube : cube_line) {
+      const auto pos = cube.posBlock();
+      cube.posBlock(ci::Vec3i(pos.x, pos.y - 1, pos.z));
+    }
+    publishLine(goal_block_length_);
+    int z = int(collapse_index_ + goal_block_length_);
+    chunkDirty(z - 1);
+    chunkDirty(z);
+    chunkDirty(z + 1);
   }
 
 
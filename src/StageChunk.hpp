@@ -0,0 +1,27 @@
+﻿#pragma once
+
+//
+// ステージを一定の行数ごとにまとめたもの
+// 視錐台カリングと、メッシュ結合の単位
+//
+
+#include "cinder/AxisAlignedBox.h"
+#include "CubeMesh.hpp"
+
+
+namespace ngs {
+
+struct StageChunk {
+  int index;
+
+  // 含まれる行が変化したら再計算する
+  bool dirty;
+
+  u_int cube_num;
+  ci::AxisAlignedBox3f bounds;
+
+  // 隣と接している面を取り除いて結合したもの
+  CubeMesh mesh;
+};
+
+}
@@ -7,6 +7,8 @@
 #include "GameEnvironment.hpp"
 #include "cinder/gl/gl.h"
 #include "cinder/Vector.h"
+#include "cinder/AxisAlignedBox.h"
+#include "BinaryStream.hpp"
 
 
 namespace ngs {
@@ -31,6 +33,14 @@ public:
   };
   
 
+  // スナップショットの読み込み用
+  StageCube() :
+    size_(0.0f),
+    active_(false),
+    on_entity_(false),
+    entity_type_(ON_PLAYER)
+  { }
+
   StageCube(const ci::Vec3i& pos_block, const float size,
             const bool active,
             const ci::Color& color = ci::Color::white()) :
@@ -39,21 +49,20 @@ public:
     size_(size),
     color_(color),
     active_(active),
-    on_entity_(false)
+    on_entity_(false),
+    entity_type_(ON_PLAYER)
   { }
 
   
-  void draw() const {
-    if (!active_) return;
-    
-    // ci::gl::color(on_entity_ ? ci::Color(0.0f, 0.0f, 1.0f) + color_ * 0.5f : color_);
-    ci::gl::color(color_);
-
-    ci::Vec3f pos(pos_);
-    // 上平面が(y = 0)
-    pos.y -= size_ / 2;
-    
-    ci::gl::drawCube(pos, ci::Vec3f(size_, size_, size_));
+  ci::AxisAlignedBox3f bounds() const {
+    return ci::AxisAlignedBox3f(pos_ + ci::Vec3f(-size_ / 2, -size_, -size_ / 2),
+                                pos_ + ci::Vec3f( size_ / 2,      0,  size_ / 2));
+  }
+
+
+  // 上平面が(y = 0)
+  ci::Vec3f center() const {
+    return ci::Vec3f(pos_.x, pos_.y - size_ / 2, pos_.z);
   }
 
 
@@ -77,6 +86,17 @@ public:
   bool isActive() const { return active_; }
   void active(const bool value) { active_ = value; }
 
+
+  // TIPS:構造体ごとmemcpyするとpaddingの不定値まで保存されるので、メンバごとに扱う
+  template <typename Self, typename Stream>
+  static void transfer(Self& self, Stream& stream) {
+    stream & self.pos_block_ & self.pos_ & self.size_ & self.color_
+           & self.active_ & self.on_entity_ & self.entity_type_;
+  }
+
+  void save(BinaryWriter& writer) const { transfer(*this, writer); }
+  void load(BinaryReader& reader) { transfer(*this, reader); }
+
   
 };
   
@@ -35,21 +35,43 @@ public:
     active_(true),
     start_line_(0),
     finish_line_(0),
+    final_stage_(false),
     started_(false),
     finished_(false),
     progress_(0)
   { }
   
   void setup(boost::shared_ptr<StageWatcher> obj_sp) {
+    connect(obj_sp);
+  }
+
+  // スナップショットから復元
+  void restore(boost::shared_ptr<StageWatcher> obj_sp, BinaryReader& reader) {
+    transfer(*this, reader);
+    connect(obj_sp);
+  }
+
+  
+private:
+  void connect(boost::shared_ptr<StageWatcher> obj_sp) {
     message_.connect(Msg::POST_STAGE_INFO, obj_sp, &StageWatcher::getStageInfo);
 
     message_.connect(Msg::CUBE_PLAYER_POS, obj_sp, &StageWatcher::check);
     message_.connect(Msg::CUBE_PLAYER_DEAD, obj_sp, &StageWatcher::inactive);
   }
 
-  
-private:
+
   bool isActive() const override { return active_; }
+  int type() const override { return ENTITY_STAGEWATCHER; }
+
+
+  template <typename Self, typename Stream>
+  static void transfer(Self& self, Stream& stream) {
+    stream & self.start_line_ & self.finish_line_ & self.final_stage_
+           & self.started_ & self.finished_ & self.progress_;
+  }
+
+  void save(BinaryWriter& writer) const override { transfer(*this, writer); }
 
   
   void getStageInfo(const Message::Connection& connection, Param& params) {
@@ -0,0 +1,57 @@
+﻿#pragma once
+
+//
+// 起動時間の計測
+// 区切りごとに前の区切りからの時間を記録し、最初の描画までを段階ごとに出力する
+//
+
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "cinder/Timer.h"
+
+
+namespace ngs {
+
+class StartupProfile {
+  ci::Timer timer_;
+  double last_time_;
+
+  // 段階の名前と時間(秒)
+  std::vector<std::pair<std::string, double> > phases_;
+
+
+public:
+  StartupProfile() :
+    timer_(true),
+    last_time_(0.0)
+  { }
+
+
+  // 前の区切りからここまでをnameの段階とする
+  void mark(const std::string& name) {
+    double time = timer_.getSeconds();
+    phases_.push_back(std::make_pair(name, time - last_time_));
+    last_time_ = time;
+  }
+
+  // 計測を始めてから最後の区切りまで(秒)
+  double total() const { return last_time_; }
+
+  const std::vector<std::pair<std::string, double> >& phases() const { return phases_; }
+
+
+  // target:目標の時間(秒)
+  void print(std::ostream& output, const std::string& title, const double target) const {
+    output << "startup " << title << ": " << total() * 1000.0 << "ms"
+           << " (target " << target * 1000.0 << "ms " << ((total() <= target) ? "OK" : "NG") << ")"
+           << std::endl;
+    for (const auto& phase : phases_) {
+      output << "  " << phase.first << ": " << phase.second * 1000.0 << "ms" << std::endl;
+    }
+  }
+
+};
+
+}
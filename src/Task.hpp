@@ -1,11 +1,13 @@
 ﻿#pragma once
 
 //
-// タスク
-// 関数オブジェクトがtrueを返すとタスクから削除する
+// 待ち合わせタスク
+// 通知(notify)があった時だけ条件を調べ、満たしていたら処理を実行して削除する
+// 毎フレームの確認は行わないので、待っている間の負荷はない
 //
 
-#include <list>
+#include <map>
+#include <vector>
 #include <functional>
 
 
@@ -13,41 +15,72 @@ namespace ngs {
 
 class Task {
   struct Object {
-    std::function<bool()> proc;
-
-    Object(std::function<bool()> p) :
-      proc(p)
-    {}
+    std::function<bool()> condition;
+    std::function<void()> proc;
   };
 
-  // 実行中に追加されることもあるのでvectorではなくlistを使う
-  std::list<Object> objects_;
+  // 通知の識別子ごとの待ち
+  std::map<int, std::vector<Object> > waiting_;
+
 
-  
   Task(const Task&) = delete;
   Task& operator=(const Task&) = delete;
 
-  
+
 public:
   Task() = default;
-  
-  void add(std::function<bool()>& proc) {
-    objects_.emplace_back(proc);
+
+  // conditionを満たすまで待ってからprocを実行
+  // TIPS:登録した時点で満たしていたら、その場で実行する
+  void wait(const int event, std::function<bool()> condition, std::function<void()> proc) {
+    if (condition()) {
+      proc();
+      return;
+    }
+
+    Object object = { std::move(condition), std::move(proc) };
+    waiting_[event].push_back(std::move(object));
+  }
+
+  // 次の通知でprocを実行
+  void wait(const int event, std::function<void()> proc) {
+    Object object = { nullptr, std::move(proc) };
+    waiting_[event].push_back(std::move(object));
   }
 
-  void add(std::function<bool()>&& proc) {
-    objects_.emplace_back(proc);
+  void notify(const int event) {
+    auto it = waiting_.find(event);
+    if (it == std::end(waiting_)) return;
+
+    // TIPS:処理の実行中に待ちが追加されることがあるので、取り出してから調べる
+    auto objects = std::move(it->second);
+    it->second.clear();
+
+    std::vector<Object> remain;
+    for (auto& object : objects) {
+      if (object.condition && !object.condition()) {
+        remain.push_back(std::move(object));
+        continue;
+      }
+      object.proc();
+    }
+
+    // 満たさなかったものは、実行中に追加されたものより前に戻す
+    // TIPS:std::mapへの追加ではiteratorが無効にならない
+    it->second.insert(std::begin(it->second),
+                      std::make_move_iterator(std::begin(remain)),
+                      std::make_move_iterator(std::end(remain)));
   }
-  
-  void operator()() {
-    // FIXME:task実行中にtaskへ追加が行われることがあるので
-    //       この実装になっている(std::listはコンテナへの操作でiteratorが無効にならない)
-    for (auto it = std::begin(objects_); it != std::end(objects_); /* do nothing */) {
-      if (it->proc()) it = objects_.erase(it);
-      else            ++it;
+
+  // 待っている数
+  size_t size() const {
+    size_t num = 0;
+    for (const auto& waiting : waiting_) {
+      num += waiting.second.size();
     }
+    return num;
   }
-  
+
 };
 
 }
@@ -0,0 +1,133 @@
+﻿#pragma once
+
+//
+// 常駐スレッドによる並列処理
+// 呼び出したスレッドも処理を分担する
+//
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace ngs {
+
+class ThreadPool {
+  std::vector<std::thread> threads_;
+
+  std::mutex mutex_;
+  std::condition_variable start_;
+  std::condition_variable finish_;
+
+  // 実行中の処理
+  std::function<void (size_t, size_t)> job_;
+  size_t job_num_;
+  std::atomic<size_t> next_index_;
+
+  u_int generation_;
+  size_t running_;
+  bool quit_;
+
+
+  // TIPS:コピー不可
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+
+public:
+  // thread_num:呼び出し側を含めたスレッド数(0ならCPUのコア数)
+  explicit ThreadPool(size_t thread_num = 0) :
+    job_num_(0),
+    generation_(0),
+    running_(0),
+    quit_(false)
+  {
+    next_index_ = 0;
+
+    if (thread_num == 0) thread_num = std::max(std::thread::hardware_concurrency(), 1u);
+    for (size_t i = 1; i < thread_num; ++i) {
+      threads_.emplace_back([this, i]() { work(i); });
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      quit_ = true;
+    }
+    start_.notify_all();
+
+    for (auto& thread : threads_) {
+      thread.join();
+    }
+  }
+
+
+  size_t threadNum() const { return threads_.size() + 1; }
+
+  // [0, num) を分担して実行
+  // func(index, thread) のthreadは 0 〜 threadNum() - 1
+  void parallelFor(const size_t num, std::function<void (size_t, size_t)> func) {
+    if (num == 0) return;
+
+    if (threads_.empty() || (num == 1)) {
+      for (size_t i = 0; i < num; ++i) {
+        func(i, 0);
+      }
+      return;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      job_        = std::move(func);
+      job_num_    = num;
+      next_index_ = 0;
+      running_    = threads_.size();
+      generation_ += 1;
+    }
+    start_.notify_all();
+
+    runJob(0);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    finish_.wait(lock, [this]() { return running_ == 0; });
+    job_ = nullptr;
+  }
+
+
+private:
+  void runJob(const size_t thread) {
+    size_t index;
+    while ((index = next_index_++) < job_num_) {
+      job_(index, thread);
+    }
+  }
+
+  void work(const size_t thread) {
+    u_int generation = 0;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        start_.wait(lock, [this, generation]() {
+            return quit_ || (generation_ != generation);
+          });
+        if (quit_) return;
+        generation = generation_;
+      }
+
+      runJob(thread);
+
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ -= 1;
+      }
+      finish_.notify_one();
+    }
+  }
+
+};
+
+}
@@ -0,0 +1,186 @@
+﻿#pragma once
+
+//
+// TimerTaskの計測(headless用)
+// 発火時間をばらけさせたN個のタイマーを登録し、半分を取り消してから毎tick更新する
+// 登録・取り消し・1tickの更新にかかる時間を、以前のstd::listによる実装と比べる
+//
+// TIPS:どちらも同じ乱数で同じ時間を登録し、発火した数が一致するか確かめる
+//      発火時間はtickの中間にして、丸め方の違いで発火するtickがずれないようにする
+//
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <vector>
+#include "cinder/Timer.h"
+#include "Random.hpp"
+#include "TimerTask.hpp"
+
+
+namespace ngs {
+
+class TimerBench {
+  // 以前のTimerTask(更新のたびに全てをたどり、残り時間を減らす)
+  // TIPS:取り消しはaddが返すiteratorで消す
+  class ListTimer {
+    struct Object {
+      double fire_time;
+      std::function<void()> proc;
+    };
+
+    std::list<Object> objects_;
+
+  public:
+    typedef std::list<Object>::iterator Id;
+
+    Id add(const double fire_time, const std::function<void()>& proc) {
+      Object object = { fire_time, proc };
+      return objects_.insert(std::end(objects_), object);
+    }
+
+    void cancel(const Id& id) {
+      objects_.erase(id);
+    }
+
+    void operator()(const double delta_time) {
+      for (auto it = std::begin(objects_); it != std::end(objects_); /* do nothing */) {
+        it->fire_time -= delta_time;
+        if (it->fire_time <= 0.0) {
+          it->proc();
+          it = objects_.erase(it);
+        }
+        else {
+          ++it;
+        }
+      }
+    }
+
+    size_t size() const { return objects_.size(); }
+  };
+
+
+public:
+  struct Result {
+    // 1回あたり(秒)
+    double add_time;
+    double cancel_time;
+    double update_time;
+
+    u_int fired;
+    // 計測後に残っている数
+    u_int pending;
+  };
+
+  struct Report {
+    u_int timers;
+    u_int ticks;
+    // 発火時間の範囲(秒)
+    double spread;
+
+    Result wheel;
+    Result list;
+
+    bool isValid() const { return (wheel.fired == list.fired) && (wheel.pending == list.pending); }
+  };
+
+
+  // spread:発火時間を 0 〜 spread 秒の範囲でばらけさせる
+  static Report run(const u_int timer_num, const u_int ticks, const double tick_time,
+                    const double spread, const u_int seed) {
+    Report report = {};
+    report.timers = timer_num;
+    report.ticks  = std::max(ticks, 1u);
+    report.spread = spread;
+
+    auto times = fireTimes(timer_num, spread, tick_time, seed);
+    {
+      TimerTask<double> timer_task(tick_time);
+      report.wheel = measure(timer_task, times, report.ticks, tick_time);
+    }
+    {
+      ListTimer timer_task;
+      report.list = measure(timer_task, times, report.ticks, tick_time);
+    }
+    return report;
+  }
+
+  static void print(std::ostream& output, const Report& report) {
+    output << "timers:" << report.timers
+           << " ticks:" << report.ticks
+           << " spread:" << report.spread << "s"
+           << std::endl;
+
+    print(output, "wheel", report.wheel);
+    print(output, "list ", report.list);
+
+    output << "fired:" << (report.isValid() ? "OK" : "NG") << std::endl;
+  }
+
+
+private:
+  static std::vector<double> fireTimes(const u_int timer_num, const double spread,
+                                       const double tick_time, const u_int seed) {
+    Random rand(seed, RANDOM_DEFAULT, 0);
+    int spread_ticks = std::max(int(spread / tick_time), 1);
+
+    std::vector<double> times(timer_num);
+    for (auto& time : times) {
+      time = (rand.nextInt(spread_ticks) + 0.5) * tick_time;
+    }
+    return times;
+  }
+
+  // 全て登録 → 奇数番目を取り消し → ticks回更新
+  template <typename Task>
+  static Result measure(Task& timer_task, const std::vector<double>& times,
+                        const u_int ticks, const double tick_time) {
+    Result result = {};
+    u_int fired = 0;
+    std::function<void()> proc = [&fired]() { fired += 1; };
+
+    std::vector<typename Task::Id> ids;
+    ids.reserve(times.size());
+    {
+      ci::Timer timer(true);
+      for (auto time : times) {
+        ids.push_back(timer_task.add(time, proc));
+      }
+      result.add_time = timer.getSeconds() / std::max(times.size(), size_t(1));
+    }
+    {
+      size_t num = 0;
+      ci::Timer timer(true);
+      for (size_t i = 1; i < ids.size(); i += 2) {
+        timer_task.cancel(ids[i]);
+        num += 1;
+      }
+      result.cancel_time = timer.getSeconds() / std::max(num, size_t(1));
+    }
+    {
+      ci::Timer timer(true);
+      for (u_int i = 0; i < ticks; ++i) {
+        timer_task(tick_time);
+      }
+      result.update_time = timer.getSeconds() / ticks;
+    }
+
+    result.fired   = fired;
+    result.pending = u_int(timer_task.size());
+    return result;
+  }
+
+  static void print(std::ostream& output, const char* name, const Result& result) {
+    output << name
+           << " add:" << result.add_time * 1000000000.0 << "ns"
+           << " cancel:" << result.cancel_time * 1000000000.0 << "ns"
+           << " update:" << result.update_time * 1000000.0 << "us/tick"
+           << " fired:" << result.fired
+           << " pending:" << result.pending
+           << std::endl;
+  }
+
+};
+
+}
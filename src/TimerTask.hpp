@@ -2,59 +2,342 @@
 
 //
 // 時間経過で関数オブジェクトを実行
+// 階層化したタイミングホイールで管理するので、登録数が増えても
+// 追加はO(1)、時間経過も(ならして)O(1)で済む
+//
+// TIPS:時間は分解能(resolution)単位に切り上げて扱う
+//      取り消し(cancel)は印を付けるだけで、slotを処理する時に取り除く
+//
+// Eventに関数オブジェクト以外(memcpyできるデータ)を使うと、
+// 実行時にhandlerへ渡す形になり、実行待ちをsave/loadできる
 //
 
-#include <list>
+#include <algorithm>
+#include <cmath>
 #include <functional>
+#include <vector>
+#include "BinaryStream.hpp"
 
 
 namespace ngs {
 
-template <typename T>
+template <typename T, typename Event = std::function<void()> >
 class TimerTask {
+  enum {
+    SLOT_BITS  = 6,
+    SLOT_NUM   = 1 << SLOT_BITS,
+    SLOT_MASK  = SLOT_NUM - 1,
+    LEVEL_NUM  = 4,
+
+    // リストの終端
+    NONE = -1
+  };
+
+  typedef unsigned long long Tick;
+
   struct Object {
-    T fire_time;
-    std::function<void()> proc;
+    Tick fire_tick;
+    // 同じtickの中では登録順に実行する
+    Tick sequence;
+    Event proc;
 
-    Object(const T t, std::function<void()> p) :
-      fire_time(t),
-      proc(p)
-    {}
+    bool used;
+    bool cancelled;
+    int next;
   };
 
-  std::list<Object> objects_;
+  // Objectは使い回す
+  std::vector<Object> objects_;
+  int free_;
+
+  // 各階層のslotごとのリスト先頭
+  int slots_[LEVEL_NUM][SLOT_NUM];
+
+  T resolution_;
+  // 経過時間(resolution単位で切り上げる前)
+  T elapsed_;
+  Tick now_;
+  Tick sequence_;
+
+  size_t size_;
+
+  // 実行待ち
+  std::vector<int> expired_;
+
 
-  
   TimerTask(const TimerTask&) = delete;
   TimerTask& operator=(const TimerTask&) = delete;
 
-  
+
 public:
-  TimerTask() = default;
-  
-  void add(const T fire_time, std::function<void()>& proc) {
-    objects_.emplace_back(fire_time, proc);
+  // 取り消し用の識別子
+  struct Id {
+    int index;
+    Tick sequence;
+  };
+
+
+  // resolution:時間の分解能(更新間隔に合わせる)
+  explicit TimerTask(const T resolution = static_cast<T>(1) / static_cast<T>(60)) :
+    free_(NONE),
+    resolution_(resolution),
+    elapsed_(static_cast<T>(0)),
+    now_(0),
+    sequence_(0),
+    size_(0)
+  {
+    std::fill(&slots_[0][0], &slots_[0][0] + LEVEL_NUM * SLOT_NUM, int(NONE));
   }
 
-  void add(const T fire_time, std::function<void()>&& proc) {
-    objects_.emplace_back(fire_time, proc);
+  Id add(const T fire_time, const Event& proc) {
+    Tick sequence = sequence_++;
+    Id id = { insert(fireTick(fire_time), sequence, proc), sequence };
+    return id;
   }
-  
+
+  Id add(const T fire_time, Event&& proc) {
+    Tick sequence = sequence_++;
+    Id id = { insert(fireTick(fire_time), sequence, std::move(proc)), sequence };
+    return id;
+  }
+
+  // 実行前なら取り消す(実行済みや取り消し済みならfalse)
+  bool cancel(const Id& id) {
+    if ((id.index < 0) || (id.index >= int(objects_.size()))) return false;
+
+    auto& object = objects_[id.index];
+    if (!object.used || object.cancelled || (object.sequence != id.sequence)) return false;
+
+    object.cancelled = true;
+    object.proc = Event();
+    size_ -= 1;
+    return true;
+  }
+
+  // 実行待ちの数
+  size_t size() const { return size_; }
+
   void operator()(const T delta_time) {
-    // FIXME:task実行中にtaskへ追加が行われることがあるので
-    //       この実装になっている(std::listはコンテナへの操作でiteratorが無効にならない)
-    for (auto it = std::begin(objects_); it != std::end(objects_); /* do nothing */) {
-      it->fire_time -= delta_time;
-      if (it->fire_time <= static_cast<T>(0)) {
-        it->proc();
-        it = objects_.erase(it);
+    (*this)(delta_time, [](Event& proc) { proc(); });
+  }
+
+  // 時間が来たEventをhandlerへ渡す
+  template <typename F>
+  void operator()(const T delta_time, F handler) {
+    elapsed_ += delta_time;
+
+    // TIPS:誤差で1tick遅れないよう、わずかに余裕を持たせる
+    Tick target = Tick(std::floor(elapsed_ / resolution_ + static_cast<T>(1e-6)));
+    while (now_ < target) {
+      step();
+    }
+
+    // TIPS:先に実行するものを全部取り出してから実行する
+    //      実行中に追加されたもので、すでに時間が来ているものもここで実行する
+    while (!expired_.empty()) {
+      auto expired = std::move(expired_);
+      expired_.clear();
+
+      std::stable_sort(std::begin(expired), std::end(expired),
+                       [this](const int lhs, const int rhs) {
+                         const auto& l = objects_[lhs];
+                         const auto& r = objects_[rhs];
+                         return (l.fire_tick != r.fire_tick) ? (l.fire_tick < r.fire_tick)
+                                                             : (l.sequence < r.sequence);
+                       });
+
+      for (auto index : expired) {
+        if (objects_[index].cancelled) {
+          release(index);
+          continue;
+        }
+
+        // TIPS:実行中のaddでobjects_が再確保されることがあるので取り出しておく
+        auto proc = std::move(objects_[index].proc);
+        release(index);
+        size_ -= 1;
+        handler(proc);
       }
-      else {
-        ++it;
+    }
+  }
+
+  // 実行待ちの保存と復元
+  // TIPS:Eventがmemcpyできる型の時だけ使える
+  void save(BinaryWriter& writer) const {
+    writer.put(elapsed_);
+    writer.put(now_);
+    writer.put(sequence_);
+
+    // TIPS:objects_の並びは使い回しの履歴で変わるので、実行順に並べて書き出す
+    //      (同じ状態なら同じバイト列になる)
+    std::vector<int> indices;
+    indices.reserve(size_);
+    for (int i = 0; i < int(objects_.size()); ++i) {
+      const auto& object = objects_[i];
+      if (object.used && !object.cancelled) indices.push_back(i);
+    }
+    std::sort(std::begin(indices), std::end(indices),
+              [this](const int lhs, const int rhs) {
+                const auto& a = objects_[lhs];
+                const auto& b = objects_[rhs];
+                return (a.fire_tick != b.fire_tick) ? (a.fire_tick < b.fire_tick)
+                                                    : (a.sequence < b.sequence);
+              });
+
+    writer.put(u_int(indices.size()));
+    for (auto index : indices) {
+      const auto& object = objects_[index];
+      writer.put(object.fire_tick);
+      writer.put(object.sequence);
+      writer.put(object.proc);
+    }
+  }
+
+  bool load(BinaryReader& reader) {
+    clear();
+
+    u_int num;
+    if (!reader.get(elapsed_) || !reader.get(now_) || !reader.get(sequence_) || !reader.get(num)) return false;
+
+    for (u_int i = 0; i < num; ++i) {
+      Tick fire_tick;
+      Tick sequence;
+      Event proc;
+      if (!reader.get(fire_tick) || !reader.get(sequence) || !reader.get(proc)) return false;
+
+      // TIPS:実行順は(fire_tick, sequence)だけで決まるので、slot内の並びは問わない
+      insert(fire_tick, sequence, std::move(proc));
+    }
+    return true;
+  }
+
+  // 読み込みに成功した一時的なTimerTaskと中身を入れ替える時に使う
+  void swap(TimerTask& other) {
+    std::swap(objects_, other.objects_);
+    std::swap(free_, other.free_);
+    std::swap_ranges(&slots_[0][0], &slots_[0][0] + LEVEL_NUM * SLOT_NUM, &other.slots_[0][0]);
+    std::swap(resolution_, other.resolution_);
+    std::swap(elapsed_, other.elapsed_);
+    std::swap(now_, other.now_);
+    std::swap(sequence_, other.sequence_);
+    std::swap(size_, other.size_);
+    std::swap(expired_, other.expired_);
+  }
+
+  // 全て破棄して時間を0に戻す
+  void clear() {
+    objects_.clear();
+    free_ = NONE;
+    std::fill(&slots_[0][0], &slots_[0][0] + LEVEL_NUM * SLOT_NUM, int(NONE));
+    elapsed_  = static_cast<T>(0);
+    now_      = 0;
+    sequence_ = 0;
+    size_     = 0;
+    expired_.clear();
+  }
+
+
+private:
+  Tick fireTick(const T fire_time) const {
+    T ticks = std::ceil((elapsed_ + fire_time) / resolution_ - static_cast<T>(1e-6));
+    return (ticks > T(now_)) ? Tick(ticks) : now_;
+  }
+
+  template <typename F>
+  int insert(const Tick fire_tick, const Tick sequence, F&& proc) {
+    int index;
+    if (free_ != NONE) {
+      index = free_;
+      free_ = objects_[index].next;
+    }
+    else {
+      index = int(objects_.size());
+      objects_.push_back(Object());
+    }
+
+    auto& object = objects_[index];
+    object.fire_tick = fire_tick;
+    object.sequence  = sequence;
+    object.proc      = std::forward<F>(proc);
+    object.used      = true;
+    object.cancelled = false;
+    size_ += 1;
+
+    if (fire_tick <= now_) {
+      // 時間が来ているものは次の実行で処理
+      expired_.push_back(index);
+      return index;
+    }
+    link(index);
+    return index;
+  }
+
+  // 残り時間に合った階層のslotへつなぐ
+  void link(const int index) {
+    auto& object = objects_[index];
+    Tick delta = object.fire_tick - now_;
+
+    int level = 0;
+    while ((level < (LEVEL_NUM - 1)) && (delta >= (Tick(1) << (SLOT_BITS * (level + 1))))) {
+      level += 1;
+    }
+
+    Tick fire_tick = object.fire_tick;
+    if (level == (LEVEL_NUM - 1)) {
+      // 最上位の範囲を超えるものは、一番遠いslotに入れて再配置を待つ
+      Tick max_delta = (Tick(1) << (SLOT_BITS * LEVEL_NUM)) - 1;
+      fire_tick = now_ + std::min(delta, max_delta);
+    }
+
+    int slot = int((fire_tick >> (SLOT_BITS * level)) & SLOT_MASK);
+    object.next = slots_[level][slot];
+    slots_[level][slot] = index;
+  }
+
+  // TIPS:size_は実行か取り消しの時に減らしている
+  void release(const int index) {
+    auto& object = objects_[index];
+    object.proc = Event();
+    object.used = false;
+    object.next = free_;
+    free_ = index;
+  }
+
+  // 1tick進める
+  void step() {
+    now_ += 1;
+
+    // 下位の階層が一周したら、上位のslotを振り分け直す
+    for (int level = 1; level < LEVEL_NUM; ++level) {
+      if ((now_ & ((Tick(1) << (SLOT_BITS * level)) - 1)) != 0) break;
+
+      int slot = int((now_ >> (SLOT_BITS * level)) & SLOT_MASK);
+      int index = slots_[level][slot];
+      slots_[level][slot] = NONE;
+      while (index != NONE) {
+        int next = objects_[index].next;
+        if (objects_[index].cancelled) {
+          release(index);
+        }
+        else if (objects_[index].fire_tick <= now_) {
+          expired_.push_back(index);
+        }
+        else {
+          link(index);
+        }
+        index = next;
       }
     }
+
+    int slot = int(now_ & SLOT_MASK);
+    int index = slots_[0][slot];
+    slots_[0][slot] = NONE;
+    while (index != NONE) {
+      expired_.push_back(index);
+      index = objects_[index].next;
+    }
   }
-  
+
 };
 
 }
@@ -30,6 +30,19 @@ public:
   
   // FIXME:コンストラクタではshared_ptrが決まっていないための措置
   void setup(boost::shared_ptr<TouchPreview> obj_sp) {
+    connect(obj_sp);
+  }
+
+  // スナップショットから復元
+  // TIPS:表示中のtouchは入力側の状態なので保存しない
+  void restore(boost::shared_ptr<TouchPreview> obj_sp, BinaryReader& reader) {
+    reader.get(display_);
+    connect(obj_sp);
+  }
+
+
+private:
+  void connect(boost::shared_ptr<TouchPreview> obj_sp) {
     message_.connect(Msg::TOUCH_BEGAN, obj_sp, &TouchPreview::touchBegan);
     message_.connect(Msg::TOUCH_MOVED, obj_sp, &TouchPreview::touchMoved);
     message_.connect(Msg::TOUCH_ENDED, obj_sp, &TouchPreview::touchEnded);
@@ -40,8 +53,10 @@ public:
   }
 
 
-private:
   bool isActive() const override { return active_; }
+  int type() const override { return ENTITY_TOUCHPREVIEW; }
+
+  void save(BinaryWriter& writer) const override { writer.put(display_); }
 
   
   void touchBegan(const Message::Connection& connection, Param& params) {
@@ -0,0 +1,118 @@
+﻿#pragma once
+
+//
+// 同時に鳴らせる声(再生ノード)の割り当て
+// 声の数は最初に決めておき、鳴らす時に増やさない
+// 空きがなければ、優先度が低い声、同じ優先度なら一番古い声を奪って鳴らす
+//
+// TIPS:どの声が鳴り終わったかは、呼び出し側が調べてreleaseする
+//
+
+#include <vector>
+
+
+namespace ngs {
+
+class VoicePool {
+public:
+  struct Stats {
+    u_int voices;
+    u_int active;
+    // 同時に鳴っていた声の最大数
+    u_int peak;
+    // 鳴っている声を奪った回数
+    u_int steals;
+    // 優先度の高い声ばかりで鳴らせなかった回数
+    u_int rejects;
+  };
+
+
+private:
+  struct Voice {
+    bool  active;
+    int   priority;
+    // 鳴らし始めた順番(小さいほど古い)
+    u_int serial;
+  };
+
+  std::vector<Voice> voices_;
+  u_int serial_;
+
+  u_int active_;
+  u_int peak_;
+  u_int steals_;
+  u_int rejects_;
+
+
+public:
+  explicit VoicePool(const size_t num) :
+    serial_(0),
+    active_(0),
+    peak_(0),
+    steals_(0),
+    rejects_(0)
+  {
+    Voice voice = { false, 0, 0 };
+    voices_.assign(num, voice);
+  }
+
+
+  // 鳴らす声を決める(鳴らせなければ-1)
+  int allocate(const int priority) {
+    int index = -1;
+    for (size_t i = 0; i < voices_.size(); ++i) {
+      const auto& voice = voices_[i];
+      if (!voice.active) {
+        index = int(i);
+        break;
+      }
+
+      // 奪う候補:優先度が低い方、同じなら古い方
+      if (voice.priority > priority) continue;
+      if ((index < 0)
+          || (voice.priority < voices_[index].priority)
+          || ((voice.priority == voices_[index].priority) && (voice.serial < voices_[index].serial))) {
+        index = int(i);
+      }
+    }
+
+    if (index < 0) {
+      rejects_ += 1;
+      return -1;
+    }
+
+    auto& voice = voices_[index];
+    if (voice.active) {
+      steals_ += 1;
+    }
+    else {
+      active_ += 1;
+      peak_ = std::max(peak_, active_);
+    }
+
+    voice.active   = true;
+    voice.priority = priority;
+    voice.serial   = serial_++;
+    return index;
+  }
+
+  void release(const size_t index) {
+    auto& voice = voices_[index];
+    if (!voice.active) return;
+
+    voice.active = false;
+    active_ -= 1;
+  }
+
+
+  size_t size() const { return voices_.size(); }
+  bool isActive(const size_t index) const { return voices_[index].active; }
+
+  Stats stats() const {
+    Stats stats = { u_int(voices_.size()), active_, peak_, steals_, rejects_ };
+    return stats;
+  }
+
+};
+
+}
@@ -0,0 +1,121 @@
+﻿#pragma once
+
+//
+// Entityの状態の置き場所
+// 各Entityは状態が変わった時だけ書き換え、その度に版(version)が上がる
+// 読む側は前回の版を覚えておけば、変わっていない時の処理を省ける
+//
+// TIPS:スナップショットには保存しない(復元したEntityが書き込み直す)
+//
+
+#include <map>
+#include "cinder/Vector.h"
+#include "GameEnvironment.hpp"
+
+
+namespace ngs {
+
+class WorldState {
+public:
+  struct StageInfo {
+    float width;
+    float length;
+    float bottom_z;
+  };
+
+
+private:
+  // TIPS:idの順(生成順)に並ぶ
+  std::map<u_int, CubeInfo> cubes_;
+  StageInfo stage_;
+
+  u_int version_;
+  // 操作できるCubeの居場所が変わった時だけ上がる
+  u_int player_version_;
+
+
+  // TIPS:コピー不可
+  WorldState(const WorldState&) = delete;
+  WorldState& operator=(const WorldState&) = delete;
+
+
+public:
+  WorldState() :
+    version_(0),
+    player_version_(0)
+  {
+    stage_ = StageInfo();
+  }
+
+
+  void clear() {
+    cubes_.clear();
+    stage_ = StageInfo();
+    version_ += 1;
+    player_version_ += 1;
+  }
+
+  // 変化があった時だけ版を上げる
+  void updateCube(const CubeInfo& info) {
+    auto it = cubes_.find(info.id);
+    if (it == std::end(cubes_)) {
+      cubes_.insert(std::make_pair(info.id, info));
+      version_ += 1;
+      if (info.manipulate) player_version_ += 1;
+      return;
+    }
+
+    auto& cube = it->second;
+    if ((cube.manipulate || info.manipulate)
+        && ((cube.manipulate != info.manipulate) || !(cube.block_pos == info.block_pos))) {
+      player_version_ += 1;
+    }
+
+    if ((cube.manipulate == info.manipulate)
+        && (cube.owner == info.owner)
+        && (cube.block_pos == info.block_pos)
+        && (cube.pos == info.pos)
+        && (cube.now_rotation == info.now_rotation)) return;
+
+    cube = info;
+    version_ += 1;
+  }
+
+  void removeCube(const u_int id) {
+    auto it = cubes_.find(id);
+    if (it == std::end(cubes_)) return;
+
+    if (it->second.manipulate) player_version_ += 1;
+    cubes_.erase(it);
+    version_ += 1;
+  }
+
+  void updateStage(const StageInfo& info) {
+    if ((stage_.width == info.width)
+        && (stage_.length == info.length)
+        && (stage_.bottom_z == info.bottom_z)) return;
+
+    stage_ = info;
+    version_ += 1;
+  }
+
+
+  const std::map<u_int, CubeInfo>& cubes() const { return cubes_; }
+  const StageInfo& stage() const { return stage_; }
+
+  // 最初に登場した操作できるCube(いなければnullptr)
+  // owner:操作する人を限定する(-1は誰でも)
+  const CubeInfo* manipulatedCube(const int owner = -1) const {
+    for (const auto& cube : cubes_) {
+      if (!cube.second.manipulate) continue;
+      if ((owner < 0) || (cube.second.owner == owner)) return &cube.second;
+    }
+    return nullptr;
+  }
+
+  u_int version() const { return version_; }
+  u_int playerVersion() const { return player_version_; }
+
+};
+
+}